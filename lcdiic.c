@@ -13,6 +13,8 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <string.h>
+
 #include "hal.h"
 #include "lcdiic.h"
 
@@ -23,154 +25,1680 @@
  * 2. Wiki: https://en.wikipedia.org/wiki/Hitachi_HD44780_LCD_controller
  */
 
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/* Service thread work flags, per driver */
+#define LCDIIC_SVC_INIT_STEP        0x01    /* Next initialization step is due */
+#define LCDIIC_SVC_BACKLIGHT        0x02    /* Backlight change waited long enough */
+#define LCDIIC_SVC_BLINK            0x04    /* Next backlight blink phase is due */
+#define LCDIIC_SVC_POWER            0x08    /* Next power manager stage is due */
+#define LCDIIC_SVC_SCAN             0x10    /* Next scanout line is due */
+
+#define LCDIIC_SVC_EVENT            EVENT_MASK(0)
+
+/* Methods are only exported when they are called directly */
+#if LCDIIC_USE_VMT
+#define LCDIIC_METHOD               static
+#else
+#define LCDIIC_METHOD
+#endif
+
+/* Without a mutex per driver, all the drivers share the module lock */
+#if LCDIIC_USE_MUTEX
+#define lcdiicLock(drvp)            chMtxLock(&(drvp)->mutex)
+#define lcdiicTryLock(drvp)         chMtxTryLock(&(drvp)->mutex)
+#define lcdiicUnlock(drvp)          chMtxUnlock(&(drvp)->mutex)
+#else
+#define lcdiicLock(drvp)            chMtxLock(&lcdiic_lock)
+#define lcdiicTryLock(drvp)         chMtxTryLock(&lcdiic_lock)
+#define lcdiicUnlock(drvp)          chMtxUnlock(&lcdiic_lock)
+#endif
+
+/* Bytes put on the bus, address byte included */
+#if LCDIIC_USE_BACKGROUND
+#define lcdiicCountBytes(drvp, n)   ((drvp)->stats.busbytes += (n))
+#else
+#define lcdiicCountBytes(drvp, n)
+#endif
+
+/* D7..D0 on the port: the controller runs its 8-bit interface */
+#define lcdiicIsWide(drvp)          ((drvp)->config->portp->wide)
+
+/* Control bits with the mask pins high, encoded in so the transport sends
+ * the frames as they are */
+#define lcdiicPortBits(drvp, v)     ((uint8_t)((v) | (drvp)->config->portp->mask))
+
+/* A cell not read back yet on a warm start: the glass may hold anything */
+#if LCDIIC_USE_WARM_ADOPT
+#define lcdiicUnadopted(drvp, idx)  ((idx) >= (drvp)->adopt)
+#else
+#define lcdiicUnadopted(drvp, idx)  false
+#endif
+
+/* Explicit requests end any power saving, so do content changes */
+#if LCDIIC_USE_POWER
+#define lcdiicTouchLocked(drvp)     ((drvp)->touched = 1)
+#else
+#define lcdiicPowerWakeLocked(drvp)
+#define lcdiicPowerTouchedLocked(drvp)
+#define lcdiicTouchLocked(drvp)
+#endif
+
+#if LCDIIC_USE_DELAY_CALLBACKS
+#define lcdiicDelayUs(drvp, val)    (drvp)->delayUs(val)
+#define lcdiicDelayMs(drvp, val)    (drvp)->delayMs(val)
+#else
+#define lcdiicDelayUs(drvp, val)    LCDIIC_DELAY_US(val)
+#define lcdiicDelayMs(drvp, val)    LCDIIC_DELAY_MS(val)
+#endif
+
+/* Initialization steps, run one at a time by the service thread */
+enum {
+    LCDIIC_STEP_SYNC1 = 0,      /* Cold start: 8-bit resync */
+    LCDIIC_STEP_SYNC2,
+    LCDIIC_STEP_SYNC3,
+    LCDIIC_STEP_HOME,
+    LCDIIC_STEP_REPLAY,         /* Blank controller, replay the shadow */
+    LCDIIC_STEP_PROBE,          /* Warm start probe, the first step */
+    LCDIIC_STEP_WARM_READY,     /* Warm start, home done: ready */
+    LCDIIC_STEP_ADOPT,          /* Ready, DDRAM read back LCDIIC_ADOPT_CHUNK cells per step */
+};
+
+/* Cells read back per warm start adoption step */
+#define LCDIIC_ADOPT_CHUNK          8
+
+/*
+ * DDRAM address written and read back by the warm start probe. Read with the
+ * nibbles swapped, or written as two 8-bit instructions, it gives something
+ * else.
+ */
+#define LCDIIC_WARM_PROBE_ADDR      0x27
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+static MUTEX_DECL(lcdiic_lock);
+static LCDIICDriver *lcdiic_drivers;
+static thread_t *lcdiic_service;
+static THD_WORKING_AREA(waLcdiicService, LCDIIC_SERVICE_WA_SIZE);
+#if LCDIIC_USE_BACKGROUND
+static THD_WORKING_AREA(waLcdiicBackground, LCDIIC_BACKGROUND_WA_SIZE);
+#endif
+
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
-static void lcdiicWriteLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t val) {
-    PCF8574Driver *portdrvp = drvp->config->drvp;
-    uint8_t buf[6], cnt = 0;
+/* Shadow index of a DDRAM address, LCD_DDRAM_SIZE if the address has no cell */
+static uint8_t lcdiicDdramIndex(uint8_t addr) {
+    uint8_t col = addr & 0x3f;
+
+    if (col >= LCD_DDRAM_LINE_LEN) {
+        return LCD_DDRAM_SIZE;
+    }
+
+    return ((addr & 0x40) ? LCD_DDRAM_LINE_LEN : 0) + col;
+}
+
+static uint8_t lcdiicDdramAddr(uint8_t idx) {
+    return idx < LCD_DDRAM_LINE_LEN ? idx : 0x40 + idx - LCD_DDRAM_LINE_LEN;
+}
+
+/* Address counter after a RAM access or cursor shift to the right */
+static uint8_t lcdiicNextAc(uint8_t ac) {
+    if (ac & LCDIIC_AC_CGRAM) {
+        return LCDIIC_AC_CGRAM | ((ac + 1) & LCD_CGRAM_ADDR_MASK);
+    }
+
+    // In 2-line mode the address counter jumps across the line gaps
+    if (ac == 0x27) return 0x40;
+    if (ac == 0x67) return 0x00;
+
+    return (ac + 1) & LCD_DDRAM_ADDR_MASK;
+}
+
+/* Address counter after a cursor shift to the left */
+static uint8_t lcdiicPrevAc(uint8_t ac) {
+    if (ac & LCDIIC_AC_CGRAM) {
+        return LCDIIC_AC_CGRAM | ((ac - 1) & LCD_CGRAM_ADDR_MASK);
+    }
+
+    if (ac == 0x40) return 0x27;
+    if (ac == 0x00) return 0x67;
+
+    return (ac - 1) & LCD_DDRAM_ADDR_MASK;
+}
+
+/* Instruction that loads the address counter with ac */
+static uint8_t lcdiicAcCommand(uint8_t ac) {
+    if (ac & LCDIIC_AC_CGRAM) {
+        return LCD_CMD_SET_CGRAM_ADDR | (ac & LCD_CGRAM_ADDR_MASK);
+    }
+
+    return LCD_CMD_SET_DDRAM_ADDR | (ac & LCD_DDRAM_ADDR_MASK);
+}
+
+/* Function set: 2-line, 5x8 font, 8-bit interface on a wide port */
+static uint8_t lcdiicFunctionSet(LCDIICDriver *drvp) {
+    return LCD_CMD_FUNCTION_SET | LCD_DISPLAY_MODE | (lcdiicIsWide(drvp) ? LCD_BUS_MODE : 0x00);
+}
+
+/* Display control instruction, the power manager may hold the display off */
+static uint8_t lcdiicDisplayControl(LCDIICDriver *drvp) {
+#if LCDIIC_USE_POWER
+    if (drvp->power == LCDIIC_POWER_OFF) {
+        return LCD_CMD_DISPLAY_CONTROL | (drvp->dctl & ~LCD_DISPLAY_ON);
+    }
+#endif
+
+    return LCD_CMD_DISPLAY_CONTROL | drvp->dctl;
+}
+
+#if LCDIIC_USE_EVENTS
+#define lcdiicBroadcastLocked(drvp, flags) \
+    chEvtBroadcastFlags(&(drvp)->event, flags)
+#else
+#define lcdiicBroadcastLocked(drvp, flags)
+#endif
+
+/* The module stopped answering: keep the shadow, stay off the bus */
+static void lcdiicOfflineLocked(LCDIICDriver *drvp) {
+    if (drvp->state != LCDIIC_OFFLINE) {
+        lcdiicBroadcastLocked(drvp, LCDIIC_EVT_ERROR);
+    }
+    drvp->state = LCDIIC_OFFLINE;
+    drvp->framelen = 0;
+}
+
+#if LCDIIC_USE_MIRROR || defined(__DOXYGEN__)
+/* The frame of the group leader goes to every ready member, same bus */
+static msg_t lcdiicMirrorSendLocked(LCDIICDriver *drvp) {
+    LCDIICMirror *mp = drvp->mirror;
+    LCDIICDriver *members[LCDIIC_MIRROR_MAX];
+    LCDIICPort *ports[LCDIIC_MIRROR_MAX];
+    msg_t rets[LCDIIC_MIRROR_MAX];
+    uint8_t idx, n = 0;
+
+    for (idx = 0; idx < mp->n; idx++) {
+        if (mp->members[idx] == drvp || mp->members[idx]->state == LCDIIC_READY) {
+            members[n] = mp->members[idx];
+            ports[n++] = mp->members[idx]->config->portp;
+        }
+    }
+
+    lcdiicPortWriteGroup(ports, n, drvp->frame, drvp->framelen, rets);
+    mp->sent = 1;
+
+    for (idx = 1; idx < n; idx++) {
+        lcdiicCountBytes(members[idx], 1 + drvp->framelen);
+        if (rets[idx] != MSG_OK) {
+            lcdiicOfflineLocked(members[idx]);
+        }
+    }
+
+    return rets[0];
+}
+#endif
+
+#if LCDIIC_USE_QUEUE || defined(__DOXYGEN__)
+/* Wait for the queued frame, if any: a failure takes the driver offline */
+static msg_t lcdiicWaitLocked(LCDIICDriver *drvp) {
+    msg_t ret = MSG_OK;
+
+    if (drvp->queued) {
+        drvp->queued = 0;
+        ret = lcdiicPortWait(drvp->config->portp);
+        if (ret != MSG_OK) {
+            lcdiicOfflineLocked(drvp);
+        }
+    }
+
+    return ret;
+}
+#endif
+
+/* Send the pending frame as one port write */
+static msg_t lcdiicSendLocked(LCDIICDriver *drvp) {
+    LCDIICPort *portp = drvp->config->portp;
+    msg_t ret;
+
+#if LCDIIC_USE_QUEUE
+    /* Frames go out in order, the queued one first */
+    ret = lcdiicWaitLocked(drvp);
+    if (ret != MSG_OK) {
+        return ret;
+    }
+#endif
+
+    if (drvp->framelen == 0) {
+        return drvp->state == LCDIIC_OFFLINE ? MSG_RESET : MSG_OK;
+    }
+
+    lcdiicCountBytes(drvp, 1 + drvp->framelen);
+#if LCDIIC_USE_MIRROR
+    ret = drvp->mirror != NULL ? lcdiicMirrorSendLocked(drvp) :
+            lcdiicPortWrite(portp, drvp->frame, drvp->framelen);
+#else
+    ret = lcdiicPortWrite(portp, drvp->frame, drvp->framelen);
+#endif
+    drvp->framelen = 0;
+
+    if (ret != MSG_OK) {
+        lcdiicOfflineLocked(drvp);
+        return ret;
+    }
+
+    // Max execution time(!Clear display & !Return home) is 37us when f(OSC) is 270kHz
+    lcdiicDelayUs(drvp, 37);
+
+    return MSG_OK;
+}
+
+#if LCDIIC_USE_QUEUE || defined(__DOXYGEN__)
+/*
+ * Hand the pending frame to the port and encode on in the other buffer. No
+ * 37 us wait: the next frame follows this one on the bus and its first EN
+ * pulse is bytes later. Groups send at once.
+ */
+static msg_t lcdiicQueueLocked(LCDIICDriver *drvp) {
+    msg_t ret;
+
+#if LCDIIC_USE_MIRROR || LCDIIC_USE_SPAN
+    if (drvp->grouped) {
+        return lcdiicSendLocked(drvp);
+    }
+#endif
+#if LCDIIC_USE_MIRROR
+    if (drvp->mirror != NULL) {
+        return lcdiicSendLocked(drvp);
+    }
+#endif
+
+    ret = lcdiicWaitLocked(drvp);
+    if (ret != MSG_OK || drvp->framelen == 0) {
+        return ret;
+    }
+
+    lcdiicCountBytes(drvp, 1 + drvp->framelen);
+    ret = lcdiicPortSubmit(drvp->config->portp, drvp->frame, drvp->framelen);
+    if (ret != MSG_OK) {
+        lcdiicOfflineLocked(drvp);
+        return ret;
+    }
+    drvp->queued = 1;
+    drvp->frame = drvp->frames[drvp->frame == drvp->frames[0]];
+    drvp->framelen = 0;
+
+    return MSG_OK;
+}
+#else
+#define lcdiicQueueLocked(drvp)     lcdiicSendLocked(drvp)
+#endif
+
+/*
+ * A wide port runs the 8-bit interface: a write is the control byte then
+ * D7..D0, with EN high then low. RS and RW get a word of their own first when
+ * they change, to meet the setup time before EN rises.
+ */
+static uint8_t lcdiicEncodeWideLocked(LCDIICDriver *drvp, uint8_t *buf, uint8_t val) {
+    uint8_t prev, cnt = 0;
+
+    prev = drvp->framelen >= 2 ? drvp->frame[drvp->framelen - 2] :
+            lcdiicPortGetLatch(drvp->config->portp);
+
+    drvp->port.u.en = 0x00;
+    drvp->port.u.dt = 0x00;
+    if ((prev ^ drvp->port.v) & (LCDIIC_PORT_RS | LCDIIC_PORT_RW)) {
+        buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+        buf[cnt++] = val;
+    }
+
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v | LCDIIC_PORT_EN);
+    buf[cnt++] = val;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+    buf[cnt++] = val;
+
+    return cnt;
+}
+
+/* Append one write to the pending frame, sending the frame first if full */
+static void lcdiicEncodeLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t val) {
+    uint8_t *buf;
+    uint8_t cnt = 0;
+
+    if (drvp->state == LCDIIC_OFFLINE) {
+        return;
+    }
+
+    if (drvp->framelen + 6 > LCDIIC_FRAME_SIZE) {
+        lcdiicSendLocked(drvp);
+    }
+
+    buf = &drvp->frame[drvp->framelen];
+
+    /* The whole byte at once, whatever the mode */
+    if (lcdiicIsWide(drvp)) {
+        cnt = lcdiicEncodeWideLocked(drvp, buf, val);
+        goto done;
+    }
+
+    drvp->port.u.dt = (val >> 4) & 0x0F;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+
+    drvp->port.u.en = 0x01;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+
+    drvp->port.u.en = 0x00;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+
+    if (mode == LCDIIC_BUS_MODE_8BIT) {
+        goto done;
+    }
+
+    drvp->port.u.dt = (val >> 0) & 0x0F;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+
+    drvp->port.u.en = 0x01;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+
+    drvp->port.u.en = 0x00;
+    buf[cnt++] = lcdiicPortBits(drvp, drvp->port.v);
+
+done:
+    drvp->framelen += cnt;
+}
+
+static msg_t lcdiicWriteLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t val) {
+    lcdiicEncodeLocked(drvp, mode, val);
+    return lcdiicSendLocked(drvp);
+}
+
+/* One port word from the control bits, D7..D0 follow them on a wide port */
+static uint8_t lcdiicPortWordLocked(LCDIICDriver *drvp, uint8_t *buf) {
+    if (lcdiicIsWide(drvp)) {
+        buf[0] = lcdiicPortBits(drvp, drvp->port.v & ~LCDIIC_PORT_DATA);
+        buf[1] = 0xff;
+        return 2;
+    }
+
+    buf[0] = lcdiicPortBits(drvp, drvp->port.v);
+    return 1;
+}
+
+/*
+ * Clock one nibble out of the LCD: drive EN low then high and sample D7..D4
+ * after a repeated START, while EN is still high. The EN low of the next
+ * nibble also closes the current one, so only the last nibble needs an
+ * extra write. A wide port samples the whole byte.
+ */
+static msg_t lcdiicReadNibbleLocked(LCDIICDriver *drvp, uint8_t *nibble) {
+    LCDIICPort *portp = drvp->config->portp;
+    lcdiic_port_cfg portval;
+    msg_t ret;
+    uint8_t buf[4], rx[2];
+    uint8_t len;
+
+    drvp->port.u.en = 0x00;
+    len = lcdiicPortWordLocked(drvp, buf);
+    drvp->port.u.en = 0x01;
+    lcdiicPortWordLocked(drvp, &buf[len]);
+
+    lcdiicCountBytes(drvp, 3 + 3 * len);
+    ret = lcdiicPortXfer(portp, buf, 2 * len, rx, len);
+    if (ret == MSG_OK) {
+        portval.v = rx[0];
+        *nibble = len == 2 ? rx[1] : portval.u.dt;
+    }
+
+    return ret;
+}
+
+/* The read cycles of len bytes, each transfer acquires the bus on its own */
+static msg_t lcdiicReadCyclesLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t *val,
+        uint8_t len) {
+    LCDIICPort *portp = drvp->config->portp;
+    msg_t ret;
+    uint8_t idx, hi, lo;
+    uint8_t word[2], wlen;
+
+    /* Release D7..D4 so the LCD can drive them */
+    drvp->port.u.dt = 0x0f;
+
+    for (idx = 0; idx < len; idx++) {
+        ret = lcdiicReadNibbleLocked(drvp, &hi);
+        if (ret != MSG_OK) return ret;
+
+        if (lcdiicIsWide(drvp)) {
+            val[idx] = hi;
+            continue;
+        }
+
+        if (mode == LCDIIC_BUS_MODE_8BIT) {
+            val[idx] = hi << 4;
+            continue;
+        }
+
+        ret = lcdiicReadNibbleLocked(drvp, &lo);
+        if (ret != MSG_OK) return ret;
+
+        val[idx] = (hi << 4) | lo;
+    }
+
+    drvp->port.u.en = 0x00;
+    wlen = lcdiicPortWordLocked(drvp, word);
+    lcdiicCountBytes(drvp, 1 + wlen);
+    ret = lcdiicPortWrite(portp, word, wlen);
+
+    if (drvp->port.u.rs != 0x00 && drvp->port.u.rw != 0x01) {
+        lcdiicDelayUs(drvp, 37);
+    }
+
+    return ret;
+}
+
+/* Read len bytes, lease: one bus acquisition for the two transfers per byte */
+static msg_t lcdiicReadLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t *val, uint8_t len,
+        bool lease) {
+    LCDIICPort *portp = drvp->config->portp;
+    msg_t ret;
+
+    if (lease) {
+        lcdiicPortLease(portp);
+    }
+    ret = lcdiicReadCyclesLocked(drvp, mode, val, len);
+    if (lease) {
+        lcdiicPortRelease(portp);
+    }
+
+    if (ret != MSG_OK) {
+        lcdiicOfflineLocked(drvp);
+    }
+
+    return ret;
+}
+
+/* Write to instruction register */
+static msg_t lcdiicIrWriteLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t val) {
+    drvp->port.u.rs = 0x00;
+    drvp->port.u.rw = 0x00;
+    return lcdiicWriteLocked(drvp, mode, val);
+}
+
+static void lcdiicIrEncodeLocked(LCDIICDriver *drvp, uint8_t val) {
+    drvp->port.u.rs = 0x00;
+    drvp->port.u.rw = 0x00;
+    lcdiicEncodeLocked(drvp, LCDIIC_BUS_MODE_4BIT, val);
+}
+
+/* Write to data register */
+static void lcdiicDrEncodeLocked(LCDIICDriver *drvp, uint8_t val) {
+    drvp->port.u.rs = 0x01;
+    drvp->port.u.rw = 0x00;
+    lcdiicEncodeLocked(drvp, LCDIIC_BUS_MODE_4BIT, val);
+}
+
+/* Check if busy: 0 - idle, 1 - busy  */
+static int8_t lcdiicCheckBusyLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t *addr) {
+    uint8_t val;
+    msg_t ret;
+
+    drvp->port.u.rs = 0x00;
+    drvp->port.u.rw = 0x01;
+    ret = lcdiicReadLocked(drvp, mode, &val, 1, true);
+
+    if (addr != NULL) {
+        *addr = (ret == MSG_OK) ? (val & LCD_ADDRESS_COUNTER) : 0xff;
+    }
+
+    return ret == MSG_OK ? (val & LCD_BUSY_FLAG) != 0 : 1;
+}
+
+#if LCDIIC_USE_READBACK || defined(__DOXYGEN__)
+/* Set the CGRAM/DDRAM address, then read len bytes using auto-increment */
+static msg_t lcdiicDrReadBlockLocked(LCDIICDriver *drvp, uint8_t ac, uint8_t *val, uint8_t len,
+        bool lease) {
+    msg_t ret;
+    uint8_t idx;
+
+    ret = lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, lcdiicAcCommand(ac));
+    if (ret != MSG_OK) return ret;
+
+    drvp->port.u.rs = 0x01;
+    drvp->port.u.rw = 0x01;
+    ret = lcdiicReadLocked(drvp, LCDIIC_BUS_MODE_4BIT, val, len, lease);
+
+    for (idx = 0; idx < len; idx++) {
+        ac = lcdiicNextAc(ac);
+    }
+    drvp->ac = drvp->hwac = ac;
+
+    return ret;
+}
+#endif /* LCDIIC_USE_READBACK */
+
+#if LCDIIC_USE_SCREENS || defined(__DOXYGEN__)
+/*
+ * Send a prerendered stream. Plain records go from flash to the bus as they
+ * are, only repeated writes are expanded into the frame buffer.
+ */
+static msg_t lcdiicSendStreamLocked(LCDIICDriver *drvp, const uint8_t *stream) {
+    LCDIICPort *portp = drvp->config->portp;
+    msg_t ret = MSG_OK;
+    uint8_t hdr;
+
+    while (ret == MSG_OK && (hdr = *stream++) != LCDIIC_STREAM_END) {
+        if (hdr & LCDIIC_STREAM_RLE) {
+            uint8_t cnt = hdr & ~LCDIIC_STREAM_RLE;
+
+            while (ret == MSG_OK && cnt > 0) {
+                for (; cnt > 0 && drvp->framelen + 6 <= LCDIIC_FRAME_SIZE; cnt--) {
+                    memcpy(&drvp->frame[drvp->framelen], stream, 6);
+                    drvp->framelen += 6;
+                }
+                ret = lcdiicSendLocked(drvp);
+            }
+            stream += 6;
+        } else {
+            /* Without a mask the record goes out as it is */
+            lcdiicCountBytes(drvp, 1 + hdr);
+            ret = lcdiicPortWrite(portp, stream, hdr);
+            stream += hdr;
+        }
+    }
+
+    if (ret != MSG_OK) {
+        lcdiicOfflineLocked(drvp);
+    }
+
+    return ret;
+}
+#endif /* LCDIIC_USE_SCREENS */
+
+#if LCDIIC_USE_SCANOUT || defined(__DOXYGEN__)
+/* One 4-bit write into a 6 bytes slot of the scan frame */
+static void lcdiicScanEncodeLocked(LCDIICDriver *drvp, uint8_t *buf, uint8_t rs, uint8_t val) {
+    uint8_t ctl = lcdiicPortBits(drvp, (rs ? LCDIIC_PORT_RS : 0x00) |
+            (drvp->scanbl ? LCDIIC_PORT_BL : 0x00));
+
+    buf[0] = ctl | (val & 0xf0);
+    buf[1] = buf[0] | LCDIIC_PORT_EN;
+    buf[2] = buf[0];
+    buf[3] = ctl | (uint8_t)(val << 4);
+    buf[4] = buf[3] | LCDIIC_PORT_EN;
+    buf[5] = buf[3];
+}
+
+/* A shadow cell changed: patch its slot, false if the scanout does not show it */
+static bool lcdiicScanPutLocked(LCDIICDriver *drvp, uint8_t idx) {
+    uint8_t line = idx / LCD_DDRAM_LINE_LEN;
+    uint8_t col = idx % LCD_DDRAM_LINE_LEN;
+
+    if (drvp->scanival == 0 || col >= LCDIIC_SCANOUT_COLS) {
+        return false;
+    }
+
+    lcdiicScanEncodeLocked(drvp, &drvp->scan[line][6 * (col + 1)], 1, drvp->ddram[idx]);
+    drvp->scanstale |= 1 << line;
+
+    return true;
+}
+
+/* Encode the scan frame from the shadow, its cells are no longer flushed */
+static void lcdiicScanBuildLocked(LCDIICDriver *drvp) {
+    uint8_t line, col;
+
+    if (drvp->scanival == 0) {
+        return;
+    }
+
+    drvp->scanbl = drvp->port.u.bl;
+    for (line = 0; line < 2; line++) {
+        lcdiicScanEncodeLocked(drvp, drvp->scan[line], 0,
+                LCD_CMD_SET_DDRAM_ADDR | lcdiicDdramAddr(line * LCD_DDRAM_LINE_LEN));
+
+        for (col = 0; col < LCDIIC_SCANOUT_COLS; col++) {
+            uint8_t idx = line * LCD_DDRAM_LINE_LEN + col;
+
+            lcdiicScanEncodeLocked(drvp, &drvp->scan[line][6 * (col + 1)], 1, drvp->ddram[idx]);
+            drvp->dirty[idx >> 3] &= ~(1 << (idx & 0x07));
+        }
+    }
+    drvp->scanstale = 0x03;
+}
+#else
+#define lcdiicScanPutLocked(drvp, idx)  false
+#define lcdiicScanBuildLocked(drvp)
+#endif
+
+/* Store a data write at the shadow address counter */
+static void lcdiicPutLocked(LCDIICDriver *drvp, uint8_t val) {
+    uint8_t ac = drvp->ac;
+
+    if (ac & LCDIIC_AC_CGRAM) {
+        uint8_t addr = ac & LCD_CGRAM_ADDR_MASK;
+        uint8_t bit = 1 << (addr >> 3);
+
+        if (drvp->cgram[addr] != val || !(drvp->cgused & bit)) {
+            drvp->cgram[addr] = val;
+            drvp->cgdirty |= bit;
+            lcdiicTouchLocked(drvp);
+        }
+        drvp->cgused |= bit;
+    } else {
+        uint8_t idx = lcdiicDdramIndex(ac);
+
+        if (idx < LCD_DDRAM_SIZE && (drvp->ddram[idx] != val || lcdiicUnadopted(drvp, idx))) {
+            drvp->ddram[idx] = val;
+            lcdiicTouchLocked(drvp);
+            if (!lcdiicScanPutLocked(drvp, idx)) {
+                drvp->dirty[idx >> 3] |= 1 << (idx & 0x07);
+            }
+        }
+    }
+
+    drvp->ac = lcdiicNextAc(ac);
+}
+
+#if LCDIIC_USE_EVENTS || defined(__DOXYGEN__)
+static uint8_t lcdiicPendingLocked(LCDIICDriver *drvp) {
+    uint8_t idx, cnt = 0;
+
+    for (idx = 0; idx < LCD_DDRAM_SIZE / 8; idx++) {
+        uint8_t bits = drvp->dirty[idx];
+
+        for (; bits != 0; bits &= bits - 1) {
+            cnt++;
+        }
+    }
+
+    return cnt;
+}
+
+/* Broadcast LCDIIC_EVT_LOW_WATER once the backlog of a commit drained */
+static void lcdiicLowWaterLocked(LCDIICDriver *drvp) {
+    if (drvp->lowwater && lcdiicPendingLocked(drvp) < LCDIIC_LOW_WATER) {
+        drvp->lowwater = 0;
+        lcdiicBroadcastLocked(drvp, LCDIIC_EVT_LOW_WATER);
+    }
+}
+#else
+#define lcdiicLowWaterLocked(drvp)
+#endif
+
+static void lcdiicPutPatternLocked(LCDIICDriver *drvp, uint8_t pos, const uint8_t *pat) {
+    uint8_t idx;
+
+    drvp->ac = LCDIIC_AC_CGRAM | ((pos & 0x07) << 3);
+
+    for (idx = 0; idx < 8; idx++) {
+        lcdiicPutLocked(drvp, pat[idx]);
+    }
+}
+
+/* Store text from row, col, within one DDRAM line; returns the length stored */
+static uint8_t lcdiicPutTextLocked(LCDIICDriver *drvp, uint8_t row, uint8_t col,
+        const char *text, uint8_t len) {
+    uint8_t idx;
+
+    drvp->ac = (row * LCD_LINE_MAX_LEN + col) & LCD_DDRAM_ADDR_MASK;
+
+    for (idx = 0; idx < LCD_LINE_MAX_LEN && idx < len; idx++) {
+        lcdiicPutLocked(drvp, text[idx]);
+    }
+
+    return idx;
+}
+
+/*
+ * Chunk boundary: when room more bytes would make the transaction longer than
+ * LCDIIC_CHUNK_SIZE, send it, then with preempt let the threads waiting on the
+ * driver go first. True if the lock was released, the shadow may have changed.
+ */
+static bool lcdiicChunkLocked(LCDIICDriver *drvp, uint8_t room, bool preempt) {
+    if (drvp->framelen == 0 || drvp->framelen + room <= LCDIIC_CHUNK_SIZE) {
+        return false;
+    }
+
+    lcdiicQueueLocked(drvp);
+    lcdiicLowWaterLocked(drvp);
+#if LCDIIC_USE_MIRROR || LCDIIC_USE_SPAN
+    /* The other members of a group stay locked */
+    preempt = preempt && !drvp->grouped;
+#endif
+    if (!preempt) {
+        return false;
+    }
+
+    /* The mutex goes to the highest priority waiter, if any */
+    drvp->flushing++;
+    lcdiicUnlock(drvp);
+    lcdiicLock(drvp);
+    drvp->flushing--;
+
+    return true;
+}
+
+/* Send the dirty ones among cnt cells from first, false if preempted */
+static bool lcdiicFlushCellsLocked(LCDIICDriver *drvp, uint8_t first, uint8_t cnt, bool preempt) {
+    uint8_t n;
+
+    for (n = 0; n < cnt; n++) {
+        uint8_t idx = (first + n) % LCD_DDRAM_SIZE;
+        uint8_t addr;
+
+        if (!(drvp->dirty[idx >> 3] & (1 << (idx & 0x07)))) continue;
+
+        addr = lcdiicDdramAddr(idx);
+        if (lcdiicChunkLocked(drvp, drvp->hwac != addr ? 12 : 6, preempt)) {
+            return false;
+        }
+        drvp->dirty[idx >> 3] &= ~(1 << (idx & 0x07));
+
+        if (drvp->hwac != addr) {
+            lcdiicIrEncodeLocked(drvp, LCD_CMD_SET_DDRAM_ADDR | addr);
+        }
+        lcdiicDrEncodeLocked(drvp, drvp->ddram[idx]);
+        drvp->hwac = lcdiicNextAc(addr);
+    }
+
+    return true;
+}
+
+/* Send the last frame of a flush and tell the listeners */
+static msg_t lcdiicFinishLocked(LCDIICDriver *drvp) {
+    bool sent = drvp->framelen > 0;
+    msg_t ret;
+
+    ret = lcdiicSendLocked(drvp);
+    if (ret == MSG_OK && sent) {
+        lcdiicLowWaterLocked(drvp);
+        lcdiicBroadcastLocked(drvp, LCDIIC_EVT_FLUSHED);
+    }
+
+    return ret;
+}
+
+#if LCDIIC_USE_BACKGROUND || defined(__DOXYGEN__)
+/* A cell shows the pattern, character codes 0x08..0x0f mirror 0x00..0x07 */
+static bool lcdiicPatternShownLocked(LCDIICDriver *drvp, uint8_t pos) {
+    uint8_t idx;
+
+    for (idx = 0; idx < LCD_DDRAM_SIZE; idx++) {
+        if ((drvp->ddram[idx] & 0xf7) == pos) {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
+static void lcdiicPatternEncodeLocked(LCDIICDriver *drvp, uint8_t pos) {
+    uint8_t idx;
+
+    drvp->cgdirty &= ~(1 << pos);
+#if LCDIIC_USE_BACKGROUND
+    drvp->cgahead &= ~(1 << pos);
+#endif
+
+    lcdiicIrEncodeLocked(drvp, LCD_CMD_SET_CGRAM_ADDR | (pos << 3));
+    for (idx = 0; idx < 8; idx++) {
+        lcdiicDrEncodeLocked(drvp, drvp->cgram[(pos << 3) + idx]);
+    }
+    drvp->hwac = LCDIIC_AC_CGRAM | (((pos + 1) << 3) & LCD_CGRAM_ADDR_MASK);
+}
+
+/*
+ * Send dirty patterns and cells, then move the address counter to its place.
+ * The scan starts over after each preemption, to also send what was written
+ * meanwhile.
+ */
+static msg_t lcdiicFlushLocked(LCDIICDriver *drvp) {
+    uint8_t pos;
+
+again:
+    if (drvp->state != LCDIIC_READY) {
+        return MSG_RESET;
+    }
+
+    for (pos = 0; pos < 8; pos++) {
+        if (!(drvp->cgdirty & (1 << pos))) continue;
+#if LCDIIC_USE_BACKGROUND
+        if ((drvp->cgahead & (1 << pos)) && !lcdiicPatternShownLocked(drvp, pos)) continue;
+#endif
+        if (lcdiicChunkLocked(drvp, 9 * 6, true)) {
+            goto again;
+        }
+        lcdiicPatternEncodeLocked(drvp, pos);
+    }
+
+    if (!lcdiicFlushCellsLocked(drvp, 0, LCD_DDRAM_SIZE, true)) {
+        goto again;
+    }
+
+    if (drvp->hwac != drvp->ac) {
+        lcdiicIrEncodeLocked(drvp, lcdiicAcCommand(drvp->ac));
+        drvp->hwac = drvp->ac;
+    }
+
+    return lcdiicFinishLocked(drvp);
+}
+
+/*
+ * Flush at the end of a method, unless a batch defers it to lcdiicBatchEnd(),
+ * a paused flush will send it when it resumes, or the display is powered off
+ * until the next wake.
+ */
+static msg_t lcdiicCommitLocked(LCDIICDriver *drvp) {
+#if LCDIIC_USE_EVENTS
+    if (drvp->batch == 0 && lcdiicPendingLocked(drvp) >= LCDIIC_LOW_WATER) {
+        drvp->lowwater = 1;
+    }
+#endif
+
+    if (drvp->batch > 0 || drvp->flushing > 0) {
+        return MSG_OK;
+    }
+#if LCDIIC_USE_POWER
+    if (drvp->power == LCDIIC_POWER_OFF) {
+        return MSG_OK;
+    }
+#endif
+
+    return lcdiicFlushLocked(drvp);
+}
+
+static void lcdiicSvcSignalFromISR(LCDIICDriver *drvp, uint8_t flags) {
+    chSysLockFromISR();
+    drvp->svcflags |= flags;
+    chEvtSignalI(lcdiic_service, LCDIIC_SVC_EVENT);
+    chSysUnlockFromISR();
+}
+
+static void lcdiicStepTimer(void *p) {
+    lcdiicSvcSignalFromISR((LCDIICDriver *)p, LCDIIC_SVC_INIT_STEP);
+}
+
+#if LCDIIC_BACKLIGHT_LATENCY > 0
+static void lcdiicBacklightTimer(void *p) {
+    lcdiicSvcSignalFromISR((LCDIICDriver *)p, LCDIIC_SVC_BACKLIGHT);
+}
+#endif
+
+#if LCDIIC_USE_BLINK || defined(__DOXYGEN__)
+static void lcdiicBlinkTimer(void *p) {
+    lcdiicSvcSignalFromISR((LCDIICDriver *)p, LCDIIC_SVC_BLINK);
+}
+#endif
+
+#if LCDIIC_USE_POWER || defined(__DOXYGEN__)
+static void lcdiicPowerTimer(void *p) {
+    lcdiicSvcSignalFromISR((LCDIICDriver *)p, LCDIIC_SVC_POWER);
+}
+#endif
+
+#if LCDIIC_USE_SCANOUT || defined(__DOXYGEN__)
+/* Periodic: each expiry arms the next one */
+static void lcdiicScanTimer(void *p) {
+    LCDIICDriver *drvp = (LCDIICDriver *)p;
+
+    chSysLockFromISR();
+    chVTSetI(&drvp->scanvt, MS2ST(drvp->scanival), lcdiicScanTimer, drvp);
+    drvp->svcflags |= LCDIIC_SVC_SCAN;
+    chEvtSignalI(lcdiic_service, LCDIIC_SVC_EVENT);
+    chSysUnlockFromISR();
+}
+#endif
+
+/* Run the next initialization step once ms milliseconds have elapsed */
+static void lcdiicStepAfterLocked(LCDIICDriver *drvp, uint32_t ms) {
+    chVTSet(&drvp->vt, MS2ST(ms), lcdiicStepTimer, drvp);
+}
+
+/* Initialization is over, successfully or not: release lcdiicWaitReady() */
+static void lcdiicInitDoneLocked(LCDIICDriver *drvp) {
+    chSysLock();
+    chThdDequeueAllI(&drvp->waiting, drvp->state == LCDIIC_READY ? MSG_OK : MSG_RESET);
+    chSchRescheduleS();
+    chSysUnlock();
+}
+
+/* Start the initialization sequence, the first step runs after ms milliseconds */
+static void lcdiicBeginInitLocked(LCDIICDriver *drvp, uint32_t ms) {
+    drvp->state = LCDIIC_INIT;
+    drvp->framelen = 0;
+    drvp->step = LCDIIC_STEP_SYNC1;
+#if LCDIIC_USE_WARM_ADOPT
+    drvp->adopt = LCD_DDRAM_SIZE;
+#endif
+
+    lcdiicStepAfterLocked(drvp, ms);
+}
+
+#if LCDIIC_USE_WARM_START || defined(__DOXYGEN__)
+/* Run the next initialization step as soon as the service thread gets to it */
+static void lcdiicStepNowLocked(LCDIICDriver *drvp) {
+    chSysLock();
+    drvp->svcflags |= LCDIIC_SVC_INIT_STEP;
+    chSysUnlock();
+    chEvtSignal(lcdiic_service, LCDIIC_SVC_EVENT);
+}
+
+/*
+ * Warm start probe, for a controller that kept its power across an MCU reset.
+ * Only a busy flag/address counter read and a DDRAM address set are used, and
+ * any unexpected answer falls back to the full initialization, so it is safe
+ * whatever the controller state. A controller left between the two nibbles of
+ * an instruction answers with the nibbles swapped: one single nibble read
+ * brings it back in phase before the second attempt.
+ */
+static bool lcdiicWarmProbeLocked(LCDIICDriver *drvp) {
+    uint8_t val, attempt;
+
+    drvp->port.u.rs = 0x00;
+    drvp->port.u.rw = 0x01;
+    if (lcdiicReadLocked(drvp, LCDIIC_BUS_MODE_4BIT, &val, 1, true) != MSG_OK) {
+        return false;
+    }
+
+    /* Busy right after reset: still running its power-on initialization */
+    if (val & LCD_BUSY_FLAG) {
+        return false;
+    }
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        if (lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT,
+                LCD_CMD_SET_DDRAM_ADDR | LCDIIC_WARM_PROBE_ADDR) != MSG_OK) {
+            return false;
+        }
+
+        drvp->port.u.rs = 0x00;
+        drvp->port.u.rw = 0x01;
+        if (lcdiicReadLocked(drvp, LCDIIC_BUS_MODE_4BIT, &val, 1, true) != MSG_OK) {
+            return false;
+        }
+
+        if (val == LCDIIC_WARM_PROBE_ADDR) {
+            return true;
+        }
+
+        /* One EN pulse: a single nibble */
+        if (lcdiicReadLocked(drvp, LCDIIC_BUS_MODE_8BIT, &val, 1, true) != MSG_OK) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * The controller is already in 4-bit mode: skip the resync and its waits, the
+ * driver is ready once the last instruction of one frame is done. Return home
+ * undoes any display shift left by the previous run and the DDRAM contents
+ * are adopted afterwards, or a clear drops them.
+ */
+static void lcdiicBeginWarmLocked(LCDIICDriver *drvp) {
+    lcdiicIrEncodeLocked(drvp, lcdiicFunctionSet(drvp));
+    lcdiicIrEncodeLocked(drvp, LCD_CMD_ENTRY_MODE_SET | LCD_ENTRY_MODE_INC);
+    lcdiicIrEncodeLocked(drvp, lcdiicDisplayControl(drvp));
+#if LCDIIC_USE_WARM_ADOPT
+    lcdiicIrEncodeLocked(drvp, LCD_CMD_RETURN_HOME);
+    drvp->step = LCDIIC_STEP_WARM_READY;
+#else
+    lcdiicIrEncodeLocked(drvp, LCD_CMD_CLEAR_DISPLAY);
+    drvp->step = LCDIIC_STEP_REPLAY;
+#endif
+    lcdiicSendLocked(drvp);
+    drvp->hwac = 0x00;
+
+    lcdiicStepAfterLocked(drvp, 2);
+}
+#endif /* LCDIIC_USE_WARM_START */
+
+#if LCDIIC_USE_WARM_ADOPT || defined(__DOXYGEN__)
+/*
+ * Background step of a ready driver: read the next chunk of DDRAM back into
+ * the shadow. Cells written since the start are dirty or already on the
+ * glass, only the others take the controller contents.
+ */
+static void lcdiicAdoptStepLocked(LCDIICDriver *drvp) {
+    uint8_t buf[LCDIIC_ADOPT_CHUNK];
+    uint8_t first = drvp->adopt;
+    uint8_t ac = drvp->ac, idx;
+
+    if (drvp->state != LCDIIC_READY || first >= LCD_DDRAM_SIZE) {
+        return;
+    }
+
+    if (lcdiicFlushLocked(drvp) != MSG_OK || lcdiicDrReadBlockLocked(drvp,
+            lcdiicDdramAddr(first), buf, sizeof(buf), true) != MSG_OK) {
+        drvp->adopt = LCD_DDRAM_SIZE;
+        return;
+    }
+    drvp->ac = ac;
+
+    for (idx = 0; idx < sizeof(buf); idx++) {
+        uint8_t pos = first + idx;
+
+        if (!(drvp->dirty[pos >> 3] & (1 << (pos & 0x07)))) {
+            drvp->ddram[pos] = buf[idx];
+        }
+    }
+
+    drvp->adopt = first + sizeof(buf);
+    if (drvp->adopt < LCD_DDRAM_SIZE) {
+        lcdiicStepAfterLocked(drvp, 1);
+    } else {
+        lcdiicScanBuildLocked(drvp);
+    }
+}
+#endif /* LCDIIC_USE_WARM_ADOPT */
+
+/*
+ * The controller comes out of the init sequence blank, so only non-blank
+ * cells, the patterns in use, the display shift and the display control are
+ * replayed from the shadow, together with whatever was written meanwhile.
+ */
+static void lcdiicReplayLocked(LCDIICDriver *drvp) {
+    uint8_t idx;
+
+    for (idx = 0; idx < LCD_DDRAM_SIZE; idx++) {
+        if (drvp->ddram[idx] != ' ') {
+            drvp->dirty[idx >> 3] |= 1 << (idx & 0x07);
+        } else {
+            drvp->dirty[idx >> 3] &= ~(1 << (idx & 0x07));
+        }
+    }
+    drvp->cgdirty = drvp->cgused;
+
+    for (idx = 0; idx < drvp->dshift; idx++) {
+        lcdiicIrEncodeLocked(drvp, LCD_CMD_CONTENT_SHIFT | LCD_SHIFT_DISPLAY | LCD_SHIFT_TO_RIGHT);
+    }
+
+    /* 8. Display control from the shadow: display on, cursor off, blink off by default */
+    lcdiicIrEncodeLocked(drvp, lcdiicDisplayControl(drvp));
+
+    drvp->state = LCDIIC_READY;
+    lcdiicFlushLocked(drvp);
+}
+
+/*
+ * LCD Initialize - 4-Bit Interface, one step per call. Steps are separated by
+ * timer waits instead of sleeps, so the caller of lcdiicStart() is not held
+ * and the waits of several displays overlap.
+ */
+static void lcdiicInitStepLocked(LCDIICDriver *drvp) {
+#if LCDIIC_USE_WARM_ADOPT
+    if (drvp->step == LCDIIC_STEP_ADOPT) {
+        lcdiicAdoptStepLocked(drvp);
+        return;
+    }
+#endif
+
+    if (drvp->state != LCDIIC_INIT) {
+        return;
+    }
+
+    switch (drvp->step) {
+    case LCDIIC_STEP_SYNC1:
+        /* 1. Wait time > 40ms: done before the first step */
+
+        /* 2. Mode selection: from unknown mode to 4-bit mode */
+        /* https://en.wikipedia.org/wiki/Hitachi_HD44780_LCD_controller */
+        /* - State1: 8-bit mode */
+        /* - State2: 4-bit mode, waiting for the first set of 4 bits */
+        /* - State3: 4-bit mode, waiting for the second set of 4 bits */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+        /* Wait time > 4.1ms */
+        drvp->step = LCDIIC_STEP_SYNC2;
+        lcdiicStepAfterLocked(drvp, 5);
+        break;
+
+    case LCDIIC_STEP_SYNC2:
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+        /* Wait time > 100us */
+        drvp->step = LCDIIC_STEP_SYNC3;
+        lcdiicStepAfterLocked(drvp, 1);
+        break;
+
+    case LCDIIC_STEP_SYNC3:
+        /* The LCD is now in either state1 or state3 */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+
+        /* Now that the LCD is definitely in 8-bit mode, switch to 4-bit mode */
+        if (!lcdiicIsWide(drvp)) {
+            lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET);
+        }
+
+        /* 3. Function set: number of display lines and character font */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, lcdiicFunctionSet(drvp));
+
+        /* 4. Display off */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_DISPLAY_CONTROL);
+
+        /* 5. Display clear */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_CLEAR_DISPLAY);
+        drvp->step = LCDIIC_STEP_HOME;
+        lcdiicStepAfterLocked(drvp, 2);
+        break;
+
+    case LCDIIC_STEP_HOME:
+        /* 6. Entry mode set */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_ENTRY_MODE_SET | LCD_ENTRY_MODE_INC);
+
+        /* 7. Return home */
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_RETURN_HOME);
+        drvp->step = LCDIIC_STEP_REPLAY;
+        lcdiicStepAfterLocked(drvp, 2);
+        break;
+
+    case LCDIIC_STEP_REPLAY:
+        lcdiicCheckBusyLocked(drvp, LCDIIC_BUS_MODE_4BIT, NULL);
+        drvp->hwac = 0x00;
+
+        if (drvp->state == LCDIIC_INIT) {
+            lcdiicReplayLocked(drvp);
+        }
+        break;
+
+#if LCDIIC_USE_WARM_START
+    case LCDIIC_STEP_PROBE:
+        /* Cold: the full sequence, the power-on wait counted from here */
+        if (lcdiicWarmProbeLocked(drvp)) {
+            lcdiicBeginWarmLocked(drvp);
+        } else if (drvp->state == LCDIIC_INIT) {
+            lcdiicBeginInitLocked(drvp, 40);
+        }
+        break;
+#endif
+
+#if LCDIIC_USE_WARM_ADOPT
+    case LCDIIC_STEP_WARM_READY: {
+        uint8_t idx;
+
+        lcdiicCheckBusyLocked(drvp, LCDIIC_BUS_MODE_4BIT, NULL);
+        if (drvp->state != LCDIIC_INIT) {
+            break;
+        }
+
+        /* Ready now: what was written meanwhile goes out */
+        for (idx = 0; idx < drvp->dshift; idx++) {
+            lcdiicIrEncodeLocked(drvp, LCD_CMD_CONTENT_SHIFT | LCD_SHIFT_DISPLAY | LCD_SHIFT_TO_RIGHT);
+        }
+        drvp->state = LCDIIC_READY;
+        lcdiicFlushLocked(drvp);
+        break;
+    }
+#endif
+    }
+
+    /* A failed step leaves the driver offline, lcdiicProbe() starts over */
+    if (drvp->state != LCDIIC_INIT) {
+        chVTReset(&drvp->vt);
+        lcdiicInitDoneLocked(drvp);
+#if LCDIIC_USE_WARM_ADOPT
+        /* After a warm start the rest of the DDRAM is read back in the background */
+        if (drvp->state == LCDIIC_READY && drvp->adopt < LCD_DDRAM_SIZE) {
+            drvp->step = LCDIIC_STEP_ADOPT;
+            lcdiicStepAfterLocked(drvp, 1);
+        }
+#endif
+    }
+}
+
+/* Backlight bit the port drives, a different port.u.bl is pending (blvt) */
+static uint8_t lcdiicBacklightSent(LCDIICDriver *drvp) {
+    if (drvp->config == NULL) {
+        return drvp->port.u.bl;
+    }
+
+    return !!(lcdiicPortGetLatch(drvp->config->portp) & LCDIIC_PORT_BL);
+}
+
+/* Send the backlight bit alone, when no frame carried it */
+static void lcdiicBacklightSendLocked(LCDIICDriver *drvp) {
+    if (drvp->config == NULL || drvp->state == LCDIIC_OFFLINE ||
+            drvp->port.u.bl == lcdiicBacklightSent(drvp)) {
+        return;
+    }
+
+    /* Only the backlight pin changes, the latch keeps the others */
+    lcdiicCountBytes(drvp, 2);
+    if (lcdiicPortWriteMasked(drvp->config->portp, LCDIIC_PORT_BL,
+            drvp->port.u.bl ? LCDIIC_PORT_BL : 0x00) != MSG_OK) {
+        lcdiicOfflineLocked(drvp);
+    }
+}
+
+/*
+ * The backlight bit is part of every frame: a change rides on the next one,
+ * and is only sent alone when no frame went out within
+ * LCDIIC_BACKLIGHT_LATENCY milliseconds.
+ */
+static void lcdiicBacklightLocked(LCDIICDriver *drvp, uint8_t on) {
+    drvp->port.u.bl = !!on;
+
+#if LCDIIC_BACKLIGHT_LATENCY > 0
+    if (drvp->port.u.bl != lcdiicBacklightSent(drvp) && !chVTIsArmed(&drvp->blvt)) {
+        chVTSet(&drvp->blvt, MS2ST(LCDIIC_BACKLIGHT_LATENCY), lcdiicBacklightTimer, drvp);
+    }
+#else
+    lcdiicBacklightSendLocked(drvp);
+#endif
+}
+
+#if LCDIIC_USE_BLINK || defined(__DOXYGEN__)
+/* Backlight off for blinkoff, then on for blinkon, blinkcnt times */
+static void lcdiicBlinkStepLocked(LCDIICDriver *drvp) {
+    if (drvp->blinkon == 0) {
+        return;
+    }
+
+    if (drvp->port.u.bl) {
+        lcdiicBacklightLocked(drvp, 0);
+        chVTSet(&drvp->blinkvt, MS2ST(drvp->blinkoff), lcdiicBlinkTimer, drvp);
+    } else {
+        lcdiicBacklightLocked(drvp, 1);
+        if (drvp->blinkcnt != 0 && --drvp->blinkcnt == 0) {
+            /* Last cycle done, the backlight stays on */
+            drvp->blinkon = 0;
+        } else {
+            chVTSet(&drvp->blinkvt, MS2ST(drvp->blinkon), lcdiicBlinkTimer, drvp);
+        }
+    }
+}
+#endif
+
+#if LCDIIC_USE_POWER || defined(__DOXYGEN__)
+static void lcdiicPowerEnterLocked(LCDIICDriver *drvp, lcdiic_power_t stage) {
+    if (stage >= LCDIIC_POWER_DARK && drvp->power < LCDIIC_POWER_DARK) {
+        drvp->blsaved = drvp->port.u.bl;
+#if LCDIIC_USE_BLINK
+        /* Blinking ends with the backlight on */
+        if (drvp->blinkon != 0) {
+            drvp->blsaved = 0x01;
+            drvp->blinkon = 0;
+            chVTReset(&drvp->blinkvt);
+        }
+#endif
+        chVTReset(&drvp->blvt);
+        drvp->port.u.bl = 0x00;
+        lcdiicBacklightSendLocked(drvp);
+    }
+
+    drvp->power = stage;
+
+    if (stage == LCDIIC_POWER_OFF) {
+        if (drvp->state == LCDIIC_READY) {
+            lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, lcdiicDisplayControl(drvp));
+        }
+        /* The backend keeps the bus up while other users are left on it */
+        lcdiicPortIdle(drvp->config->portp);
+    }
+}
+
+/* Enter the stages whose idle time has elapsed, then wait for the next one */
+static void lcdiicPowerStepLocked(LCDIICDriver *drvp) {
+    systime_t elapsed = chVTTimeElapsedSinceX(drvp->activity);
+    uint8_t stage;
+
+    if (drvp->config == NULL || drvp->state == LCDIIC_STOP) {
+        return;
+    }
+
+    for (stage = drvp->power + 1; stage <= LCDIIC_POWER_OFF; stage++) {
+        systime_t idle = S2ST(drvp->config->idlesec[stage - 1]);
+
+        if (idle == 0) {
+            continue;
+        }
+        if (elapsed < idle) {
+            chVTSet(&drvp->powervt, idle - elapsed, lcdiicPowerTimer, drvp);
+            return;
+        }
+        lcdiicPowerEnterLocked(drvp, (lcdiic_power_t)stage);
+    }
+}
+
+/*
+ * Back to LCDIIC_POWER_ACTIVE at once: the writes held while the display was
+ * off go out in one flush before it is switched on again.
+ */
+static void lcdiicPowerWakeLocked(LCDIICDriver *drvp) {
+    lcdiic_power_t old = drvp->power;
+
+    drvp->activity = chVTGetSystemTimeX();
+    if (old == LCDIIC_POWER_ACTIVE) {
+        if (!chVTIsArmed(&drvp->powervt)) {
+            lcdiicPowerStepLocked(drvp);
+        }
+        return;
+    }
+
+    drvp->power = LCDIIC_POWER_ACTIVE;
+    if (old >= LCDIIC_POWER_DARK) {
+        drvp->port.u.bl = drvp->blsaved;
+    }
+
+    if (old == LCDIIC_POWER_OFF && drvp->state == LCDIIC_READY) {
+        lcdiicFlushLocked(drvp);
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, lcdiicDisplayControl(drvp));
+    }
+    lcdiicBacklightSendLocked(drvp);
+
+    lcdiicPowerStepLocked(drvp);
+}
+
+/*
+ * The shadow changed since the last commit: wake as for lcdiicPowerActivity(),
+ * unless the config keeps the idle time. Held until the end of a batch.
+ */
+static void lcdiicPowerTouchedLocked(LCDIICDriver *drvp) {
+    if (!drvp->touched || drvp->batch > 0) {
+        return;
+    }
+
+    drvp->touched = 0;
+    if (drvp->config != NULL && !drvp->config->keepidle) {
+        lcdiicPowerWakeLocked(drvp);
+    }
+}
+#endif /* LCDIIC_USE_POWER */
+
+#if LCDIIC_USE_SCANOUT || defined(__DOXYGEN__)
+/*
+ * Submit the next line of the scan frame, the address counter restored at its
+ * end. Skipped while the panel is not ready or powered off, and while a flush
+ * is paused with frames of its own.
+ */
+static void lcdiicScanStepLocked(LCDIICDriver *drvp) {
+    uint8_t line = drvp->scanrow;
+    uint8_t *tail = &drvp->scan[line][6 * (LCDIIC_SCANOUT_COLS + 1)];
 
-    drvp->port.u.dt = (val >> 4) & 0x0F;
-    buf[cnt++] = drvp->port.v;
+    if (drvp->scanival == 0 || drvp->state != LCDIIC_READY ||
+            drvp->framelen > 0 || drvp->flushing > 0) {
+        return;
+    }
+#if LCDIIC_USE_POWER
+    if (drvp->power == LCDIIC_POWER_OFF) {
+        return;
+    }
+#endif
 
-    drvp->port.u.en = 0x01;
-    buf[cnt++] = drvp->port.v;
+    /* Neither line is on the bus past this point */
+    if (lcdiicWaitLocked(drvp) != MSG_OK) {
+        return;
+    }
 
-    drvp->port.u.en = 0x00;
-    buf[cnt++] = drvp->port.v;
+    /* A backlight change rides on the scan like on any frame */
+    if (drvp->scanbl != drvp->port.u.bl) {
+        uint8_t *p = drvp->scan[0];
 
-    if (mode == LCDIIC_BUS_MODE_8BIT) {
-        goto done;
+        for (; p < drvp->scan[0] + sizeof(drvp->scan); p++) {
+            *p = lcdiicPortBits(drvp, drvp->port.u.bl ? (*p | LCDIIC_PORT_BL) :
+                    (*p & ~LCDIIC_PORT_BL));
+        }
+        drvp->scanbl = drvp->port.u.bl;
     }
+    lcdiicScanEncodeLocked(drvp, tail, 0, lcdiicAcCommand(drvp->ac));
 
-    drvp->port.u.dt = (val >> 0) & 0x0F;
-    buf[cnt++] = drvp->port.v;
+    lcdiicCountBytes(drvp, 1 + sizeof(drvp->scan[0]));
+    if (lcdiicPortSubmit(drvp->config->portp, drvp->scan[line], sizeof(drvp->scan[0])) != MSG_OK) {
+        lcdiicOfflineLocked(drvp);
+        return;
+    }
+    drvp->queued = 1;
+    drvp->scanstale &= ~(1 << line);
+    drvp->scanrow = line ^ 1;
+    drvp->hwac = drvp->ac;
+}
 
-    drvp->port.u.en = 0x01;
-    buf[cnt++] = drvp->port.v;
+/* Leave the scan frame, its lines edited since last sent go to the flush */
+static void lcdiicScanStopLocked(LCDIICDriver *drvp) {
+    uint8_t line, col;
 
-    drvp->port.u.en = 0x00;
-    buf[cnt++] = drvp->port.v;
+    if (drvp->scanival == 0) {
+        return;
+    }
 
-done:
-    pcf8574SetPort(portdrvp, 1, buf, cnt);
+    chVTReset(&drvp->scanvt);
+    drvp->scanival = 0;
 
-    // Max execution time(!Clear display & !Return home) is 37us when f(OSC) is 270kHz
-    drvp->delayUs(37);
+    for (line = 0; line < 2; line++) {
+        if (!(drvp->scanstale & (1 << line))) continue;
+
+        for (col = 0; col < LCDIIC_SCANOUT_COLS; col++) {
+            uint8_t idx = line * LCD_DDRAM_LINE_LEN + col;
+
+            drvp->dirty[idx >> 3] |= 1 << (idx & 0x07);
+        }
+    }
+    drvp->scanstale = 0;
+}
+#endif /* LCDIIC_USE_SCANOUT */
+
+static THD_FUNCTION(lcdiicServiceThread, arg) {
+    (void)arg;
+    chRegSetThreadName("lcdiic");
+
+    while (true) {
+        LCDIICDriver *drvp;
+
+        chEvtWaitAny(LCDIIC_SVC_EVENT);
+
+        for (drvp = lcdiic_drivers; drvp != NULL; drvp = drvp->next) {
+            uint8_t flags;
+
+            chSysLock();
+            flags = drvp->svcflags;
+            drvp->svcflags = 0;
+            chSysUnlock();
+
+            if (flags & LCDIIC_SVC_INIT_STEP) {
+                lcdiicLock(drvp);
+                lcdiicInitStepLocked(drvp);
+                lcdiicUnlock(drvp);
+            }
+
+#if LCDIIC_USE_BLINK
+            if (flags & LCDIIC_SVC_BLINK) {
+                lcdiicLock(drvp);
+                lcdiicBlinkStepLocked(drvp);
+                lcdiicUnlock(drvp);
+            }
+#endif
+
+            if (flags & LCDIIC_SVC_BACKLIGHT) {
+                lcdiicLock(drvp);
+                lcdiicBacklightSendLocked(drvp);
+                lcdiicUnlock(drvp);
+            }
+
+#if LCDIIC_USE_POWER
+            if (flags & LCDIIC_SVC_POWER) {
+                lcdiicLock(drvp);
+                lcdiicPowerStepLocked(drvp);
+                lcdiicUnlock(drvp);
+            }
+#endif
+
+#if LCDIIC_USE_SCANOUT
+            if (flags & LCDIIC_SVC_SCAN) {
+                lcdiicLock(drvp);
+                lcdiicScanStepLocked(drvp);
+                lcdiicUnlock(drvp);
+            }
+#endif
+        }
+    }
 }
 
-static msg_t lcdiicReadLocked(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t *val) {
-    PCF8574Driver *portdrvp = drvp->config->drvp;
-    lcdiic_port_cfg portval;
-    msg_t ret;
-    uint8_t buf[2];
+#if LCDIIC_USE_BACKGROUND || defined(__DOXYGEN__)
+/* Upload one pattern given to lcdiicPrefetchPattern(), false if none is left */
+static bool lcdiicPrefetchStepLocked(LCDIICDriver *drvp) {
+    uint8_t pos;
 
-    drvp->port.u.dt = 0x0f;
-    buf[0] = drvp->port.v;
-    drvp->port.u.en = 0x01;
-    buf[1] = drvp->port.v;
-    pcf8574SetPort(portdrvp, 1, buf, 2);
+    for (pos = 0; pos < 8; pos++) {
+        if (drvp->cgahead & drvp->cgdirty & (1 << pos)) {
+            lcdiicPatternEncodeLocked(drvp, pos);
+            drvp->stats.prefetched++;
+            return true;
+        }
+    }
 
-    ret = pcf8574GetPortOb(portdrvp, &portval.v);
-    if (ret != MSG_OK) goto out;
+    return false;
+}
 
-    *val = portval.u.dt << 4;
+#if (LCDIIC_USE_READBACK && (LCDIIC_SCRUB_CELLS > 0)) || defined(__DOXYGEN__)
+/*
+ * Read back the next cell, mark it dirty if wrong. Without a lease the
+ * address, each nibble and the closing word are one bus acquisition each:
+ * another user of the bus waits for one transaction at most.
+ */
+static void lcdiicScrubStepLocked(LCDIICDriver *drvp) {
+    uint8_t cell = drvp->scrub;
+    uint8_t ac = drvp->ac, val;
+    msg_t ret;
 
-    if (mode == LCDIIC_BUS_MODE_8BIT) goto done;
+    drvp->scrub = (cell + 1) % LCD_DDRAM_SIZE;
 
-    drvp->port.u.en = 0x00;
-    buf[0] = drvp->port.v;
-    drvp->port.u.en = 0x01;
-    buf[1] = drvp->port.v;
-    pcf8574SetPort(portdrvp, 1, buf, 2);
+    ret = lcdiicDrReadBlockLocked(drvp, lcdiicDdramAddr(cell), &val, 1, false);
+    drvp->ac = ac;
+    if (ret != MSG_OK) {
+        return;
+    }
 
-    ret = pcf8574GetPortOb(portdrvp, &portval.v);
-    if (ret != MSG_OK) goto out;
+    if (!(drvp->dirty[cell >> 3] & (1 << (cell & 0x07))) && val != drvp->ddram[cell]) {
+        drvp->dirty[cell >> 3] |= 1 << (cell & 0x07);
+        drvp->stats.repaired++;
+    }
+}
+#endif
 
-    *val |= portval.u.dt;
+/*
+ * One unit of background work, only on a ready driver with nothing pending
+ * and a bus nobody else uses: a pattern to prefetch, else one of the cells
+ * left to scrub. Returns true if more work is left.
+ */
+static bool lcdiicBackgroundStepLocked(LCDIICDriver *drvp, uint8_t *cells) {
+    uint32_t busbytes = drvp->stats.busbytes;
+    bool more;
 
-done:
-    drvp->port.u.en = 0x00;
-    pcf8574SetPortOb(portdrvp, 1, drvp->port.v);
+    if (drvp->state != LCDIIC_READY || drvp->batch > 0 || drvp->flushing > 0 ||
+            lcdiicPortBusy(drvp->config->portp)) {
+        return false;
+    }
+#if LCDIIC_USE_POWER
+    if (drvp->power == LCDIIC_POWER_OFF) {
+        return false;
+    }
+#endif
 
-    if (drvp->port.u.rs != 0x00 && drvp->port.u.rw != 0x01) {
-        drvp->delayUs(37);
+    more = lcdiicPrefetchStepLocked(drvp);
+#if LCDIIC_USE_READBACK && (LCDIIC_SCRUB_CELLS > 0)
+    if (!more && *cells > 0) {
+        lcdiicScrubStepLocked(drvp);
+        more = --*cells > 0;
     }
+#else
+    (void)cells;
+#endif
 
-out:
-    return ret;
-}
+    /* Repairs, and the address counter back where the foreground left it */
+    lcdiicFlushLocked(drvp);
+    drvp->stats.bgbytes += drvp->stats.busbytes - busbytes;
 
-/* Write to instruction register */
-static void lcdiicIrWrite(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t val) {
-    chMtxLock(&drvp->mutex);
-    drvp->port.u.rs = 0x00;
-    drvp->port.u.rw = 0x00;
-    lcdiicWriteLocked(drvp, mode, val);
-    chMtxUnlock(&drvp->mutex);
+    return more;
 }
 
-/* Check if busy: 0 - idle, 1 - busy  */
-static int8_t lcdiicCheckBusy(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t *addr) {
-    uint8_t val;
-    msg_t ret;
+/*
+ * Low priority worker: a unit is a pattern or one cell, and the driver is
+ * given up as soon as another thread is waiting for it.
+ */
+static THD_FUNCTION(lcdiicBackgroundThread, arg) {
+    (void)arg;
+    chRegSetThreadName("lcdiicbg");
 
-    chMtxLock(&drvp->mutex);
-    drvp->port.u.rs = 0x00;
-    drvp->port.u.rw = 0x01;
-    ret = lcdiicReadLocked(drvp, mode, &val);
-    chMtxUnlock(&drvp->mutex);
+    while (true) {
+        LCDIICDriver *drvp;
 
-    if (addr != NULL) {
-        *addr = (ret == MSG_OK) ? (val & LCD_ADDRESS_COUNTER) : 0xff;
-    }
+        chThdSleepMilliseconds(LCDIIC_BACKGROUND_PERIOD);
 
-    return ret == MSG_OK ? (val & LCD_BUSY_FLAG) != 0 : 1;
-}
+        for (drvp = lcdiic_drivers; drvp != NULL; drvp = drvp->next) {
+            uint8_t cells = LCDIIC_SCRUB_CELLS;
+            bool more = true;
 
-/* Write to data register */
-static void lcdiicDrWrite(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t val) {
-    chMtxLock(&drvp->mutex);
-    drvp->port.u.rs = 0x01;
-    drvp->port.u.rw = 0x00;
-    lcdiicWriteLocked(drvp, mode, val);
-    chMtxUnlock(&drvp->mutex);
+            while (more && lcdiicTryLock(drvp)) {
+                more = lcdiicBackgroundStepLocked(drvp, &cells);
+                lcdiicUnlock(drvp);
+            }
+        }
+    }
 }
+#endif /* LCDIIC_USE_BACKGROUND */
+
+/* Chain a started driver to the service thread, starting the thread if needed */
+static void lcdiicServiceAttach(LCDIICDriver *drvp) {
+    LCDIICDriver *p;
+
+    chMtxLock(&lcdiic_lock);
+    if (lcdiic_service == NULL) {
+        lcdiic_service = chThdCreateStatic(waLcdiicService, sizeof(waLcdiicService),
+                LCDIIC_SERVICE_PRIORITY, lcdiicServiceThread, NULL);
+#if LCDIIC_USE_BACKGROUND
+        chThdCreateStatic(waLcdiicBackground, sizeof(waLcdiicBackground),
+                LCDIIC_BACKGROUND_PRIORITY, lcdiicBackgroundThread, NULL);
+#endif
+    }
 
-/* Read from data register */
-static msg_t lcdiicDrRead(LCDIICDriver *drvp, lcdiic_bus_mode_t mode, uint8_t *val) {
-    msg_t ret;
-
-    chMtxLock(&drvp->mutex);
-    drvp->port.u.rs = 0x01;
-    drvp->port.u.rw = 0x01;
-    ret = lcdiicReadLocked(drvp, mode, val);
-    chMtxUnlock(&drvp->mutex);
+    for (p = lcdiic_drivers; p != NULL && p != drvp; p = p->next)
+        ;
 
-    return ret;
+    if (p == NULL) {
+        drvp->next = lcdiic_drivers;
+        lcdiic_drivers = drvp;
+    }
+    chMtxUnlock(&lcdiic_lock);
 }
 
-static uint8_t isBusy(void *ip) {
+LCDIIC_METHOD uint8_t _lcdiic_is_busy(void *ip) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
-    return lcdiicCheckBusy(drvp, LCDIIC_BUS_MODE_4BIT, NULL);
+    uint8_t ret = 1;
+
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+    if (drvp->state == LCDIIC_READY) {
+        ret = lcdiicCheckBusyLocked(drvp, LCDIIC_BUS_MODE_4BIT, NULL);
+    }
+    lcdiicUnlock(drvp);
+
+    return ret;
 }
 
-static void setBacklight(void *ip, uint8_t on) {
+LCDIIC_METHOD void _lcdiic_set_backlight(void *ip, uint8_t on) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
-    PCF8574Driver *portdrvp = drvp->config->drvp;
 
-    drvp->port.u.bl = !!on;
-    pcf8574SetPortOb(portdrvp, 1, drvp->port.v);
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+#if LCDIIC_USE_BLINK
+    /* An explicit change ends blinking */
+    drvp->blinkon = 0;
+    chVTReset(&drvp->blinkvt);
+#endif
+    lcdiicBacklightLocked(drvp, on);
+    lcdiicUnlock(drvp);
 }
 
-static void toggleBacklight(void *ip) {
+LCDIIC_METHOD void _lcdiic_toggle_backlight(void *ip) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
 
-    setBacklight(drvp, !drvp->port.u.bl);
+    _lcdiic_set_backlight(drvp, !drvp->port.u.bl);
 }
 
-static void setDisplay(void *ip, uint8_t display, uint8_t cursor, uint8_t blink) {
+LCDIIC_METHOD void _lcdiic_set_display(void *ip, uint8_t display, uint8_t cursor, uint8_t blink) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
     uint8_t ctrl = 0;
 
@@ -178,103 +1706,255 @@ static void setDisplay(void *ip, uint8_t display, uint8_t cursor, uint8_t blink)
     if (cursor)     ctrl |= LCD_CURSOR_ON;
     if (blink)      ctrl |= LCD_CURSOR_BLINK_ON;
 
-    lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_DISPLAY_CONTROL | ctrl);
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+    drvp->dctl = ctrl;
+    if (drvp->state == LCDIIC_READY) {
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, lcdiicDisplayControl(drvp));
+    }
+    lcdiicUnlock(drvp);
 }
 
-static void clearScreen(void *ip) {
+LCDIIC_METHOD void _lcdiic_clear_screen(void *ip) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
 
-    lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_CLEAR_DISPLAY);
-    drvp->delayMs(2);
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+    memset(drvp->ddram, ' ', sizeof(drvp->ddram));
+    memset(drvp->dirty, 0, sizeof(drvp->dirty));
+    drvp->ac = 0x00;
+    drvp->dshift = 0;
+
+    if (drvp->state == LCDIIC_READY) {
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_CLEAR_DISPLAY);
+        drvp->hwac = 0x00;
+        lcdiicDelayMs(drvp, 2);
+    }
+    lcdiicScanBuildLocked(drvp);
+    lcdiicUnlock(drvp);
 }
 
-static void shiftContent(void *ip, uint8_t display, uint8_t right) {
+LCDIIC_METHOD void _lcdiic_shift_content(void *ip, uint8_t display, uint8_t right) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
     uint8_t ctrl = 0;
     if (display)    ctrl |= LCD_SHIFT_DISPLAY;
     if (right)      ctrl |= LCD_SHIFT_TO_RIGHT;
-    lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_CONTENT_SHIFT | ctrl);
+
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+    /* Make sure the controller address counter matches the shadow one */
+    lcdiicFlushLocked(drvp);
+
+    if (display) {
+        drvp->dshift = (drvp->dshift + (right ? 1 : LCD_DDRAM_LINE_LEN - 1)) % LCD_DDRAM_LINE_LEN;
+    } else {
+        drvp->ac = right ? lcdiicNextAc(drvp->ac) : lcdiicPrevAc(drvp->ac);
+    }
+
+    if (drvp->state == LCDIIC_READY) {
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_CONTENT_SHIFT | ctrl);
+        drvp->hwac = drvp->ac;
+    }
+    lcdiicUnlock(drvp);
 }
 
-static void returnHome(void *ip) {
+LCDIIC_METHOD void _lcdiic_return_home(void *ip) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
 
-    lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_RETURN_HOME);
-    drvp->delayMs(2);
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+    lcdiicFlushLocked(drvp);
+
+    drvp->ac = 0x00;
+    drvp->dshift = 0;
+
+    if (drvp->state == LCDIIC_READY) {
+        lcdiicIrWriteLocked(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_RETURN_HOME);
+        drvp->hwac = 0x00;
+        lcdiicDelayMs(drvp, 2);
+    }
+    lcdiicUnlock(drvp);
 }
 
-static void updatePattern(void *ip, uint8_t pos, const uint8_t *pat) {
+LCDIIC_METHOD void _lcdiic_update_pattern(void *ip, uint8_t pos, const uint8_t *pat) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
-    uint8_t idx;
 
-    pos = (pos & 0x07) << 3;
-    lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_SET_CGRAM_ADDR | pos);
+    lcdiicLock(drvp);
+    lcdiicPutPatternLocked(drvp, pos, pat);
 
-    for (idx = 0; idx < 8; idx++) {
-        lcdiicDrWrite(drvp, LCDIIC_BUS_MODE_4BIT, pat[idx]);
-    }
+#if LCDIIC_USE_BACKGROUND
+    drvp->cgahead &= ~(1 << (pos & 0x07));
+#endif
+    lcdiicPowerTouchedLocked(drvp);
+    lcdiicCommitLocked(drvp);
+    lcdiicUnlock(drvp);
 }
 
-static void moveTo(void *ip, uint8_t row, uint8_t col) {
+LCDIIC_METHOD void _lcdiic_move_to(void *ip, uint8_t row, uint8_t col) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
-    uint8_t pos = (row * LCD_LINE_MAX_LEN + col) & LCD_DDRAM_ADDR_MASK;
 
-    lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_SET_DDRAM_ADDR | pos);
+    uint8_t ac = (row * LCD_LINE_MAX_LEN + col) & LCD_DDRAM_ADDR_MASK;
+
+    lcdiicLock(drvp);
+    if (drvp->ac != ac) {
+        drvp->ac = ac;
+        lcdiicTouchLocked(drvp);
+    }
+    lcdiicPowerTouchedLocked(drvp);
+    lcdiicCommitLocked(drvp);
+    lcdiicUnlock(drvp);
 }
 
-static msg_t readData(void *ip, uint8_t ddram, uint8_t offset, uint8_t *val) {
+#if LCDIIC_USE_READBACK || defined(__DOXYGEN__)
+LCDIIC_METHOD msg_t _lcdiic_read_block(void *ip, uint8_t ddram, uint8_t offset, uint8_t *buf, uint8_t n) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
-    uint8_t pos;
+    msg_t ret = MSG_RESET;
+    uint8_t ac;
 
     if (ddram) {
-        pos =  offset & LCD_DDRAM_ADDR_MASK;
-        lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_SET_DDRAM_ADDR | pos);
+        ac = offset & LCD_DDRAM_ADDR_MASK;
     } else {
-        pos = offset & LCD_CGRAM_ADDR_MASK;
-        lcdiicIrWrite(drvp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_SET_CGRAM_ADDR | pos);
+        ac = LCDIIC_AC_CGRAM | (offset & LCD_CGRAM_ADDR_MASK);
+    }
+
+    lcdiicLock(drvp);
+    lcdiicPowerWakeLocked(drvp);
+    if (lcdiicFlushLocked(drvp) == MSG_OK) {
+        ret = lcdiicDrReadBlockLocked(drvp, ac, buf, n, true);
     }
+    lcdiicUnlock(drvp);
+
+    return ret;
+}
 
-    return lcdiicDrRead(drvp, LCDIIC_BUS_MODE_4BIT, val);
+LCDIIC_METHOD msg_t _lcdiic_read_data(void *ip, uint8_t ddram, uint8_t offset, uint8_t *val) {
+    return _lcdiic_read_block(ip, ddram, offset, val, 1);
 }
+#endif /* LCDIIC_USE_READBACK */
 
-static void addChar(void *ip, uint8_t ch) {
+LCDIIC_METHOD void _lcdiic_add_char(void *ip, uint8_t ch) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
-    lcdiicDrWrite(drvp, LCDIIC_BUS_MODE_4BIT, ch);
+
+    lcdiicLock(drvp);
+    lcdiicPutLocked(drvp, ch);
+    lcdiicPowerTouchedLocked(drvp);
+    lcdiicCommitLocked(drvp);
+    lcdiicUnlock(drvp);
 }
 
-static uint8_t drawText(void *ip, uint8_t row, uint8_t col, const char *text, uint8_t len) {
+LCDIIC_METHOD uint8_t _lcdiic_draw_text(void *ip, uint8_t row, uint8_t col, const char *text, uint8_t len) {
     LCDIICDriver *drvp = (LCDIICDriver *)ip;
     uint8_t idx;
 
-    moveTo(drvp, row, col);
+    lcdiicLock(drvp);
+    idx = lcdiicPutTextLocked(drvp, row, col, text, len);
+
+    /* Only the cells that differ from the shadow go out on the bus */
+    lcdiicPowerTouchedLocked(drvp);
+    lcdiicCommitLocked(drvp);
+    lcdiicUnlock(drvp);
 
-    for (idx = 0; idx < LCD_LINE_MAX_LEN && idx < len; idx++) {
-        lcdiicDrWrite(drvp, LCDIIC_BUS_MODE_4BIT, text[idx]);
-    }
     return idx;
 }
 
+#if LCDIIC_USE_VMT
 static const struct LCDIICVMT vmt_lcdiic = {
-    isBusy, setBacklight, toggleBacklight, setDisplay, clearScreen,
-    shiftContent, returnHome, updatePattern, moveTo, readData,
-    addChar, drawText,
+    _lcdiic_is_busy, _lcdiic_set_backlight, _lcdiic_toggle_backlight,
+    _lcdiic_set_display, _lcdiic_clear_screen, _lcdiic_shift_content,
+    _lcdiic_return_home, _lcdiic_update_pattern, _lcdiic_move_to,
+    _lcdiic_add_char, _lcdiic_draw_text,
+#if LCDIIC_USE_READBACK
+    _lcdiic_read_data, _lcdiic_read_block,
+#endif
 };
+#endif
 
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
 
 void lcdiicObjectInit(LCDIICDriver *devp, void (*delayUs)(uint32_t), void (*delayMs)(uint32_t)) {
+#if LCDIIC_USE_VMT
     devp->vmt = &vmt_lcdiic;
+#endif
+#if LCDIIC_USE_DELAY_CALLBACKS
     devp->delayUs = delayUs;
     devp->delayMs = delayMs;
+#else
+    (void)delayUs;
+    (void)delayMs;
+#endif
 
     devp->port.v = 0x00;
     devp->port.u.bl = 0x01;
 
     devp->config = NULL;
 
+#if LCDIIC_USE_MUTEX
     chMtxObjectInit(&devp->mutex);
+#endif
+
+    memset(devp->ddram, ' ', sizeof(devp->ddram));
+    memset(devp->dirty, 0, sizeof(devp->dirty));
+    memset(devp->cgram, 0, sizeof(devp->cgram));
+    devp->cgused = 0;
+    devp->cgdirty = 0;
+    devp->ac = 0x00;
+    devp->hwac = 0x00;
+    devp->dctl = LCD_DISPLAY_ON;
+    devp->dshift = 0;
+    devp->framelen = 0;
+#if LCDIIC_USE_QUEUE
+    devp->frame = devp->frames[0];
+    devp->queued = 0;
+#endif
+    devp->batch = 0;
+    devp->flushing = 0;
+    chVTObjectInit(&devp->blvt);
+#if LCDIIC_USE_BLINK
+    chVTObjectInit(&devp->blinkvt);
+    devp->blinkon = 0;
+    devp->blinkoff = 0;
+    devp->blinkcnt = 0;
+#endif
+#if LCDIIC_USE_BACKGROUND
+    devp->cgahead = 0;
+    devp->scrub = 0;
+    memset(&devp->stats, 0, sizeof(devp->stats));
+#endif
+#if LCDIIC_USE_EVENTS
+    chEvtObjectInit(&devp->event);
+    devp->lowwater = 0;
+#endif
+
+    chVTObjectInit(&devp->vt);
+    chThdQueueObjectInit(&devp->waiting);
+    devp->step = 0;
+#if LCDIIC_USE_WARM_ADOPT
+    devp->adopt = LCD_DDRAM_SIZE;
+#endif
+    devp->svcflags = 0;
+    devp->next = NULL;
+#if LCDIIC_USE_MIRROR
+    devp->mirror = NULL;
+#endif
+#if LCDIIC_USE_MIRROR || LCDIIC_USE_SPAN
+    devp->grouped = 0;
+#endif
+#if LCDIIC_USE_POWER
+    devp->power = LCDIIC_POWER_ACTIVE;
+    devp->blsaved = 0x01;
+    devp->activity = 0;
+    chVTObjectInit(&devp->powervt);
+    devp->touched = 0;
+#endif
+#if LCDIIC_USE_SCANOUT
+    chVTObjectInit(&devp->scanvt);
+    devp->scanival = 0;
+    devp->scanrow = 0;
+    devp->scanstale = 0;
+    devp->scanbl = 0;
+#endif
 
     devp->state = LCDIIC_STOP;
 }
@@ -287,63 +1967,621 @@ void lcdiicStart(LCDIICDriver *devp, const LCDIICConfig *config) {
 
     devp->config = config;
 
-    /* LCD Initialize - 4-Bit Interface */
+    lcdiicServiceAttach(devp);
+
+    /* Returns right away: content written until the panel is ready stays in
+     * the shadow and is sent by the last initialization step */
+    lcdiicLock(devp);
+#if LCDIIC_USE_WARM_START
+    /* The probe talks to the controller: it is the first step, on the
+     * service thread */
+    devp->state = LCDIIC_INIT;
+    devp->framelen = 0;
+    devp->step = LCDIIC_STEP_PROBE;
+#if LCDIIC_USE_WARM_ADOPT
+    /* Until the probe tells, the glass may hold anything */
+    devp->adopt = 0;
+#endif
+    lcdiicStepNowLocked(devp);
+#else
+    lcdiicBeginInitLocked(devp, 40);
+#endif
+#if LCDIIC_USE_POWER
+    lcdiicPowerWakeLocked(devp);
+#endif
+    lcdiicUnlock(devp);
+}
+
+void lcdiicStop(LCDIICDriver *devp) {
+    chDbgAssert((devp->state == LCDIIC_STOP) || (devp->state == LCDIIC_READY) ||
+            (devp->state == LCDIIC_INIT) || (devp->state == LCDIIC_OFFLINE),
+            "lcdiicStop(), invalid state");
+
+    lcdiicLock(devp);
+#if LCDIIC_USE_SCANOUT
+    lcdiicScanStopLocked(devp);
+#endif
+    /* 1. Display off, the shadow keeps the display control for a restart */
+    chVTReset(&devp->vt);
+    if (devp->state == LCDIIC_READY) {
+        lcdiicIrWriteLocked(devp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_DISPLAY_CONTROL);
+    } else if (devp->state == LCDIIC_INIT) {
+        devp->state = LCDIIC_STOP;
+        lcdiicInitDoneLocked(devp);
+    }
+
+    /* 2. Backlight off, right away */
+#if LCDIIC_USE_BLINK
+    devp->blinkon = 0;
+    chVTReset(&devp->blinkvt);
+#endif
+    chVTReset(&devp->blvt);
+    devp->port.u.bl = 0x00;
+    lcdiicBacklightSendLocked(devp);
+
+#if LCDIIC_USE_POWER
+    chVTReset(&devp->powervt);
+    devp->power = LCDIIC_POWER_ACTIVE;
+#endif
+#if LCDIIC_USE_QUEUE
+    /* Nothing of this run is left on the bus */
+    (void)lcdiicWaitLocked(devp);
+#endif
+    devp->state = LCDIIC_STOP;
+    lcdiicUnlock(devp);
+}
+
+/*
+ * Cheap health check, meant to be called periodically: a single busy flag and
+ * address counter read. A NACK takes the driver offline, so further calls only
+ * update the shadow. Once the module answers again, or when the address counter
+ * does not match the shadow (controller reset or nibble phase lost), the
+ * controller is initialized again in the background and the shadow is replayed.
+ */
+msg_t lcdiicProbe(LCDIICDriver *devp) {
+    msg_t ret;
+    uint8_t val;
+
+    chDbgCheck(devp != NULL);
+
+    lcdiicLock(devp);
+    if ((devp->state != LCDIIC_READY) && (devp->state != LCDIIC_OFFLINE)) {
+        lcdiicUnlock(devp);
+        return MSG_RESET;
+    }
+#if LCDIIC_USE_POWER
+    /* Leave a stopped bus alone, the check runs again after the wake */
+    if (devp->power == LCDIIC_POWER_OFF) {
+        lcdiicUnlock(devp);
+        return MSG_OK;
+    }
+#endif
+
+    devp->port.u.rs = 0x00;
+    devp->port.u.rw = 0x01;
+    ret = lcdiicReadLocked(devp, LCDIIC_BUS_MODE_4BIT, &val, 1, true);
+
+    if (ret == MSG_OK) {
+        if (devp->state == LCDIIC_OFFLINE) {
+            /* Plugged in again: give the controller its power-on time */
+            lcdiicBeginInitLocked(devp, 40);
+            ret = MSG_RESET;
+        } else if (!(val & LCD_BUSY_FLAG) &&
+                ((val & LCD_ADDRESS_COUNTER) != (devp->hwac & LCD_ADDRESS_COUNTER))) {
+            lcdiicBeginInitLocked(devp, 1);
+            ret = MSG_RESET;
+        }
+    }
+    lcdiicUnlock(devp);
+
+    return ret;
+}
+
+#if LCDIIC_USE_SCANOUT || defined(__DOXYGEN__)
+/*
+ * Refresh the first LCDIIC_SCANOUT_COLS cells of DDRAM lines 0 and 1 from a
+ * RAM frame: one line, an address and its cells, goes to the port queue every
+ * interval ms and the lines alternate. Writes to those cells only patch the
+ * frame, the next pass sends them, and whatever upset the panel is rewritten.
+ * interval sets the share of the bus: a 16 cells line is 109 bytes, about
+ * 10 ms at 100 kHz, so 50 leaves the bus to the other devices 80% of the time
+ * and refreshes the panel every 100 ms. A cell written while its line is on
+ * the bus may show a mix of both values until the next pass. Not for wide
+ * ports.
+ */
+msg_t lcdiicScanoutStart(LCDIICDriver *devp, uint16_t interval) {
+    msg_t ret = MSG_RESET;
+
+    chDbgCheck((devp != NULL) && (interval > 0));
+
+    lcdiicLock(devp);
+    if ((devp->config != NULL) && !lcdiicIsWide(devp)) {
+        devp->scanival = interval;
+        devp->scanrow = 0;
+        lcdiicScanBuildLocked(devp);
+        chVTSet(&devp->scanvt, MS2ST(interval), lcdiicScanTimer, devp);
+        ret = MSG_OK;
+    }
+    lcdiicUnlock(devp);
+
+    return ret;
+}
+
+/* Back to flushes, the edits the scanout did not send yet are flushed now */
+void lcdiicScanoutStop(LCDIICDriver *devp) {
+    chDbgCheck(devp != NULL);
 
-    /* 1. Wait time > 40ms */
-    devp->delayMs(40);
+    lcdiicLock(devp);
+    lcdiicScanStopLocked(devp);
+    (void)lcdiicCommitLocked(devp);
+    lcdiicUnlock(devp);
+}
+#endif /* LCDIIC_USE_SCANOUT */
 
-    /* 2. Mode selection: from unknown mode to 4-bit mode */
-    /* https://en.wikipedia.org/wiki/Hitachi_HD44780_LCD_controller */
-    /* - State1: 8-bit mode */
-    /* - State2: 4-bit mode, waiting for the first set of 4 bits */
-    /* - State3: 4-bit mode, waiting for the second set of 4 bits */
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
-    /* Wait time > 4.1ms */
-    devp->delayMs(5);
+#if LCDIIC_USE_SCREENS || defined(__DOXYGEN__)
+/*
+ * Draw a prerendered screen from its row 0, column 0. The streams carry the
+ * backlight bit on, ignore the port mask and are 4-bit frames: otherwise, on a
+ * wide port, or when the panel is not ready, the text goes through the shadow
+ * like lcdiicDrawText().
+ */
+msg_t lcdiicDrawScreen(LCDIICDriver *devp, const LCDIICScreen *screen) {
+    msg_t ret = MSG_RESET;
+    uint8_t row, col;
+
+    chDbgCheck((devp != NULL) && (screen != NULL));
+
+    lcdiicLock(devp);
+    if ((devp->state == LCDIIC_READY) && devp->port.u.bl &&
+            (devp->config->portp->mask == 0x00) && !lcdiicIsWide(devp)) {
+        /* Pending cells first, they may be overwritten by the screen */
+        if (lcdiicFlushLocked(devp) == MSG_OK) {
+            ret = lcdiicSendStreamLocked(devp, screen->stream);
+        }
+    }
 
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
-    /* Wait time > 100us */
-    devp->delayMs(1);
+    for (row = 0; row < screen->rows; row++) {
+        devp->ac = row * LCD_LINE_MAX_LEN;
+
+        for (col = 0; col < screen->cols; col++) {
+            uint8_t idx = row * LCD_DDRAM_LINE_LEN + col;
+
+            if (ret == MSG_OK) {
+                /* Already on the glass: only the shadow is updated */
+                if (devp->ddram[idx] != screen->text[row * screen->cols + col]) {
+                    lcdiicTouchLocked(devp);
+                }
+                devp->ddram[idx] = screen->text[row * screen->cols + col];
+                devp->dirty[idx >> 3] &= ~(1 << (idx & 0x07));
+                devp->ac = lcdiicNextAc(devp->ac);
+            } else {
+                lcdiicPutLocked(devp, screen->text[row * screen->cols + col]);
+            }
+        }
+    }
 
-    /* The LCD is now in either state1 or state3 */
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+    lcdiicScanBuildLocked(devp);
+    lcdiicPowerTouchedLocked(devp);
+    if (ret == MSG_OK) {
+        devp->hwac = devp->ac;
+        lcdiicBroadcastLocked(devp, LCDIIC_EVT_FLUSHED);
+    } else {
+        ret = lcdiicFlushLocked(devp);
+    }
+    lcdiicUnlock(devp);
 
-    /* Now that the LCD is definitely in 8-bit mode, switch to 4-bit mode */
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_8BIT, LCD_CMD_FUNCTION_SET);
+    return ret;
+}
+#endif /* LCDIIC_USE_SCREENS */
 
-    /* 3. Function set: number of display lines and character font */
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_FUNCTION_SET |
-            LCD_DISPLAY_MODE); // Set to 2-line and font size to 5x8
+/*
+ * Batch the writes of several calls: until the matching lcdiicBatchEnd(),
+ * text, cursor and pattern writes only update the shadow, then the whole
+ * change set is sent at once. Batches nest, and hold back the writes of
+ * every thread using the driver.
+ */
+void lcdiicBatchBegin(LCDIICDriver *devp) {
+    chDbgCheck(devp != NULL);
 
-    /* 4. Display off */
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_DISPLAY_CONTROL);
+    lcdiicLock(devp);
+    devp->batch++;
+    lcdiicUnlock(devp);
+}
 
-    /* 5. Display clear */
-    clearScreen(devp);
+msg_t lcdiicBatchEnd(LCDIICDriver *devp) {
+    msg_t ret;
 
-    /* 6. Entry mode set */
-    lcdiicIrWrite(devp, LCDIIC_BUS_MODE_4BIT, LCD_CMD_ENTRY_MODE_SET | LCD_ENTRY_MODE_INC);
+    chDbgCheck(devp != NULL);
 
-    /* 7. Return home */
-    returnHome(devp);
+    lcdiicLock(devp);
+    chDbgAssert(devp->batch > 0, "lcdiicBatchEnd(), not in a batch");
+    devp->batch--;
+    lcdiicPowerTouchedLocked(devp);
+    ret = lcdiicCommitLocked(devp);
+    lcdiicUnlock(devp);
 
-    lcdiicCheckBusy(devp, LCDIIC_BUS_MODE_4BIT, NULL);
+    return ret;
+}
 
-    /* 8. Display on, cursor off, blink off */
-    setDisplay(devp, 1, 0, 0);
+/*
+ * Draw text ahead of everything else: only these cells are sent, right away,
+ * even inside a batch or while a long flush is paused between two chunks.
+ */
+uint8_t lcdiicDrawTextUrgent(LCDIICDriver *devp, uint8_t row, uint8_t col, const char *text, uint8_t len) {
+    uint8_t first, idx;
+
+    chDbgCheck((devp != NULL) && (text != NULL));
+
+    lcdiicLock(devp);
+    lcdiicPowerWakeLocked(devp);
+    first = lcdiicDdramIndex((row * LCD_LINE_MAX_LEN + col) & LCD_DDRAM_ADDR_MASK);
+    idx = lcdiicPutTextLocked(devp, row, col, text, len);
+    lcdiicPowerTouchedLocked(devp);
+
+    if (devp->state == LCDIIC_READY && first < LCD_DDRAM_SIZE) {
+        lcdiicFlushCellsLocked(devp, first, idx, false);
+        if (devp->hwac != devp->ac) {
+            lcdiicIrEncodeLocked(devp, lcdiicAcCommand(devp->ac));
+            devp->hwac = devp->ac;
+        }
+        lcdiicFinishLocked(devp);
+    }
+    lcdiicUnlock(devp);
 
-    devp->state = LCDIIC_READY;
+    return idx;
 }
 
-void lcdiicStop(LCDIICDriver *devp) {
-    chDbgAssert((devp->state == LCDIIC_STOP) || (devp->state == LCDIIC_READY),
-            "lcdiicStop(), invalid state");
+#if LCDIIC_USE_MIRROR || LCDIIC_USE_SPAN || defined(__DOXYGEN__)
+#if LCDIIC_USE_MUTEX
+/*
+ * Member of drvs following bound in address order, up or down, NULL bound
+ * for the first one. Every group takes its locks in the same global order
+ * whatever the order of its members, so two groups never deadlock.
+ */
+static LCDIICDriver *lcdiicGroupNext(LCDIICDriver * const *drvs, uint8_t n,
+        const LCDIICDriver *bound, bool up) {
+    LCDIICDriver *next = NULL;
+    uint8_t idx;
+
+    for (idx = 0; idx < n; idx++) {
+        uintptr_t addr = (uintptr_t)drvs[idx];
 
-    /* 1. Display off */
-    setDisplay(devp, 0, 0, 0);
+        if (bound != NULL && (up ? addr <= (uintptr_t)bound : addr >= (uintptr_t)bound)) {
+            continue;
+        }
+        if (next == NULL || (up ? addr < (uintptr_t)next : addr > (uintptr_t)next)) {
+            next = drvs[idx];
+        }
+    }
+
+    return next;
+}
+#endif
 
-    /* 2. Backlight off */
-    setBacklight(devp, 0);
+/* Drivers are locked by ascending address and released in reverse order */
+static void lcdiicLockGroup(LCDIICDriver * const *drvs, uint8_t n) {
+#if LCDIIC_USE_MUTEX
+    LCDIICDriver *drvp = NULL;
 
-    devp->state = LCDIIC_STOP;
+    while ((drvp = lcdiicGroupNext(drvs, n, drvp, true)) != NULL) {
+        lcdiicLock(drvp);
+    }
+#else
+    /* One lock for every driver */
+    (void)drvs;
+    (void)n;
+    lcdiicLock(drvs[0]);
+#endif
+}
+
+static void lcdiicUnlockGroup(LCDIICDriver * const *drvs, uint8_t n) {
+#if LCDIIC_USE_MUTEX
+    LCDIICDriver *drvp = NULL;
+
+    while ((drvp = lcdiicGroupNext(drvs, n, drvp, false)) != NULL) {
+        lcdiicUnlock(drvp);
+    }
+#else
+    (void)drvs;
+    (void)n;
+    lcdiicUnlock(drvs[0]);
+#endif
+}
+#endif
+
+#if LCDIIC_USE_MIRROR || defined(__DOXYGEN__)
+/*
+ * Every member ready, powered on at the stage of the leader, on the leader
+ * bus, with the same shadow and nothing deferred
+ */
+static bool lcdiicMirrorInSyncLocked(LCDIICMirror *mp) {
+    LCDIICDriver *leader = mp->members[0];
+    uint8_t idx;
+
+    for (idx = 0; idx < mp->n; idx++) {
+        LCDIICDriver *drvp = mp->members[idx];
+
+        if (drvp->state != LCDIIC_READY || drvp->batch > 0 || drvp->flushing > 0) {
+            return false;
+        }
+#if LCDIIC_USE_POWER
+        /* An off member holds its writes back, the leader flush would send them */
+        if (drvp->power == LCDIIC_POWER_OFF || drvp->power != leader->power) {
+            return false;
+        }
+#endif
+
+        if (drvp->config->portp->vmt != leader->config->portp->vmt ||
+                drvp->config->portp->bus != leader->config->portp->bus ||
+                drvp->port.v != leader->port.v || drvp->ac != leader->ac ||
+                drvp->hwac != leader->hwac || drvp->cgused != leader->cgused ||
+                drvp->cgdirty != leader->cgdirty ||
+#if LCDIIC_USE_BACKGROUND
+                drvp->cgahead != leader->cgahead ||
+#endif
+                memcmp(drvp->ddram, leader->ddram, sizeof(drvp->ddram)) != 0 ||
+                memcmp(drvp->dirty, leader->dirty, sizeof(drvp->dirty)) != 0 ||
+                memcmp(drvp->cgram, leader->cgram, sizeof(drvp->cgram)) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * In sync, the leader flush is sent to all the members and its result copied
+ * to the others. Otherwise, when it sent nothing, or for members left behind,
+ * each one sends its own differences.
+ */
+static void lcdiicMirrorCommitLocked(LCDIICMirror *mp) {
+    LCDIICDriver *leader = mp->members[0];
+    bool mirrored = false;
+    uint8_t idx;
+
+    for (idx = 0; idx < mp->n; idx++) {
+        lcdiicPowerTouchedLocked(mp->members[idx]);
+    }
+
+    if (lcdiicMirrorInSyncLocked(mp)) {
+        leader->mirror = mp;
+        leader->grouped = 1;
+        mp->sent = 0;
+        mirrored = lcdiicCommitLocked(leader) == MSG_OK && mp->sent;
+        leader->grouped = 0;
+        leader->mirror = NULL;
+    }
+
+    for (idx = mirrored ? 1 : 0; idx < mp->n; idx++) {
+        LCDIICDriver *drvp = mp->members[idx];
+
+        if (mirrored && drvp->state == LCDIIC_READY) {
+            memcpy(drvp->dirty, leader->dirty, sizeof(drvp->dirty));
+            drvp->cgdirty = leader->cgdirty;
+#if LCDIIC_USE_BACKGROUND
+            drvp->cgahead = leader->cgahead;
+#endif
+            drvp->hwac = leader->hwac;
+            /* The same bytes went to its expander */
+            drvp->port.v = leader->port.v;
+            lcdiicBroadcastLocked(drvp, LCDIIC_EVT_FLUSHED);
+        } else {
+            lcdiicCommitLocked(drvp);
+        }
+    }
+}
+
+void lcdiicMirrorObjectInit(LCDIICMirror *mp) {
+    mp->n = 0;
+    mp->sent = 0;
+}
+
+/* Members must be started, a group only holds displays showing the same content */
+void lcdiicMirrorAdd(LCDIICMirror *mp, LCDIICDriver *devp) {
+    chDbgCheck((mp != NULL) && (devp != NULL) && (devp->config != NULL));
+    chDbgAssert(mp->n < LCDIIC_MIRROR_MAX, "lcdiicMirrorAdd(), group full");
+
+    mp->members[mp->n++] = devp;
+}
+
+uint8_t lcdiicMirrorDrawText(LCDIICMirror *mp, uint8_t row, uint8_t col, const char *text, uint8_t len) {
+    uint8_t idx, cnt = 0;
+
+    chDbgCheck((mp != NULL) && (mp->n > 0) && (text != NULL));
+
+    lcdiicLockGroup(mp->members, mp->n);
+    for (idx = 0; idx < mp->n; idx++) {
+        cnt = lcdiicPutTextLocked(mp->members[idx], row, col, text, len);
+    }
+    lcdiicMirrorCommitLocked(mp);
+    lcdiicUnlockGroup(mp->members, mp->n);
+
+    return cnt;
+}
+
+void lcdiicMirrorUpdatePattern(LCDIICMirror *mp, uint8_t pos, const uint8_t *pat) {
+    uint8_t idx;
+
+    chDbgCheck((mp != NULL) && (mp->n > 0) && (pat != NULL));
+
+    lcdiicLockGroup(mp->members, mp->n);
+    for (idx = 0; idx < mp->n; idx++) {
+        lcdiicPutPatternLocked(mp->members[idx], pos, pat);
+#if LCDIIC_USE_BACKGROUND
+        mp->members[idx]->cgahead &= ~(1 << (pos & 0x07));
+#endif
+    }
+    lcdiicMirrorCommitLocked(mp);
+    lcdiicUnlockGroup(mp->members, mp->n);
+}
+#endif /* LCDIIC_USE_MIRROR */
+
+#if LCDIIC_USE_SPAN || defined(__DOXYGEN__)
+void lcdiicSpanObjectInit(LCDIICSpan *sp, LCDIICDriver *first, LCDIICDriver *second,
+        uint8_t cols, uint8_t stacked) {
+    chDbgCheck((sp != NULL) && (first != NULL) && (second != NULL) &&
+            (cols > 0) && (cols <= LCD_DDRAM_LINE_LEN));
+
+    sp->members[0] = first;
+    sp->members[1] = second;
+    sp->cols = cols;
+    sp->stacked = stacked;
+}
+
+/*
+ * Draw text at logical row, col, split at the seam between the displays and
+ * cut at the edge of the surface. The portions of both displays are sent
+ * within one bus acquisition; returns the length drawn.
+ */
+uint8_t lcdiicSpanDrawText(LCDIICSpan *sp, uint8_t row, uint8_t col, const char *text, uint8_t len) {
+    LCDIICDriver * const *members = sp->members;
+    LCDIICPort *ports[2];
+    uint8_t width = sp->stacked ? sp->cols : 2 * sp->cols;
+    uint8_t cnt = 0, idx, n = 0;
+
+    chDbgCheck((sp != NULL) && (text != NULL));
+
+    if (row >= (sp->stacked ? 4 : 2) || col >= width) {
+        return 0;
+    }
+    if (len > width - col) {
+        len = width - col;
+    }
+
+    lcdiicLockGroup(members, 2);
+    if (sp->stacked) {
+        cnt = lcdiicPutTextLocked(members[row >> 1], row & 1, col, text, len);
+    } else {
+        if (col < sp->cols) {
+            cnt = lcdiicPutTextLocked(members[0], row, col, text,
+                    len < sp->cols - col ? len : sp->cols - col);
+        }
+        if (cnt < len) {
+            cnt += lcdiicPutTextLocked(members[1], row, col + cnt - sp->cols,
+                    text + cnt, len - cnt);
+        }
+    }
+
+    /* Ready members, nothing deferred: one acquisition for both flushes */
+    for (idx = 0; idx < 2; idx++) {
+        lcdiicPowerTouchedLocked(members[idx]);
+        if (members[idx]->state == LCDIIC_READY && members[idx]->batch == 0 &&
+                members[idx]->flushing == 0 &&
+                members[idx]->config->portp->vmt == members[0]->config->portp->vmt &&
+                members[idx]->config->portp->bus == members[0]->config->portp->bus) {
+            ports[n++] = members[idx]->config->portp;
+        }
+    }
+
+    if (n == 2) {
+        lcdiicPortAcquireGroup(ports, n);
+    }
+    for (idx = 0; idx < 2; idx++) {
+        members[idx]->grouped = 1;
+        lcdiicCommitLocked(members[idx]);
+        members[idx]->grouped = 0;
+    }
+    if (n == 2) {
+        lcdiicPortReleaseGroup(ports, n);
+    }
+    lcdiicUnlockGroup(members, 2);
+
+    return cnt;
+}
+#endif /* LCDIIC_USE_SPAN */
+
+#if LCDIIC_USE_BACKGROUND || defined(__DOXYGEN__)
+/*
+ * Store a pattern the next page is going to need: the background worker
+ * uploads it when the bus is idle, unless a cell shows it before.
+ */
+void lcdiicPrefetchPattern(LCDIICDriver *devp, uint8_t pos, const uint8_t *pat) {
+    uint8_t ac;
+
+    chDbgCheck((devp != NULL) && (pat != NULL));
+
+    lcdiicLock(devp);
+    ac = devp->ac;
+    lcdiicPutPatternLocked(devp, pos, pat);
+    devp->ac = ac;
+    devp->cgahead |= devp->cgdirty & (1 << (pos & 0x07));
+    lcdiicUnlock(devp);
+}
+
+void lcdiicGetBackgroundStats(LCDIICDriver *devp, LCDIICBackgroundStats *statsp) {
+    chDbgCheck((devp != NULL) && (statsp != NULL));
+
+    lcdiicLock(devp);
+    *statsp = devp->stats;
+    lcdiicUnlock(devp);
+}
+#endif /* LCDIIC_USE_BACKGROUND */
+
+#if LCDIIC_USE_BLINK || defined(__DOXYGEN__)
+/*
+ * Blink the backlight from the service thread: off for offms, then on for
+ * onms, count times or forever when count is 0. onms = 0 stops blinking.
+ * The backlight is left on, lcdiicSetBacklight() also stops blinking.
+ */
+void lcdiicBlinkBacklight(LCDIICDriver *devp, uint16_t onms, uint16_t offms, uint8_t count) {
+    chDbgCheck((devp != NULL) && ((onms == 0) || (offms != 0)));
+
+    lcdiicLock(devp);
+    lcdiicPowerWakeLocked(devp);
+    chVTReset(&devp->blinkvt);
+    devp->blinkon = onms;
+    devp->blinkoff = offms;
+    devp->blinkcnt = count;
+
+    if (onms == 0) {
+        lcdiicBacklightLocked(devp, 1);
+    } else {
+        /* Start from on, so the first step switches it off */
+        devp->port.u.bl = 0x01;
+        lcdiicBlinkStepLocked(devp);
+    }
+    lcdiicUnlock(devp);
+}
+#endif /* LCDIIC_USE_BLINK */
+
+#if LCDIIC_USE_POWER || defined(__DOXYGEN__)
+/*
+ * User activity, e.g. a key press: restarts the idle time and wakes the
+ * display. So does a content change, unless LCDIICConfig keepidle is set:
+ * then a clock ticking on an idle display is held in the shadow once the
+ * display is off.
+ */
+void lcdiicPowerActivity(LCDIICDriver *devp) {
+    chDbgCheck(devp != NULL);
+
+    lcdiicLock(devp);
+    lcdiicPowerWakeLocked(devp);
+    lcdiicUnlock(devp);
+}
+
+/* Refresh period for a thread redrawing every ms milliseconds when active */
+uint32_t lcdiicPowerPeriod(LCDIICDriver *devp, uint32_t ms) {
+    chDbgCheck(devp != NULL);
+
+    return devp->power >= LCDIIC_POWER_SLOW ? ms * LCDIIC_POWER_SLOW_FACTOR : ms;
+}
+#endif /* LCDIIC_USE_POWER */
+
+/* Wait until the initialization sequence is over, MSG_OK if the panel is ready */
+msg_t lcdiicWaitReady(LCDIICDriver *devp, systime_t timeout) {
+    msg_t ret;
+
+    chDbgCheck(devp != NULL);
+
+    chSysLock();
+    if (devp->state == LCDIIC_READY) {
+        ret = MSG_OK;
+    } else if (devp->state == LCDIIC_INIT) {
+        ret = chThdEnqueueTimeoutS(&devp->waiting, timeout);
+    } else {
+        ret = MSG_RESET;
+    }
+    chSysUnlock();
+
+    return ret;
 }
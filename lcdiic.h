@@ -17,7 +17,6 @@
 #define __LCDIIC_H__
 
 #include "hal.h"
-#include "pcf8574.h"
 
 
 /*===========================================================================*/
@@ -26,6 +25,10 @@
 
 #define LCD_LINE_MAX_LEN            0x40
 
+#define LCD_DDRAM_LINE_LEN          40   /* Characters held per line in 2-line mode */
+#define LCD_DDRAM_SIZE              80   /* Two lines: 0x00..0x27, 0x40..0x67 */
+#define LCD_CGRAM_SIZE              64   /* 8 patterns, 8 rows each */
+
 /**
  * =========================================================
  * DISPLAY CONTROL INSTRUCTION
@@ -151,6 +154,299 @@
  *  1   1    D7  D6  D5  D4  D3  D2  D1  D0
  */
 
+/* Flags broadcast on lcdiicGetEventSource() */
+#define LCDIIC_EVT_FLUSHED          (eventflags_t)0x01 /* Pending writes reached the controller */
+#define LCDIIC_EVT_ERROR            (eventflags_t)0x02 /* The module stopped answering */
+#define LCDIIC_EVT_LOW_WATER        (eventflags_t)0x04 /* Fewer than LCDIIC_LOW_WATER cells left to send */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Size of the per-driver frame buffer, in bytes.
+ * @details Pending writes are encoded into this buffer and sent as a single
+ *          port write, one I2C transaction on an expander. A 4-bit write
+ *          takes 6 bytes.
+ */
+#if !defined(LCDIIC_FRAME_SIZE) || defined(__DOXYGEN__)
+#define LCDIIC_FRAME_SIZE           48
+#endif
+
+/**
+ * @brief   Largest I2C transaction of a flush, in bytes.
+ * @details Bounds how long I2CD1 is held for the other devices on the bus,
+ *          about 90 us per byte at 100 kHz. Between chunks the driver is
+ *          released, so waiting writers and lcdiicDrawTextUrgent() go first.
+ */
+#if !defined(LCDIIC_CHUNK_SIZE) || defined(__DOXYGEN__)
+#define LCDIIC_CHUNK_SIZE           LCDIIC_FRAME_SIZE
+#endif
+
+/**
+ * @brief   Stack size of the driver service thread.
+ * @details The service thread runs the initialization sequence of every
+ *          started driver, so the power-on waits of several displays overlap.
+ */
+#if !defined(LCDIIC_SERVICE_WA_SIZE) || defined(__DOXYGEN__)
+#define LCDIIC_SERVICE_WA_SIZE      256
+#endif
+
+/**
+ * @brief   Priority of the driver service thread.
+ */
+#if !defined(LCDIIC_SERVICE_PRIORITY) || defined(__DOXYGEN__)
+#define LCDIIC_SERVICE_PRIORITY     (NORMALPRIO + 2)
+#endif
+
+/**
+ * @brief   Dispatches the driver methods through a VMT.
+ * @details When disabled the method macros call the implementation directly,
+ *          which lets the compiler inline them, and each driver saves its VMT
+ *          pointer. Needed when several LCD implementations are mixed.
+ */
+#if !defined(LCDIIC_USE_VMT) || defined(__DOXYGEN__)
+#define LCDIIC_USE_VMT              TRUE
+#endif
+
+/**
+ * @brief   Gives every driver its own mutex.
+ * @details When disabled all the drivers share a single lock, so two displays
+ *          are no longer driven in parallel from two threads.
+ */
+#if !defined(LCDIIC_USE_MUTEX) || defined(__DOXYGEN__)
+#define LCDIIC_USE_MUTEX            TRUE
+#endif
+
+/**
+ * @brief   Takes the delay functions from lcdiicObjectInit().
+ * @details When disabled the delay function pointers are not stored and the
+ *          driver uses @p LCDIIC_DELAY_US() and @p LCDIIC_DELAY_MS() instead.
+ */
+#if !defined(LCDIIC_USE_DELAY_CALLBACKS) || defined(__DOXYGEN__)
+#define LCDIIC_USE_DELAY_CALLBACKS  TRUE
+#endif
+
+/**
+ * @brief   Microseconds delay when the delay callbacks are disabled.
+ * @note    A single frame at 100 kHz already lasts longer than the 37 us an
+ *          instruction takes, so nothing is waited by default.
+ */
+#if !defined(LCDIIC_DELAY_US) || defined(__DOXYGEN__)
+#define LCDIIC_DELAY_US(us)         (void)(us)
+#endif
+
+/**
+ * @brief   Milliseconds delay when the delay callbacks are disabled.
+ */
+#if !defined(LCDIIC_DELAY_MS) || defined(__DOXYGEN__)
+#define LCDIIC_DELAY_MS(ms)         chThdSleepMilliseconds(ms)
+#endif
+
+/**
+ * @brief   Enables reading CGRAM/DDRAM contents back from the controller.
+ * @details Drops lcdiicReadData(), lcdiicReadBlock() and the warm start
+ *          adoption when disabled. Busy flag reads are always available.
+ */
+#if !defined(LCDIIC_USE_READBACK) || defined(__DOXYGEN__)
+#define LCDIIC_USE_READBACK         TRUE
+#endif
+
+/**
+ * @brief   Longest delay of a backlight change, in milliseconds.
+ * @details A change rides on the next frame sent within this delay, else it
+ *          is sent alone. 0 sends every change right away.
+ */
+#if !defined(LCDIIC_BACKLIGHT_LATENCY) || defined(__DOXYGEN__)
+#define LCDIIC_BACKLIGHT_LATENCY    20
+#endif
+
+/**
+ * @brief   Enables lcdiicBlinkBacklight().
+ */
+#if !defined(LCDIIC_USE_BLINK) || defined(__DOXYGEN__)
+#define LCDIIC_USE_BLINK            TRUE
+#endif
+
+/**
+ * @brief   Enables the background worker.
+ * @details A low priority thread uploads the patterns given to
+ *          lcdiicPrefetchPattern() and, with LCDIIC_USE_READBACK, reads back
+ *          a few DDRAM cells at a time to rewrite the ones that differ from
+ *          the shadow. It only works while nobody else uses the driver.
+ */
+#if !defined(LCDIIC_USE_BACKGROUND) || defined(__DOXYGEN__)
+#define LCDIIC_USE_BACKGROUND       FALSE
+#endif
+
+/**
+ * @brief   Stack size of the background worker thread.
+ */
+#if !defined(LCDIIC_BACKGROUND_WA_SIZE) || defined(__DOXYGEN__)
+#define LCDIIC_BACKGROUND_WA_SIZE   256
+#endif
+
+/**
+ * @brief   Priority of the background worker thread.
+ */
+#if !defined(LCDIIC_BACKGROUND_PRIORITY) || defined(__DOXYGEN__)
+#define LCDIIC_BACKGROUND_PRIORITY  (LOWPRIO + 1)
+#endif
+
+/**
+ * @brief   Background worker period, in milliseconds.
+ */
+#if !defined(LCDIIC_BACKGROUND_PERIOD) || defined(__DOXYGEN__)
+#define LCDIIC_BACKGROUND_PERIOD    250
+#endif
+
+/**
+ * @brief   DDRAM cells verified per background period, 0 disables scrubbing.
+ * @details A full pass over the 80 cells takes 20 periods by default.
+ */
+#if !defined(LCDIIC_SCRUB_CELLS) || defined(__DOXYGEN__)
+#define LCDIIC_SCRUB_CELLS          4
+#endif
+
+/**
+ * @brief   Enables the per-driver event source.
+ */
+#if !defined(LCDIIC_USE_EVENTS) || defined(__DOXYGEN__)
+#define LCDIIC_USE_EVENTS           TRUE
+#endif
+
+/**
+ * @brief   Dirty cells below which LCDIIC_EVT_LOW_WATER is broadcast.
+ * @details Only after a commit left at least this many cells to send, so a
+ *          producer can prepare the next page while the end of the current
+ *          one is still going out.
+ */
+#if !defined(LCDIIC_LOW_WATER) || defined(__DOXYGEN__)
+#define LCDIIC_LOW_WATER            16
+#endif
+
+/**
+ * @brief   Enables mirror groups, see lcdiicMirrorDrawText().
+ */
+#if !defined(LCDIIC_USE_MIRROR) || defined(__DOXYGEN__)
+#define LCDIIC_USE_MIRROR           FALSE
+#endif
+
+/**
+ * @brief   Displays per mirror group.
+ */
+#if !defined(LCDIIC_MIRROR_MAX) || defined(__DOXYGEN__)
+#define LCDIIC_MIRROR_MAX           4
+#endif
+
+/**
+ * @brief   Enables spans, two displays drawn as one, see lcdiicSpanDrawText().
+ */
+#if !defined(LCDIIC_USE_SPAN) || defined(__DOXYGEN__)
+#define LCDIIC_USE_SPAN             FALSE
+#endif
+
+/**
+ * @brief   Enables the power manager, see LCDIICConfig idlesec.
+ */
+#if !defined(LCDIIC_USE_POWER) || defined(__DOXYGEN__)
+#define LCDIIC_USE_POWER            FALSE
+#endif
+
+/**
+ * @brief   Refresh period multiplier of lcdiicPowerPeriod() once idle.
+ */
+#if !defined(LCDIIC_POWER_SLOW_FACTOR) || defined(__DOXYGEN__)
+#define LCDIIC_POWER_SLOW_FACTOR    4
+#endif
+
+/**
+ * @brief   Overlaps the encoding of a flush with its transmission.
+ * @details Each chunk but the last is handed to the port submit method and
+ *          the next one is encoded into a second frame buffer meanwhile, so
+ *          LCDIIC_FRAME_SIZE more bytes per driver. A failed chunk takes the
+ *          driver offline at the next send.
+ */
+#if !defined(LCDIIC_USE_QUEUE) || defined(__DOXYGEN__)
+#define LCDIIC_USE_QUEUE            TRUE
+#endif
+
+/**
+ * @brief   Enables lcdiicScanoutStart(), the panel refreshed from a RAM frame.
+ * @details 6 * (LCDIIC_SCANOUT_COLS + 2) bytes per DDRAM line and driver.
+ */
+#if !defined(LCDIIC_USE_SCANOUT) || defined(__DOXYGEN__)
+#define LCDIIC_USE_SCANOUT          FALSE
+#endif
+
+/**
+ * @brief   Columns of each DDRAM line refreshed by the scanout.
+ */
+#if !defined(LCDIIC_SCANOUT_COLS) || defined(__DOXYGEN__)
+#define LCDIIC_SCANOUT_COLS         16
+#endif
+
+/**
+ * @brief   Enables lcdiicDrawScreen() and its prerendered frame streams.
+ */
+#if !defined(LCDIIC_USE_SCREENS) || defined(__DOXYGEN__)
+#define LCDIIC_USE_SCREENS          TRUE
+#endif
+
+/**
+ * @brief   Skips the full initialization when the controller kept its power.
+ * @details After an MCU-only reset the controller is probed first, by the
+ *          service thread. When it is already in 4-bit mode, the 40 ms wait
+ *          and the 8-bit resync are skipped and the driver is ready about
+ *          2 ms after the probe.
+ */
+#if !defined(LCDIIC_USE_WARM_START) || defined(__DOXYGEN__)
+#define LCDIIC_USE_WARM_START       TRUE
+#endif
+
+/**
+ * @brief   Adopts the DDRAM contents found on a warm start.
+ * @details The content stays on the glass and the DDRAM is read back into
+ *          the shadow in the background, once the driver is ready; cells
+ *          written before their read back are always sent. When disabled,
+ *          the DDRAM is cleared.
+ */
+#if !defined(LCDIIC_USE_WARM_ADOPT) || defined(__DOXYGEN__)
+#define LCDIIC_USE_WARM_ADOPT       LCDIIC_USE_READBACK
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if LCDIIC_USE_WARM_ADOPT && !LCDIIC_USE_WARM_START
+#error "LCDIIC_USE_WARM_ADOPT requires LCDIIC_USE_WARM_START"
+#endif
+
+#if LCDIIC_USE_WARM_ADOPT && !LCDIIC_USE_READBACK
+#error "LCDIIC_USE_WARM_ADOPT requires LCDIIC_USE_READBACK"
+#endif
+
+#if LCDIIC_SCRUB_CELLS > LCD_DDRAM_SIZE
+#error "LCDIIC_SCRUB_CELLS must not exceed the DDRAM size"
+#endif
+
+#if LCDIIC_USE_SCANOUT && !LCDIIC_USE_QUEUE
+#error "LCDIIC_USE_SCANOUT requires LCDIIC_USE_QUEUE"
+#endif
+
+#if LCDIIC_SCANOUT_COLS < 1 || LCDIIC_SCANOUT_COLS > LCD_DDRAM_LINE_LEN
+#error "LCDIIC_SCANOUT_COLS must be 1 to LCD_DDRAM_LINE_LEN"
+#endif
+
+#if LCDIIC_FRAME_SIZE < 6
+#error "LCDIIC_FRAME_SIZE must hold at least one 4-bit write"
+#endif
+
+#if (LCDIIC_CHUNK_SIZE < 12) || (LCDIIC_CHUNK_SIZE > LCDIIC_FRAME_SIZE)
+#error "LCDIIC_CHUNK_SIZE must hold one cell and fit in LCDIIC_FRAME_SIZE"
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
@@ -159,8 +455,18 @@ typedef enum {
     LCDIIC_UNINIT = 0,
     LCDIIC_STOP = 1,
     LCDIIC_READY = 2,
+    LCDIIC_INIT = 3,        /* Running the controller initialization sequence */
+    LCDIIC_OFFLINE = 4,     /* No ACK from the module, waiting for lcdiicProbe() */
 } lcdiic_state_t;
 
+/* Power manager stages, each one keeps what the previous ones did */
+typedef enum {
+    LCDIIC_POWER_ACTIVE = 0,
+    LCDIIC_POWER_SLOW = 1,  /* lcdiicPowerPeriod() stretches the refresh period */
+    LCDIIC_POWER_DARK = 2,  /* Backlight off */
+    LCDIIC_POWER_OFF = 3,   /* Display off, writes held in the shadow, bus stopped if idle */
+} lcdiic_power_t;
+
 typedef enum {
     LCDIIC_BUS_MODE_4BIT = 0,
     LCDIIC_BUS_MODE_8BIT = 1,
@@ -177,11 +483,105 @@ typedef union {
     uint8_t v;
 } lcdiic_port_cfg;
 
+/* Pins of lcdiic_port_cfg, for the port backends */
+#define LCDIIC_PORT_RS              0x01
+#define LCDIIC_PORT_RW              0x02
+#define LCDIIC_PORT_EN              0x04
+#define LCDIIC_PORT_BL              0x08
+#define LCDIIC_PORT_DATA            0xf0
+
+/*
+ * Port backend, see lcdiicport.h: drives the module pins from lcdiic_port_cfg
+ * bytes. Writes OR the backend mask in and leave the caller buffer untouched.
+ * - xfer: write txlen bytes, then sample the pins rxlen times
+ * - writeMasked: drive the pins of bits to their level in val, the others
+ *   keep the latch, the last byte written
+ * - lease, release: keep a shared bus across several calls, they nest
+ * - idle: the display does not need the bus for a while, the backend may
+ *   stop it once it has no other user
+ * - busy: another thread holds the shared bus or has writes queued for it,
+ *   background work keeps off; never for pins of its own
+ * - writeGroup, acquireGroup, releaseGroup: the same for n ports of this
+ *   backend on one bus, within one bus acquisition
+ * - submit: start a write and return, like write the buffer is left
+ *   untouched; it stays in use until wait, which returns the result. Without a queue
+ *   the write is done at once and submit returns its result. Any other call
+ *   waits for it first.
+ */
+#define _lcdiic_port_methods \
+    msg_t (*write)(void *instance, const uint8_t *val, uint8_t len); \
+    msg_t (*xfer)(void *instance, const uint8_t *txval, uint8_t txlen, \
+            uint8_t *rxval, uint8_t rxlen); \
+    msg_t (*writeMasked)(void *instance, uint8_t bits, uint8_t val); \
+    uint8_t (*latch)(void *instance); \
+    void (*lease)(void *instance); \
+    void (*release)(void *instance); \
+    void (*idle)(void *instance); \
+    bool (*busy)(void *instance); \
+    msg_t (*writeGroup)(void * const *instances, uint8_t n, const uint8_t *val, uint8_t len, \
+            msg_t *rets); \
+    void (*acquireGroup)(void * const *instances, uint8_t n); \
+    void (*releaseGroup)(void * const *instances, uint8_t n); \
+    msg_t (*submit)(void *instance, const uint8_t *val, uint8_t len); \
+    msg_t (*wait)(void *instance);
+
+/*
+ * - bus: shared bus of the port, NULL when its pins are its own
+ * - mask: pins always driven high
+ * - wide: 16-bit port, each word is the control byte then D7..D0 and the
+ *   controller runs its 8-bit interface; latch and writeMasked only see the
+ *   control byte
+ */
+#define _lcdiic_port_data \
+    const void *bus; \
+    uint8_t mask; \
+    uint8_t wide;
+
+struct LCDIICPortVMT {
+    _lcdiic_port_methods
+};
+
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_port_data
+} LCDIICPort;
+
 typedef struct {
-    PCF8574Driver *drvp;
-    const PCF8574Config *drvcfg;
+    LCDIICPort *portp;
+#if LCDIIC_USE_POWER
+    /* Seconds without lcdiicPowerActivity() before entering LCDIIC_POWER_SLOW,
+     * _DARK and _OFF, 0 skips the stage */
+    uint16_t idlesec[3];
+    /* Content changes leave the idle time running, e.g. a clock ticking on an
+     * otherwise idle display. Otherwise they count as activity */
+    uint8_t keepidle;
+#endif
 } LCDIICConfig;
 
+/*
+ * Screen prerendered by tools/lcdscreens: stream holds the port frames,
+ * text the rows * cols characters kept in the shadow.
+ */
+typedef struct {
+    const uint8_t *stream;
+    const char *text;
+    uint8_t rows;
+    uint8_t cols;
+} LCDIICScreen;
+
+/* Bus usage, from lcdiicGetBackgroundStats() */
+typedef struct {
+    uint32_t busbytes;                  /* Bytes on the bus, address bytes included */
+    uint32_t bgbytes;                   /* Part of busbytes sent by the background worker */
+    uint16_t prefetched;                /* Patterns uploaded ahead of use */
+    uint16_t repaired;                  /* Cells found different from the shadow */
+} LCDIICBackgroundStats;
+
+/* Stream records: header below LCDIIC_STREAM_RLE, then that many bytes; or
+ * LCDIIC_STREAM_RLE | count, then one 6-byte write repeated count times */
+#define LCDIIC_STREAM_END           0x00
+#define LCDIIC_STREAM_RLE           0x80
+
 #define _lcdiic_methods \
     uint8_t (*isBusy)(void *instance); \
     void (*setBacklight)(void *instance, uint8_t on); \
@@ -192,31 +592,210 @@ typedef struct {
     void (*returnHome)(void *instance); \
     void (*updatePattern)(void *instance, uint8_t pos, const uint8_t *pat); \
     void (*moveTo)(void *instance, uint8_t row, uint8_t col); \
-    msg_t (*readData)(void *instance, uint8_t ddram, uint8_t offset, uint8_t *val); \
     void (*addChar)(void *instance, uint8_t ch); \
     uint8_t (*drawText)(void *instance, uint8_t row, uint8_t col, const char *text, uint8_t len);
 
+#define _lcdiic_readback_methods \
+    msg_t (*readData)(void *instance, uint8_t ddram, uint8_t offset, uint8_t *val); \
+    msg_t (*readBlock)(void *instance, uint8_t ddram, uint8_t offset, uint8_t *buf, uint8_t n);
+
 struct LCDIICVMT {
     _lcdiic_methods
+#if LCDIIC_USE_READBACK
+    _lcdiic_readback_methods
+#endif
 };
 
+/* Address counter values at or above this point refer to CGRAM */
+#define LCDIIC_AC_CGRAM             0x80
+
+/*
+ * Shadow of everything written to the controller, used to replay the lost
+ * state after the module is re-attached or the controller is reset.
+ * - ddram: indexed by line * LCD_DDRAM_LINE_LEN + column
+ * - dirty: one bit per ddram cell not yet sent to the controller
+ * - cgused: patterns written at least once, cgdirty: patterns not yet sent
+ * - ac: address counter as seen by the controller once dirty cells are sent
+ * - hwac: address counter the controller currently holds
+ * - batch: lcdiicBatchBegin() nesting, flushes are deferred while non zero
+ * - flushing: flushes paused between two chunks, they send later writes too
+ * - blvt: sends a port.u.bl change no frame carried, see lcdiicPortGetLatch()
+ * - blinkon, blinkoff, blinkcnt: backlight blink schedule run by blinkvt
+ * - event: LCDIIC_EVT_* flags, lowwater: a commit left LCDIIC_LOW_WATER dirty
+ *   cells or more
+ * - mirror: group being flushed through this driver, its frames go to all
+ *   the members
+ * - grouped: flushed while other drivers are locked, without preemption
+ * - power: power manager stage, activity: time of the last activity,
+ *   blsaved: backlight to restore on wake, powervt: next stage timer,
+ *   touched: the shadow changed since the last commit
+ * - cgahead: dirty patterns from lcdiicPrefetchPattern(), left to the
+ *   background worker until a cell shows them; scrub: next cell to verify
+ * - scan: DDRAM lines 0 and 1 encoded for the scanout, an address, the cells
+ *   and the address counter to restore; scanvt submits line scanrow every
+ *   scanival ms, 0 when stopped. scanstale: lines edited since last sent,
+ *   scanbl: backlight bit they carry
+ *
+ * Initialization is a sequence of steps separated by timer waits (vt), run by
+ * the service thread when svcflags says so. Drivers are chained through next
+ * once started, threads in lcdiicWaitReady() sleep on waiting.
+ */
+#if LCDIIC_USE_MUTEX
+#define _lcdiic_mutex               mutex_t mutex;
+#else
+#define _lcdiic_mutex
+#endif
+
+#if LCDIIC_USE_MIRROR
+#define _lcdiic_mirror              struct LCDIICMirror *mirror;
+#else
+#define _lcdiic_mirror
+#endif
+
+#if LCDIIC_USE_MIRROR || LCDIIC_USE_SPAN
+#define _lcdiic_grouped             uint8_t grouped;
+#else
+#define _lcdiic_grouped
+#endif
+
+#if LCDIIC_USE_POWER
+#define _lcdiic_power \
+    lcdiic_power_t power; \
+    uint8_t blsaved; \
+    systime_t activity; \
+    virtual_timer_t powervt; \
+    uint8_t touched;
+#else
+#define _lcdiic_power
+#endif
+
+#if LCDIIC_USE_EVENTS
+#define _lcdiic_events \
+    event_source_t event; \
+    uint8_t lowwater;
+#else
+#define _lcdiic_events
+#endif
+
+#if LCDIIC_USE_BACKGROUND
+#define _lcdiic_background \
+    uint8_t cgahead; \
+    uint8_t scrub; \
+    LCDIICBackgroundStats stats;
+#else
+#define _lcdiic_background
+#endif
+
+#if LCDIIC_USE_BLINK
+#define _lcdiic_blink \
+    virtual_timer_t blinkvt; \
+    uint16_t blinkon; \
+    uint16_t blinkoff; \
+    uint8_t blinkcnt;
+#else
+#define _lcdiic_blink
+#endif
+
+/* Next DDRAM cell a warm start reads back, LCD_DDRAM_SIZE once adopted */
+#if LCDIIC_USE_WARM_ADOPT
+#define _lcdiic_adopt               uint8_t adopt;
+#else
+#define _lcdiic_adopt
+#endif
+
+#if LCDIIC_USE_SCANOUT
+#define _lcdiic_scanout \
+    uint8_t scan[2][6 * (LCDIIC_SCANOUT_COLS + 2)]; \
+    virtual_timer_t scanvt; \
+    uint16_t scanival; \
+    uint8_t scanrow; \
+    uint8_t scanstale; \
+    uint8_t scanbl;
+#else
+#define _lcdiic_scanout
+#endif
+
+#if LCDIIC_USE_QUEUE
+/* frame points into frames, the other one is on the bus while queued is set */
+#define _lcdiic_frame \
+    uint8_t *frame; \
+    uint8_t frames[2][LCDIIC_FRAME_SIZE]; \
+    uint8_t queued;
+#else
+#define _lcdiic_frame \
+    uint8_t frame[LCDIIC_FRAME_SIZE];
+#endif
+
 #define _lcdiic_data \
     lcdiic_port_cfg port; \
     lcdiic_state_t state; \
     const LCDIICConfig *config; \
-    mutex_t mutex;
+    _lcdiic_mutex \
+    uint8_t ddram[LCD_DDRAM_SIZE]; \
+    uint8_t dirty[LCD_DDRAM_SIZE / 8]; \
+    uint8_t cgram[LCD_CGRAM_SIZE]; \
+    uint8_t cgused; \
+    uint8_t cgdirty; \
+    uint8_t ac; \
+    uint8_t hwac; \
+    uint8_t dctl; \
+    uint8_t dshift; \
+    uint8_t framelen; \
+    _lcdiic_frame \
+    uint8_t batch; \
+    uint8_t flushing; \
+    virtual_timer_t blvt; \
+    _lcdiic_blink \
+    _lcdiic_background \
+    _lcdiic_events \
+    _lcdiic_mirror \
+    _lcdiic_grouped \
+    _lcdiic_power \
+    _lcdiic_scanout \
+    virtual_timer_t vt; \
+    threads_queue_t waiting; \
+    uint8_t step; \
+    _lcdiic_adopt \
+    volatile uint8_t svcflags; \
+    struct LCDIICDriver *next;
 
 typedef struct LCDIICDriver {
+#if LCDIIC_USE_VMT
     const struct LCDIICVMT *vmt;
+#endif
+#if LCDIIC_USE_DELAY_CALLBACKS
     void (*delayUs)(uint32_t val);
     void (*delayMs)(uint32_t val);
+#endif
     _lcdiic_data;
 } LCDIICDriver;
 
+/*
+ * Displays showing the same content. Members on one bus with identical
+ * shadows get each update encoded once and sent to all of them in a row.
+ * sent: a frame of the current update went out to the members.
+ */
+typedef struct LCDIICMirror {
+    LCDIICDriver *members[LCDIIC_MIRROR_MAX];
+    uint8_t n;
+    uint8_t sent;
+} LCDIICMirror;
+
+/*
+ * Two displays of cols x 2 characters drawn as one surface: side by side,
+ * (2 * cols) x 2, or stacked, cols x 4. Both must be on the same bus.
+ */
+typedef struct {
+    LCDIICDriver *members[2];
+    uint8_t cols;
+    uint8_t stacked;
+} LCDIICSpan;
+
 /*===========================================================================*/
 /* Driver macros.                                                            */
 /*===========================================================================*/
 
+#if LCDIIC_USE_VMT || defined(__DOXYGEN__)
 #define lcdiicIsBusy(ip) \
     (ip)->vmt->isBusy(ip)
 
@@ -244,14 +823,111 @@ typedef struct LCDIICDriver {
 #define lcdiicMoveTo(ip, row, col) \
     (ip)->vmt->moveTo(ip, row, col)
 
+#define lcdiicAddChar(ip, ch) \
+    (ip)->vmt->addChar(ip, ch)
+
+#define lcdiicDrawText(ip, row, col, text, len) \
+    (ip)->vmt->drawText(ip, row, col, text, len)
+
+#if LCDIIC_USE_READBACK || defined(__DOXYGEN__)
 #define lcdiicReadData(ip, ddram, offset, val) \
     (ip)->vmt->readData(ip, ddram, offset, val)
 
+#define lcdiicReadBlock(ip, ddram, offset, buf, n) \
+    (ip)->vmt->readBlock(ip, ddram, offset, buf, n)
+#endif
+#else
+#define lcdiicIsBusy(ip) \
+    _lcdiic_is_busy(ip)
+
+#define lcdiicSetBacklight(ip, on) \
+    _lcdiic_set_backlight(ip, on)
+
+#define lcdiicToggleBacklight(ip) \
+    _lcdiic_toggle_backlight(ip)
+
+#define lcdiicSetDisplay(ip, display, cursor, blink) \
+    _lcdiic_set_display(ip, display, cursor, blink)
+
+#define lcdiicShiftContent(ip, display, right) \
+    _lcdiic_shift_content(ip, display, right)
+
+#define lcdiicClearScreen(ip) \
+    _lcdiic_clear_screen(ip)
+
+#define lcdiicReturnHome(ip) \
+    _lcdiic_return_home(ip)
+
+#define lcdiicUpdatePattern(ip, pos, pat) \
+    _lcdiic_update_pattern(ip, pos, pat)
+
+#define lcdiicMoveTo(ip, row, col) \
+    _lcdiic_move_to(ip, row, col)
+
 #define lcdiicAddChar(ip, ch) \
-    (ip)->vmt->addChar(ip, ch)
+    _lcdiic_add_char(ip, ch)
 
 #define lcdiicDrawText(ip, row, col, text, len) \
-    (ip)->vmt->drawText(ip, row, col, text, len)
+    _lcdiic_draw_text(ip, row, col, text, len)
+
+#if LCDIIC_USE_READBACK
+#define lcdiicReadData(ip, ddram, offset, val) \
+    _lcdiic_read_data(ip, ddram, offset, val)
+
+#define lcdiicReadBlock(ip, ddram, offset, buf, n) \
+    _lcdiic_read_block(ip, ddram, offset, buf, n)
+#endif
+#endif
+
+#define lcdiicPortWrite(ip, val, len) \
+    (ip)->vmt->write(ip, val, len)
+
+#define lcdiicPortXfer(ip, txval, txlen, rxval, rxlen) \
+    (ip)->vmt->xfer(ip, txval, txlen, rxval, rxlen)
+
+#define lcdiicPortWriteMasked(ip, bits, val) \
+    (ip)->vmt->writeMasked(ip, bits, val)
+
+#define lcdiicPortGetLatch(ip) \
+    (ip)->vmt->latch(ip)
+
+#define lcdiicPortLease(ip) \
+    (ip)->vmt->lease(ip)
+
+#define lcdiicPortRelease(ip) \
+    (ip)->vmt->release(ip)
+
+#define lcdiicPortIdle(ip) \
+    (ip)->vmt->idle(ip)
+
+#define lcdiicPortBusy(ip) \
+    (ip)->vmt->busy(ip)
+
+/* ports: array of n LCDIICPort pointers, all of the backend of ports[0] */
+#define lcdiicPortWriteGroup(ports, n, val, len, rets) \
+    (ports)[0]->vmt->writeGroup((void * const *)(ports), n, val, len, rets)
+
+#define lcdiicPortAcquireGroup(ports, n) \
+    (ports)[0]->vmt->acquireGroup((void * const *)(ports), n)
+
+#define lcdiicPortReleaseGroup(ports, n) \
+    (ports)[0]->vmt->releaseGroup((void * const *)(ports), n)
+
+#define lcdiicPortSubmit(ip, val, len) \
+    (ip)->vmt->submit(ip, val, len)
+
+#define lcdiicPortWait(ip) \
+    (ip)->vmt->wait(ip)
+
+#if LCDIIC_USE_EVENTS || defined(__DOXYGEN__)
+/* Event source of the driver, see LCDIIC_EVT_* */
+#define lcdiicGetEventSource(ip)    (&(ip)->event)
+#endif
+
+#if LCDIIC_USE_POWER || defined(__DOXYGEN__)
+/* Current power manager stage, see lcdiic_power_t */
+#define lcdiicPowerGetStage(ip)     ((ip)->power)
+#endif
 
 /*===========================================================================*/
 /* External declarations.                                                    */
@@ -264,6 +940,57 @@ extern "C" {
 void lcdiicObjectInit(LCDIICDriver *devp, void (*delayUs)(uint32_t), void (*delayMs)(uint32_t));
 void lcdiicStart(LCDIICDriver *devp, const LCDIICConfig *config);
 void lcdiicStop(LCDIICDriver *devp);
+msg_t lcdiicProbe(LCDIICDriver *devp);
+msg_t lcdiicWaitReady(LCDIICDriver *devp, systime_t timeout);
+void lcdiicBatchBegin(LCDIICDriver *devp);
+msg_t lcdiicBatchEnd(LCDIICDriver *devp);
+uint8_t lcdiicDrawTextUrgent(LCDIICDriver *devp, uint8_t row, uint8_t col, const char *text, uint8_t len);
+#if LCDIIC_USE_MIRROR
+void lcdiicMirrorObjectInit(LCDIICMirror *mp);
+void lcdiicMirrorAdd(LCDIICMirror *mp, LCDIICDriver *devp);
+uint8_t lcdiicMirrorDrawText(LCDIICMirror *mp, uint8_t row, uint8_t col, const char *text, uint8_t len);
+void lcdiicMirrorUpdatePattern(LCDIICMirror *mp, uint8_t pos, const uint8_t *pat);
+#endif
+#if LCDIIC_USE_SPAN
+void lcdiicSpanObjectInit(LCDIICSpan *sp, LCDIICDriver *first, LCDIICDriver *second,
+        uint8_t cols, uint8_t stacked);
+uint8_t lcdiicSpanDrawText(LCDIICSpan *sp, uint8_t row, uint8_t col, const char *text, uint8_t len);
+#endif
+#if LCDIIC_USE_POWER
+void lcdiicPowerActivity(LCDIICDriver *devp);
+uint32_t lcdiicPowerPeriod(LCDIICDriver *devp, uint32_t ms);
+#endif
+#if LCDIIC_USE_BACKGROUND
+void lcdiicPrefetchPattern(LCDIICDriver *devp, uint8_t pos, const uint8_t *pat);
+void lcdiicGetBackgroundStats(LCDIICDriver *devp, LCDIICBackgroundStats *statsp);
+#endif
+#if LCDIIC_USE_BLINK
+void lcdiicBlinkBacklight(LCDIICDriver *devp, uint16_t onms, uint16_t offms, uint8_t count);
+#endif
+#if LCDIIC_USE_SCANOUT
+msg_t lcdiicScanoutStart(LCDIICDriver *devp, uint16_t interval);
+void lcdiicScanoutStop(LCDIICDriver *devp);
+#endif
+#if LCDIIC_USE_SCREENS
+msg_t lcdiicDrawScreen(LCDIICDriver *devp, const LCDIICScreen *screen);
+#endif
+#if !LCDIIC_USE_VMT
+uint8_t _lcdiic_is_busy(void *ip);
+void _lcdiic_set_backlight(void *ip, uint8_t on);
+void _lcdiic_toggle_backlight(void *ip);
+void _lcdiic_set_display(void *ip, uint8_t display, uint8_t cursor, uint8_t blink);
+void _lcdiic_clear_screen(void *ip);
+void _lcdiic_shift_content(void *ip, uint8_t display, uint8_t right);
+void _lcdiic_return_home(void *ip);
+void _lcdiic_update_pattern(void *ip, uint8_t pos, const uint8_t *pat);
+void _lcdiic_move_to(void *ip, uint8_t row, uint8_t col);
+void _lcdiic_add_char(void *ip, uint8_t ch);
+uint8_t _lcdiic_draw_text(void *ip, uint8_t row, uint8_t col, const char *text, uint8_t len);
+#if LCDIIC_USE_READBACK
+msg_t _lcdiic_read_data(void *ip, uint8_t ddram, uint8_t offset, uint8_t *val);
+msg_t _lcdiic_read_block(void *ip, uint8_t ddram, uint8_t offset, uint8_t *buf, uint8_t n);
+#endif
+#endif
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LCDIIC_HPP__
+#define __LCDIIC_HPP__
+
+/*
+ * Header-only C++14 HD44780 driver. The expander, the geometry, the pin map
+ * and the timing are template parameters, so every call is resolved at
+ * compile time and can be inlined, and the frames of constant strings are
+ * encoded by the compiler:
+ *
+ *   static constexpr auto banner =
+ *       lcdiic::textFrame<lcdiic::Geometry1602, lcdiic::PinMapPcf8574T>(0, 0, "ChibiOS/RT");
+ *
+ *   lcdiic::Pcf8574 ex(PCF8574D1);
+ *   lcdiic::Lcd<lcdiic::Pcf8574> lcd(ex);
+ *   lcd.start();
+ *   lcd.send(banner);
+ *
+ * Unlike LCDIICDriver there is no shadow, no readback and no locking: one
+ * thread owns the display. Both can share the same PCF8574Driver bus.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+
+namespace lcdiic {
+
+/*===========================================================================*/
+/* Geometry, pin map and timing policies.                                    */
+/*===========================================================================*/
+
+/*
+ * Visible size. Rows 0 and 1 start at DDRAM 0x00 and 0x40, rows 2 and 3 of
+ * 4-line displays continue those lines Cols cells further.
+ */
+template <uint8_t Cols, uint8_t Rows>
+struct Geometry {
+    static_assert(Rows >= 1 && Rows <= 4, "1 to 4 rows");
+    static_assert(Cols >= 1 && Cols * ((Rows + 1) / 2) <= LCD_DDRAM_LINE_LEN,
+            "rows do not fit in DDRAM");
+
+    static constexpr uint8_t cols = Cols;
+    static constexpr uint8_t rows = Rows;
+
+    static constexpr uint8_t address(uint8_t row, uint8_t col) {
+        return ((row & 0x01) ? 0x40 : 0x00) + ((row & 0x02) ? Cols : 0) + col;
+    }
+};
+
+typedef Geometry<16, 2> Geometry1602;
+typedef Geometry<20, 4> Geometry2004;
+
+/* Expander bit of each LCD signal, D4..D7 on four consecutive bits from D4 */
+template <uint8_t RS, uint8_t RW, uint8_t EN, uint8_t BL, uint8_t D4>
+struct PinMap {
+    static_assert(D4 <= 4, "D4..D7 must fit in the port");
+
+    static constexpr uint8_t rs = 1 << RS;
+    static constexpr uint8_t rw = 1 << RW;
+    static constexpr uint8_t en = 1 << EN;
+    static constexpr uint8_t bl = 1 << BL;
+
+    static constexpr uint8_t data(uint8_t nibble) {
+        return (nibble & 0x0f) << D4;
+    }
+};
+
+/* P0 - RS, P1 - RW, P2 - E, P3 - BL, P4..P7 - D4..D7 */
+typedef PinMap<0, 1, 2, 3, 4> PinMapPcf8574T;
+
+/* HD44780 waits, running from a ChibiOS thread */
+struct TimingChibios {
+    static constexpr uint32_t powerOnMs = 40;
+    static constexpr uint32_t clearMs = 2;
+
+    /* A 100 kHz frame already outlasts the 37 us of an instruction */
+    static void delayUs(uint32_t us) {
+        (void)us;
+    }
+
+    static void delayMs(uint32_t ms) {
+        chThdSleepMilliseconds(ms);
+    }
+};
+
+/*===========================================================================*/
+/* Frames.                                                                   */
+/*===========================================================================*/
+
+/* Expander bytes sent as one I2C transaction */
+template <size_t N>
+struct Frame {
+    uint8_t data[N];
+    size_t size;
+
+    constexpr Frame() : data(), size(0) {}
+
+    constexpr bool full(size_t room) const {
+        return size + room > N;
+    }
+};
+
+template <typename PinMap>
+struct Encoder {
+    /* Data, then EN high and low: the LCD latches on the falling edge */
+    template <size_t N>
+    static constexpr void nibble(Frame<N> &f, uint8_t ctl, uint8_t val) {
+        f.data[f.size++] = ctl | PinMap::data(val);
+        f.data[f.size++] = ctl | PinMap::data(val) | PinMap::en;
+        f.data[f.size++] = ctl | PinMap::data(val);
+    }
+
+    /* A write in 4-bit mode, 6 bytes */
+    template <size_t N>
+    static constexpr void put(Frame<N> &f, uint8_t ctl, uint8_t val) {
+        nibble(f, ctl, val >> 4);
+        nibble(f, ctl, val);
+    }
+
+    template <size_t N>
+    static constexpr void instruction(Frame<N> &f, bool bl, uint8_t cmd) {
+        put(f, bl ? PinMap::bl : 0, cmd);
+    }
+
+    template <size_t N>
+    static constexpr void data(Frame<N> &f, bool bl, uint8_t val) {
+        put(f, PinMap::rs | (bl ? PinMap::bl : 0), val);
+    }
+};
+
+/*
+ * Frame writing a string literal at row, col. Built at compile time when
+ * assigned to a constexpr object, which then lives in flash. The backlight
+ * state is part of every byte, so it is fixed here.
+ */
+template <typename Geometry, typename PinMap, size_t L>
+constexpr Frame<6 * L> textFrame(uint8_t row, uint8_t col, const char (&text)[L], bool bl = true) {
+    Frame<6 * L> f;
+
+    Encoder<PinMap>::instruction(f, bl, LCD_CMD_SET_DDRAM_ADDR | Geometry::address(row, col));
+    for (size_t idx = 0; idx < L - 1 && col + idx < Geometry::cols; idx++) {
+        Encoder<PinMap>::data(f, bl, (uint8_t)text[idx]);
+    }
+
+    return f;
+}
+
+/*===========================================================================*/
+/* Expanders.                                                                */
+/*===========================================================================*/
+
+/*
+ * Expander interface: bool send(const uint8_t *buf, size_t len), one I2C
+ * transaction per call if possible.
+ */
+class Pcf8574 {
+public:
+    explicit Pcf8574(PCF8574Driver &drv) : drv_(drv) {}
+
+    bool send(const uint8_t *buf, size_t len) {
+        while (len > 0) {
+            uint8_t n = len > 0xff ? 0xff : (uint8_t)len;
+
+            /* The buffer can be in flash, the config mask is ORed in on the
+             * way out as the C driver does */
+            if (pcf8574SetPort(&drv_, 1, buf, n) != MSG_OK) {
+                return false;
+            }
+            buf += n;
+            len -= n;
+        }
+
+        return true;
+    }
+
+private:
+    PCF8574Driver &drv_;
+};
+
+/*===========================================================================*/
+/* Driver.                                                                   */
+/*===========================================================================*/
+
+template <typename Expander, typename Geometry = Geometry1602,
+        typename PinMap = PinMapPcf8574T, typename Timing = TimingChibios>
+class Lcd {
+public:
+    typedef Encoder<PinMap> Enc;
+
+    explicit Lcd(Expander &ex) : ex_(ex), bl_(true), failed_(false) {}
+
+    /* LCD Initialize - 4-Bit Interface, blocking */
+    bool start() {
+        Timing::delayMs(Timing::powerOnMs);
+
+        /* From any state to 8-bit mode, then 4-bit mode */
+        nibble(LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+        Timing::delayMs(5);
+        nibble(LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+        Timing::delayMs(1);
+        nibble(LCD_CMD_FUNCTION_SET | LCD_BUS_MODE);
+        nibble(LCD_CMD_FUNCTION_SET);
+
+        Enc::instruction(frame_, bl_, LCD_CMD_FUNCTION_SET |
+                (Geometry::rows > 1 ? LCD_DISPLAY_MODE : 0));
+        Enc::instruction(frame_, bl_, LCD_CMD_DISPLAY_CONTROL);
+        Enc::instruction(frame_, bl_, LCD_CMD_CLEAR_DISPLAY);
+        if (!flush()) return false;
+        Timing::delayMs(Timing::clearMs);
+
+        Enc::instruction(frame_, bl_, LCD_CMD_ENTRY_MODE_SET | LCD_ENTRY_MODE_INC);
+        Enc::instruction(frame_, bl_, LCD_CMD_DISPLAY_CONTROL | LCD_DISPLAY_ON);
+        return flush();
+    }
+
+    bool clear() {
+        return command(LCD_CMD_CLEAR_DISPLAY, Timing::clearMs);
+    }
+
+    bool home() {
+        return command(LCD_CMD_RETURN_HOME, Timing::clearMs);
+    }
+
+    bool setDisplay(bool display, bool cursor, bool blink) {
+        return command(LCD_CMD_DISPLAY_CONTROL | (display ? LCD_DISPLAY_ON : 0) |
+                (cursor ? LCD_CURSOR_ON : 0) | (blink ? LCD_CURSOR_BLINK_ON : 0), 0);
+    }
+
+    bool setBacklight(bool on) {
+        uint8_t val = on ? PinMap::bl : 0;
+
+        bl_ = on;
+        return ex_.send(&val, 1);
+    }
+
+    bool updatePattern(uint8_t pos, const uint8_t *pat) {
+        uint8_t idx;
+
+        put(false, LCD_CMD_SET_CGRAM_ADDR | ((pos & 0x07) << 3));
+        for (idx = 0; idx < 8; idx++) {
+            put(true, pat[idx]);
+        }
+
+        return flush();
+    }
+
+    /* Text is cut at the end of the row */
+    uint8_t drawText(uint8_t row, uint8_t col, const char *text, uint8_t len) {
+        uint8_t idx;
+
+        if (row >= Geometry::rows || col >= Geometry::cols) {
+            return 0;
+        }
+
+        put(false, LCD_CMD_SET_DDRAM_ADDR | Geometry::address(row, col));
+        for (idx = 0; idx < len && col + idx < Geometry::cols; idx++) {
+            put(true, (uint8_t)text[idx]);
+        }
+
+        return flush() ? idx : 0;
+    }
+
+    /* Fill width cells from DDRAM address addr, padding text with spaces */
+    bool writeAt(uint8_t addr, uint8_t width, const char *text, uint8_t len) {
+        uint8_t idx;
+
+        put(false, LCD_CMD_SET_DDRAM_ADDR | (addr & LCD_DDRAM_ADDR_MASK));
+        for (idx = 0; idx < width; idx++) {
+            put(true, idx < len ? (uint8_t)text[idx] : ' ');
+        }
+
+        return flush();
+    }
+
+    /* Send a frame built with textFrame() */
+    template <size_t N>
+    bool send(const Frame<N> &f) {
+        return ex_.send(f.data, f.size);
+    }
+
+private:
+    /* 8-bit mode instruction, a single nibble */
+    bool nibble(uint8_t cmd) {
+        Enc::nibble(frame_, bl_ ? PinMap::bl : 0, cmd >> 4);
+        return flush();
+    }
+
+    bool command(uint8_t cmd, uint32_t ms) {
+        bool ret;
+
+        Enc::instruction(frame_, bl_, cmd);
+        ret = flush();
+        if (ms != 0) {
+            Timing::delayMs(ms);
+        }
+
+        return ret;
+    }
+
+    /* A failed intermediate frame is latched and reported by the next flush() */
+    void put(bool data, uint8_t val) {
+        if (frame_.full(6) && !flush()) {
+            failed_ = true;
+        }
+
+        if (data) {
+            Enc::data(frame_, bl_, val);
+        } else {
+            Enc::instruction(frame_, bl_, val);
+        }
+    }
+
+    bool flush() {
+        bool ret = ex_.send(frame_.data, frame_.size) && !failed_;
+
+        frame_.size = 0;
+        failed_ = false;
+        Timing::delayUs(37);
+
+        return ret;
+    }
+
+    Expander &ex_;
+    bool bl_;
+    bool failed_;
+    Frame<LCDIIC_FRAME_SIZE> frame_;
+};
+
+} /* namespace lcdiic */
+
+#endif /* __LCDIIC_HPP__ */
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LCDIIC_LAYOUT_HPP__
+#define __LCDIIC_LAYOUT_HPP__
+
+/*
+ * Fixed screen layouts: static labels plus dynamic fields, resolved by the
+ * compiler into the frame painting the whole screen and the DDRAM address
+ * and width of every field:
+ *
+ *   static constexpr lcdiic::Label labels[] = { { 0, 0, "Tick:" }, { 1, 0, "ID:" } };
+ *   static constexpr lcdiic::Field fields[] = { { 0, 6, 10 }, { 1, 4, 12 } };
+ *   static constexpr auto screen =
+ *       lcdiic::layout<lcdiic::Geometry1602, lcdiic::PinMapPcf8574T>(labels, fields);
+ *
+ *   lcd.send(screen.paint);
+ *   lcdiic::drawField(lcd, screen, 0, buf, len);
+ *
+ * A label or a field off the screen, or overlapping another one, fails to
+ * compile.
+ */
+
+#include "lcdiic.hpp"
+
+namespace lcdiic {
+
+struct Label {
+    uint8_t row;
+    uint8_t col;
+    const char *text;
+};
+
+struct Field {
+    uint8_t row;
+    uint8_t col;
+    uint8_t width;
+};
+
+/* Where a field goes on the controller */
+struct FieldInfo {
+    uint8_t addr;
+    uint8_t width;
+};
+
+template <typename Geometry, typename PinMap, size_t NF>
+struct Screen {
+    /* Every cell of every row, labels in place and fields blank */
+    Frame<Geometry::rows * 6 * (Geometry::cols + 1)> paint;
+    FieldInfo fields[NF];
+
+    constexpr Screen() : paint(), fields() {}
+};
+
+/* Not constexpr: reaching it during constant evaluation stops the build */
+void layoutError(const char *msg);
+
+/* Mark len cells from row, col as taken by id, overlaps are errors */
+template <typename Geometry>
+constexpr void layoutClaim(uint8_t *owner, uint8_t row, uint8_t col, size_t len, uint8_t id) {
+    if (row >= Geometry::rows || col + len > Geometry::cols) {
+        layoutError("off the screen");
+    }
+
+    for (size_t idx = 0; idx < len; idx++) {
+        if (owner[row * Geometry::cols + col + idx] != 0) {
+            layoutError("overlap");
+        }
+        owner[row * Geometry::cols + col + idx] = id;
+    }
+}
+
+template <typename Geometry, typename PinMap, size_t NL, size_t NF>
+constexpr Screen<Geometry, PinMap, NF> layout(const Label (&labels)[NL],
+        const Field (&fields)[NF], bool bl = true) {
+    Screen<Geometry, PinMap, NF> s;
+    uint8_t owner[Geometry::rows * Geometry::cols] = {};
+    uint8_t cells[Geometry::rows * Geometry::cols] = {};
+
+    for (size_t idx = 0; idx < sizeof(cells); idx++) {
+        cells[idx] = ' ';
+    }
+
+    for (size_t idx = 0; idx < NL; idx++) {
+        const Label &l = labels[idx];
+        size_t len = 0;
+
+        while (l.text[len] != '\0') {
+            len++;
+        }
+
+        layoutClaim<Geometry>(owner, l.row, l.col, len, 1);
+        for (size_t pos = 0; pos < len; pos++) {
+            cells[l.row * Geometry::cols + l.col + pos] = (uint8_t)l.text[pos];
+        }
+    }
+
+    for (size_t idx = 0; idx < NF; idx++) {
+        const Field &f = fields[idx];
+
+        layoutClaim<Geometry>(owner, f.row, f.col, f.width, 2);
+        s.fields[idx].addr = Geometry::address(f.row, f.col);
+        s.fields[idx].width = f.width;
+    }
+
+    for (uint8_t row = 0; row < Geometry::rows; row++) {
+        Encoder<PinMap>::instruction(s.paint, bl, LCD_CMD_SET_DDRAM_ADDR | Geometry::address(row, 0));
+        for (uint8_t col = 0; col < Geometry::cols; col++) {
+            Encoder<PinMap>::data(s.paint, bl, cells[row * Geometry::cols + col]);
+        }
+    }
+
+    return s;
+}
+
+/* Only the field cells go out on the bus, text is padded to the field width */
+template <typename Lcd, typename Geometry, typename PinMap, size_t NF>
+bool drawField(Lcd &lcd, const Screen<Geometry, PinMap, NF> &s, size_t idx,
+        const char *text, uint8_t len) {
+    if (idx >= NF) {
+        return false;
+    }
+
+    return lcd.writeAt(s.fields[idx].addr, s.fields[idx].width, text, len);
+}
+
+} /* namespace lcdiic */
+
+#endif /* __LCDIIC_LAYOUT_HPP__ */
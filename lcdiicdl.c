@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+
+#include "hal.h"
+#include "lcdiicdl.h"
+
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/* Operands of the instruction at pc, false if the program is cut short */
+static bool lcdiicDlFetch(LCDIICDisplayList *dlp, uint8_t *ops, uint8_t n) {
+    const LCDIICProgram *prog = dlp->prog;
+
+    if (dlp->pc + n > prog->size) {
+        return false;
+    }
+
+    memcpy(ops, &prog->code[dlp->pc], n);
+    dlp->pc += n;
+
+    return true;
+}
+
+/* FNV-1a, 32 bits: two texts of a field are not mistaken for one another */
+static uint32_t lcdiicDlHash(const char *text) {
+    uint32_t sum = 0x811c9dc5;
+
+    while (*text != '\0') {
+        sum = (sum ^ (uint8_t)*text++) * 0x01000193;
+    }
+
+    return sum;
+}
+
+static void lcdiicDlText(LCDIICDisplayList *dlp, const char *text, uint8_t len) {
+    dlp->col += lcdiicDrawText(dlp->lcdp, dlp->row, dlp->col, text, len);
+}
+
+/* Run one instruction, false once the program is over */
+static bool lcdiicDlExec(LCDIICDisplayList *dlp, uint32_t *ms) {
+    const LCDIICProgram *prog = dlp->prog;
+    uint8_t op, ops[3];
+
+    if (!lcdiicDlFetch(dlp, &op, 1)) {
+        return false;
+    }
+
+    switch (op) {
+    case LCDIIC_DL_MOVE:
+        if (!lcdiicDlFetch(dlp, ops, 2)) return false;
+        dlp->row = ops[0];
+        dlp->col = ops[1];
+        break;
+
+    case LCDIIC_DL_TEXT:
+        if (!lcdiicDlFetch(dlp, ops, 1) || ops[0] >= prog->ntexts) return false;
+        lcdiicDlText(dlp, prog->texts[ops[0]], strlen(prog->texts[ops[0]]));
+        break;
+
+    case LCDIIC_DL_FIELD: {
+        char buf[LCD_DDRAM_LINE_LEN];
+        const char *text;
+        uint8_t idx;
+
+        if (!lcdiicDlFetch(dlp, ops, 2) || ops[1] > sizeof(buf)) return false;
+        text = dlp->field != NULL ? dlp->field(dlp->arg, ops[0]) : NULL;
+
+        for (idx = 0; idx < ops[1]; idx++) {
+            buf[idx] = (text != NULL && *text != '\0') ? *text++ : ' ';
+        }
+        lcdiicDlText(dlp, buf, ops[1]);
+        break;
+    }
+
+    case LCDIIC_DL_GLYPH:
+        if (!lcdiicDlFetch(dlp, ops, 2) || ops[1] >= prog->nglyphs) return false;
+        lcdiicUpdatePattern(dlp->lcdp, ops[0], prog->glyphs[ops[1]]);
+        break;
+
+    case LCDIIC_DL_SHIFT:
+        if (!lcdiicDlFetch(dlp, ops, 1)) return false;
+        lcdiicShiftContent(dlp->lcdp, ops[0] & LCDIIC_DL_SHIFT_DISPLAY,
+                ops[0] & LCDIIC_DL_SHIFT_RIGHT);
+        break;
+
+    case LCDIIC_DL_WAIT:
+        if (!lcdiicDlFetch(dlp, ops, 2)) return false;
+        *ms = ops[0] | (ops[1] << 8);
+        break;
+
+    case LCDIIC_DL_JCHG: {
+        const char *text;
+        uint32_t sum;
+
+        if (!lcdiicDlFetch(dlp, ops, 3) || ops[0] >= LCDIIC_DL_FIELDS) return false;
+        text = dlp->field != NULL ? dlp->field(dlp->arg, ops[0]) : NULL;
+        sum = lcdiicDlHash(text != NULL ? text : "");
+
+        if (!(dlp->seen[ops[0] / 8] & (1 << (ops[0] % 8))) || dlp->sums[ops[0]] != sum) {
+            dlp->seen[ops[0] / 8] |= 1 << (ops[0] % 8);
+            dlp->sums[ops[0]] = sum;
+            dlp->pc = ops[1] | (ops[2] << 8);
+        }
+        break;
+    }
+
+    case LCDIIC_DL_JMP:
+        if (!lcdiicDlFetch(dlp, ops, 2)) return false;
+        dlp->pc = ops[0] | (ops[1] << 8);
+        break;
+
+    case LCDIIC_DL_END:
+    default:
+        return false;
+    }
+
+    return true;
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+void lcdiicDlObjectInit(LCDIICDisplayList *dlp, LCDIICDriver *lcdp, const LCDIICProgram *prog,
+        lcdiicdl_field_t field, void *arg) {
+    dlp->lcdp = lcdp;
+    dlp->prog = prog;
+    dlp->field = field;
+    dlp->arg = arg;
+    dlp->pc = 0;
+    dlp->row = 0;
+    dlp->col = 0;
+    memset(dlp->seen, 0x00, sizeof(dlp->seen));
+}
+
+/*
+ * Run the program up to its next LCDIIC_DL_WAIT, whose time goes to *ms. All
+ * the writes of the step go out together when it ends. MSG_RESET once the
+ * program is over, or stopped on an invalid instruction or a step without
+ * LCDIIC_DL_WAIT.
+ */
+msg_t lcdiicDlStep(LCDIICDisplayList *dlp, uint32_t *ms) {
+    uint16_t budget = LCDIIC_DL_STEP_BUDGET;
+    bool running = true;
+
+    chDbgCheck((dlp != NULL) && (ms != NULL));
+
+    *ms = 0;
+
+    lcdiicBatchBegin(dlp->lcdp);
+    while (*ms == 0 && budget-- > 0 && (running = lcdiicDlExec(dlp, ms)))
+        ;
+    lcdiicBatchEnd(dlp->lcdp);
+
+    if (!running || *ms == 0) {
+        /* Later steps end right away */
+        dlp->pc = dlp->prog->size;
+        return MSG_RESET;
+    }
+
+    return MSG_OK;
+}
+
+/* Run the program until it is over */
+void lcdiicDlRun(LCDIICDisplayList *dlp) {
+    uint32_t ms;
+
+    while (lcdiicDlStep(dlp, &ms) == MSG_OK) {
+        chThdSleepMilliseconds(ms);
+    }
+}
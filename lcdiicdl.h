@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LCDIICDL_H__
+#define __LCDIICDL_H__
+
+#include "hal.h"
+#include "lcdiic.h"
+
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/*
+ * Display list opcodes, followed by their operands. Jump targets are byte
+ * offsets in the program, low byte first. A step runs up to the next WAIT and
+ * its writes are sent together.
+ */
+#define LCDIIC_DL_END               0x00 /* End of the program */
+#define LCDIIC_DL_MOVE              0x01 /* row, col */
+#define LCDIIC_DL_TEXT              0x02 /* text index: text from the program table */
+#define LCDIIC_DL_FIELD             0x03 /* field index, width: padded or cut to width */
+#define LCDIIC_DL_GLYPH             0x04 /* CGRAM position, glyph index */
+#define LCDIIC_DL_SHIFT             0x05 /* LCDIIC_DL_SHIFT_* flags */
+#define LCDIIC_DL_WAIT              0x06 /* ms low, ms high: ends the step */
+#define LCDIIC_DL_JCHG              0x07 /* field index, target: jump if the field changed */
+#define LCDIIC_DL_JMP               0x08 /* target */
+
+#define LCDIIC_DL_SHIFT_DISPLAY     0x01 /* Shift the display, else the cursor */
+#define LCDIIC_DL_SHIFT_RIGHT       0x02 /* Shift to the right */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Number of fields watched by LCDIIC_DL_JCHG.
+ */
+#if !defined(LCDIIC_DL_FIELDS) || defined(__DOXYGEN__)
+#define LCDIIC_DL_FIELDS            8
+#endif
+
+/**
+ * @brief   Instructions run per step at most.
+ * @details A program looping without LCDIIC_DL_WAIT is stopped.
+ */
+#if !defined(LCDIIC_DL_STEP_BUDGET) || defined(__DOXYGEN__)
+#define LCDIIC_DL_STEP_BUDGET       64
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if LCDIIC_DL_FIELDS < 1 || LCDIIC_DL_FIELDS > 256
+#error "LCDIIC_DL_FIELDS must be 1 to 256, the field operand is a byte"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/* A program and its tables, usually generated by tools/lcdiicasm */
+typedef struct {
+    const uint8_t *code;
+    uint16_t size;
+    const char * const *texts;
+    uint8_t ntexts;
+    const uint8_t (*glyphs)[8];
+    uint8_t nglyphs;
+} LCDIICProgram;
+
+/* Returns the current text of field idx, NUL terminated */
+typedef const char *(*lcdiicdl_field_t)(void *arg, uint8_t idx);
+
+typedef struct {
+    LCDIICDriver *lcdp;
+    const LCDIICProgram *prog;
+    lcdiicdl_field_t field;
+    void *arg;
+    uint16_t pc;
+    uint8_t row;
+    uint8_t col;
+    uint8_t seen[(LCDIIC_DL_FIELDS + 7) / 8]; /* Fields with a valid sum */
+    uint32_t sums[LCDIIC_DL_FIELDS];    /* Field hashes at the last LCDIIC_DL_JCHG */
+} LCDIICDisplayList;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lcdiicDlObjectInit(LCDIICDisplayList *dlp, LCDIICDriver *lcdp, const LCDIICProgram *prog,
+        lcdiicdl_field_t field, void *arg);
+msg_t lcdiicDlStep(LCDIICDisplayList *dlp, uint32_t *ms);
+void lcdiicDlRun(LCDIICDisplayList *dlp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCDIICDL_H__ */
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "hal.h"
+#include "lcdiicmock.h"
+
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static msg_t lcdiic_mock_write(void *ip, const uint8_t *val, uint8_t len) {
+    LCDIICMockPort *portp = (LCDIICMockPort *)ip;
+    uint8_t idx, byte;
+
+    if (portp->result != MSG_OK) {
+        return portp->result;
+    }
+
+    for (idx = 0; idx < len; idx++) {
+        byte = val[idx];
+        if (!portp->wide || (idx & 1) == 0) {
+            byte |= portp->mask;
+            portp->latch = byte;
+        }
+        if (portp->len < portp->size) {
+            portp->log[portp->len] = byte;
+        }
+        portp->len++;
+    }
+
+    return MSG_OK;
+}
+
+static msg_t lcdiic_mock_xfer(void *ip, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    LCDIICMockPort *portp = (LCDIICMockPort *)ip;
+    msg_t ret;
+    uint8_t idx;
+
+    ret = lcdiic_mock_write(ip, txval, txlen);
+    for (idx = 0; ret == MSG_OK && idx < rxlen; idx++) {
+        rxval[idx] = portp->read != NULL ? portp->read(portp->arg, portp->latch) : portp->latch;
+    }
+
+    return ret;
+}
+
+static msg_t lcdiic_mock_write_masked(void *ip, uint8_t bits, uint8_t val) {
+    LCDIICMockPort *portp = (LCDIICMockPort *)ip;
+    uint8_t word[2];
+
+    word[0] = (portp->latch & ~bits) | (val & bits);
+    word[1] = 0xff;
+
+    return lcdiic_mock_write(ip, word, portp->wide ? 2 : 1);
+}
+
+static uint8_t lcdiic_mock_latch(void *ip) {
+    return ((LCDIICMockPort *)ip)->latch;
+}
+
+/* Nothing to share, the log is the bus */
+static void lcdiic_mock_lease(void *ip) {
+    (void)ip;
+}
+
+static bool lcdiic_mock_busy(void *ip) {
+    (void)ip;
+    return false;
+}
+
+static msg_t lcdiic_mock_write_group(void * const *instances, uint8_t n, const uint8_t *val,
+        uint8_t len, msg_t *rets) {
+    msg_t ret = MSG_OK;
+    uint8_t idx;
+
+    for (idx = 0; idx < n; idx++) {
+        rets[idx] = lcdiic_mock_write(instances[idx], val, len);
+        if (rets[idx] != MSG_OK) {
+            ret = rets[idx];
+        }
+    }
+
+    return ret;
+}
+
+static void lcdiic_mock_acquire_group(void * const *instances, uint8_t n) {
+    (void)instances;
+    (void)n;
+}
+
+/* The write is done by the submission */
+static msg_t lcdiic_mock_submit(void *ip, const uint8_t *val, uint8_t len) {
+    return lcdiic_mock_write(ip, val, len);
+}
+
+static msg_t lcdiic_mock_wait(void *ip) {
+    (void)ip;
+    return MSG_OK;
+}
+
+static const struct LCDIICPortVMT vmt_mock = {
+    lcdiic_mock_write, lcdiic_mock_xfer,
+    lcdiic_mock_write_masked, lcdiic_mock_latch,
+    lcdiic_mock_lease, lcdiic_mock_lease, lcdiic_mock_lease, lcdiic_mock_busy,
+    lcdiic_mock_write_group, lcdiic_mock_acquire_group, lcdiic_mock_acquire_group,
+    lcdiic_mock_submit, lcdiic_mock_wait,
+};
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/* Without read, transfers sample the latch back */
+void lcdiicMockPortObjectInit(LCDIICMockPort *portp, uint8_t wide, uint8_t *log, size_t size,
+        lcdiic_mock_read_t read, void *arg) {
+    chDbgCheck((portp != NULL) && ((log != NULL) || (size == 0)));
+
+    portp->vmt = &vmt_mock;
+    portp->bus = NULL;
+    portp->mask = 0x00;
+    portp->wide = wide;
+    portp->log = log;
+    portp->size = size;
+    portp->len = 0;
+    portp->latch = 0x00;
+    portp->read = read;
+    portp->arg = arg;
+    portp->result = MSG_OK;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LCDIICMOCK_H__
+#define __LCDIICMOCK_H__
+
+#include "hal.h"
+#include "lcdiic.h"
+
+/*
+ * Port backend for host tests, it only needs lcdiic.h: the bytes written go
+ * to a log instead of an expander, see test/.
+ */
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/* Pins sampled by a mock port transfer, latch holds the last byte written */
+typedef uint8_t (*lcdiic_mock_read_t)(void *arg, uint8_t latch);
+
+/*
+ * The bytes written go to log, len counts them all, also past size. On a
+ * wide port the mask only goes into the control bytes, the even ones, and
+ * latch is the last control byte. Writes and transfers return result,
+ * MSG_OK unless set otherwise.
+ */
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_port_data
+    uint8_t *log;
+    size_t size;
+    size_t len;
+    uint8_t latch;
+    lcdiic_mock_read_t read;
+    void *arg;
+    msg_t result;
+} LCDIICMockPort;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lcdiicMockPortObjectInit(LCDIICMockPort *portp, uint8_t wide, uint8_t *log, size_t size,
+        lcdiic_mock_read_t read, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCDIICMOCK_H__ */
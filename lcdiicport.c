@@ -0,0 +1,665 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "hal.h"
+#include "lcdiicport.h"
+
+
+/**
+ * Reference manual:
+ * 1. Microchip: http://ww1.microchip.com/downloads/en/DeviceDoc/21919e.pdf
+ */
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/* MCP23008 registers */
+#define MCP23008_IODIR              0x00
+#define MCP23008_IOCON              0x05
+#define MCP23008_GPIO               0x09
+#define MCP23008_OLAT               0x0a
+
+/* IOCON: the address pointer stays on the register, writes repeat OLAT */
+#define MCP23008_IOCON_SEQOP        0x20
+
+/* IODIR after a reset, all pins inputs */
+#define MCP23008_IODIR_RESET        0xff
+
+/* MCP23017 registers with IOCON.BANK = 0, SEQOP toggles within the A/B pair */
+#define MCP23017_IODIRA             0x00
+#define MCP23017_IOCON              0x0a
+#define MCP23017_GPIOA              0x12
+#define MCP23017_OLATA              0x14
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/* D7..D4 are inputs while RW is high, so the LCD can drive them */
+static uint8_t lcdiicPortDirection(uint8_t val) {
+    return (val & LCDIIC_PORT_RW) ? LCDIIC_PORT_DATA : 0x00;
+}
+
+/*
+ * Copy the words of val into buf up to the next change of RW, at most
+ * LCDIIC_PORT_CHUNK bytes, with the mask ORed into the control bytes. A word
+ * is width bytes, the control byte first. Returns the bytes copied.
+ */
+static uint8_t lcdiicPortRun(const uint8_t *val, uint8_t len, uint8_t width, uint8_t mask,
+        uint8_t *buf) {
+    uint8_t n = 0;
+
+    while (n + width <= len && n + width <= LCDIIC_PORT_CHUNK &&
+            ((val[n] ^ val[0]) & LCDIIC_PORT_RW) == 0) {
+        buf[n] = val[n] | mask;
+        if (width == 2) {
+            buf[n + 1] = val[n + 1];
+        }
+        n += width;
+    }
+
+    return n;
+}
+
+/* Transports of n expander ports */
+static void lcdiicExpanderDrivers(void * const *instances, uint8_t n, PCF8574Driver **drvs) {
+    uint8_t idx;
+
+    chDbgCheck(n <= LCDIIC_PORT_GROUP_MAX);
+
+    for (idx = 0; idx < n; idx++) {
+        drvs[idx] = ((LCDIICPcf8574Port *)instances[idx])->drvp;
+    }
+}
+
+static void lcdiic_expander_lease(void *ip) {
+    pcf8574Lease(((LCDIICPcf8574Port *)ip)->drvp);
+}
+
+static void lcdiic_expander_release(void *ip) {
+    pcf8574Release(((LCDIICPcf8574Port *)ip)->drvp);
+}
+
+static void lcdiic_expander_idle(void *ip) {
+    pcf8574StopBus(((LCDIICPcf8574Port *)ip)->drvp);
+}
+
+static bool lcdiic_expander_busy(void *ip) {
+    return pcf8574BusBusy(((LCDIICPcf8574Port *)ip)->drvp);
+}
+
+static void lcdiic_expander_acquire_group(void * const *instances, uint8_t n) {
+    PCF8574Driver *drvs[LCDIIC_PORT_GROUP_MAX];
+
+    lcdiicExpanderDrivers(instances, n, drvs);
+    pcf8574AcquireBus(drvs, n);
+}
+
+static void lcdiic_expander_release_group(void * const *instances, uint8_t n) {
+    PCF8574Driver *drvs[LCDIIC_PORT_GROUP_MAX];
+
+    lcdiicExpanderDrivers(instances, n, drvs);
+    pcf8574ReleaseBus(drvs, n);
+}
+
+/* Ports with pins of their own: nothing to share */
+static void lcdiic_local_lease(void *ip) {
+    (void)ip;
+}
+
+static bool lcdiic_local_busy(void *ip) {
+    (void)ip;
+    return false;
+}
+
+static void lcdiic_local_acquire_group(void * const *instances, uint8_t n) {
+    (void)instances;
+    (void)n;
+}
+
+/* Backends without a queue: the write is done by the submission */
+static msg_t lcdiic_direct_submit(void *ip, const uint8_t *val, uint8_t len) {
+    return lcdiicPortWrite((LCDIICPort *)ip, val, len);
+}
+
+static msg_t lcdiic_direct_wait(void *ip) {
+    (void)ip;
+    return MSG_OK;
+}
+
+/* One write after the other, within the group acquisition if any */
+static msg_t lcdiic_each_write_group(void * const *instances, uint8_t n, const uint8_t *val,
+        uint8_t len, msg_t *rets) {
+    msg_t ret = MSG_OK;
+    uint8_t idx;
+
+    for (idx = 0; idx < n; idx++) {
+        LCDIICPort *portp = (LCDIICPort *)instances[idx];
+
+        rets[idx] = lcdiicPortWrite(portp, val, len);
+        if (rets[idx] != MSG_OK) {
+            ret = rets[idx];
+        }
+    }
+
+    return ret;
+}
+
+/*
+ * PCF8574 backend.
+ */
+
+/* lcdiic.c frames have the mask pins high already, they go out as they are */
+static msg_t lcdiic_pcf8574_write(void *ip, const uint8_t *val, uint8_t len) {
+    return pcf8574SetPort(((LCDIICPcf8574Port *)ip)->drvp, 1, val, len);
+}
+
+static msg_t lcdiic_pcf8574_xfer(void *ip, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    return pcf8574XferPort(((LCDIICPcf8574Port *)ip)->drvp, 1, txval, txlen, rxval, rxlen);
+}
+
+static msg_t lcdiic_pcf8574_write_masked(void *ip, uint8_t bits, uint8_t val) {
+    return pcf8574WriteMasked(((LCDIICPcf8574Port *)ip)->drvp, bits, val);
+}
+
+static uint8_t lcdiic_pcf8574_latch(void *ip) {
+#if PCF8574_USE_QUEUE
+    /* Up to date once the queued write is done */
+    (void)pcf8574WaitPort(((LCDIICPcf8574Port *)ip)->drvp);
+#endif
+    return pcf8574GetLatch(((LCDIICPcf8574Port *)ip)->drvp);
+}
+
+static msg_t lcdiic_pcf8574_write_group(void * const *instances, uint8_t n, const uint8_t *val,
+        uint8_t len, msg_t *rets) {
+    PCF8574Driver *drvs[LCDIIC_PORT_GROUP_MAX];
+
+    lcdiicExpanderDrivers(instances, n, drvs);
+    return pcf8574SetPortMulti(drvs, n, val, len, rets);
+}
+
+#if PCF8574_USE_QUEUE
+/* The worker ORs the mask in where a byte misses it */
+static msg_t lcdiic_pcf8574_submit(void *ip, const uint8_t *val, uint8_t len) {
+    pcf8574SubmitPort(((LCDIICPcf8574Port *)ip)->drvp, 1, val, len);
+
+    return MSG_OK;
+}
+
+static msg_t lcdiic_pcf8574_wait(void *ip) {
+    return pcf8574WaitPort(((LCDIICPcf8574Port *)ip)->drvp);
+}
+#else
+#define lcdiic_pcf8574_submit       lcdiic_direct_submit
+#define lcdiic_pcf8574_wait         lcdiic_direct_wait
+#endif
+
+static const struct LCDIICPortVMT vmt_pcf8574 = {
+    lcdiic_pcf8574_write, lcdiic_pcf8574_xfer,
+    lcdiic_pcf8574_write_masked, lcdiic_pcf8574_latch,
+    lcdiic_expander_lease, lcdiic_expander_release, lcdiic_expander_idle, lcdiic_expander_busy,
+    lcdiic_pcf8574_write_group, lcdiic_expander_acquire_group, lcdiic_expander_release_group,
+    lcdiic_pcf8574_submit, lcdiic_pcf8574_wait,
+};
+
+/*
+ * MCP23008 backend: IOCON and IODIR are set up on the first write, then
+ * every write goes to OLAT. D7..D4 turn into inputs before the bytes with RW
+ * high, and back into outputs before the others.
+ */
+
+static msg_t lcdiicMcp23008Register(LCDIICMcp23008Port *portp, uint8_t reg, uint8_t val) {
+    uint8_t buf[2] = { reg, val };
+
+    return pcf8574SetPort(portp->drvp, 0, buf, sizeof(buf));
+}
+
+static msg_t lcdiicMcp23008Direction(LCDIICMcp23008Port *portp, uint8_t iodir) {
+    msg_t ret = MSG_OK;
+
+    if (portp->iodir == MCP23008_IODIR_RESET) {
+        ret = lcdiicMcp23008Register(portp, MCP23008_IOCON, MCP23008_IOCON_SEQOP);
+    }
+    if (ret == MSG_OK && portp->iodir != iodir) {
+        ret = lcdiicMcp23008Register(portp, MCP23008_IODIR, iodir);
+    }
+    if (ret == MSG_OK) {
+        portp->iodir = iodir;
+    }
+
+    return ret;
+}
+
+/* The bus must be leased */
+static msg_t lcdiicMcp23008WriteLeased(LCDIICMcp23008Port *portp, const uint8_t *val, uint8_t len) {
+    uint8_t buf[1 + LCDIIC_PORT_CHUNK];
+    msg_t ret = MSG_OK;
+
+    buf[0] = MCP23008_OLAT;
+
+    while (ret == MSG_OK && len > 0) {
+        uint8_t n = lcdiicPortRun(val, len, 1, portp->mask, &buf[1]);
+
+        ret = lcdiicMcp23008Direction(portp, lcdiicPortDirection(val[0]));
+        if (ret == MSG_OK) {
+            ret = pcf8574SetPort(portp->drvp, 0, buf, 1 + n);
+        }
+        if (ret == MSG_OK) {
+            portp->latch = buf[n];
+        }
+        val += n;
+        len -= n;
+    }
+
+    if (ret != MSG_OK) {
+        /* The expander may have been reset */
+        portp->iodir = MCP23008_IODIR_RESET;
+    }
+
+    return ret;
+}
+
+static msg_t lcdiic_mcp23008_write(void *ip, const uint8_t *val, uint8_t len) {
+    LCDIICMcp23008Port *portp = (LCDIICMcp23008Port *)ip;
+    msg_t ret;
+
+    pcf8574Lease(portp->drvp);
+    ret = lcdiicMcp23008WriteLeased(portp, val, len);
+    pcf8574Release(portp->drvp);
+
+    return ret;
+}
+
+static msg_t lcdiic_mcp23008_xfer(void *ip, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    LCDIICMcp23008Port *portp = (LCDIICMcp23008Port *)ip;
+    static const uint8_t reg = MCP23008_GPIO;
+    msg_t ret;
+
+    pcf8574Lease(portp->drvp);
+    ret = lcdiicMcp23008WriteLeased(portp, txval, txlen);
+    if (ret == MSG_OK) {
+        /* With SEQOP every byte read samples GPIO again */
+        ret = pcf8574XferPort(portp->drvp, 0, &reg, 1, rxval, rxlen);
+    }
+    pcf8574Release(portp->drvp);
+
+    return ret;
+}
+
+static msg_t lcdiic_mcp23008_write_masked(void *ip, uint8_t bits, uint8_t val) {
+    LCDIICMcp23008Port *portp = (LCDIICMcp23008Port *)ip;
+    uint8_t latch = (portp->latch & ~bits) | (val & bits) | portp->mask;
+
+    if (latch == portp->latch && portp->iodir != MCP23008_IODIR_RESET) {
+        return MSG_OK;
+    }
+
+    return lcdiic_mcp23008_write(ip, &latch, 1);
+}
+
+static uint8_t lcdiic_mcp23008_latch(void *ip) {
+    return ((LCDIICMcp23008Port *)ip)->latch;
+}
+
+static msg_t lcdiic_mcp23008_write_group(void * const *instances, uint8_t n, const uint8_t *val,
+        uint8_t len, msg_t *rets) {
+    msg_t ret;
+
+    lcdiic_expander_acquire_group(instances, n);
+    ret = lcdiic_each_write_group(instances, n, val, len, rets);
+    lcdiic_expander_release_group(instances, n);
+
+    return ret;
+}
+
+static const struct LCDIICPortVMT vmt_mcp23008 = {
+    lcdiic_mcp23008_write, lcdiic_mcp23008_xfer,
+    lcdiic_mcp23008_write_masked, lcdiic_mcp23008_latch,
+    lcdiic_expander_lease, lcdiic_expander_release, lcdiic_expander_idle, lcdiic_expander_busy,
+    lcdiic_mcp23008_write_group, lcdiic_expander_acquire_group, lcdiic_expander_release_group,
+    lcdiic_direct_submit, lcdiic_direct_wait,
+};
+
+/*
+ * 16-bit expanders, P0 to P7 in the lcdiic_port_cfg order and D0..D7 on P10
+ * to P17, or GPA and GPB on the MCP23017. A word is two bytes, the control
+ * byte first.
+ */
+
+static msg_t lcdiic_wide_write_masked(void *ip, uint8_t bits, uint8_t val) {
+    LCDIICPcf8575Port *portp = (LCDIICPcf8575Port *)ip;
+    uint8_t word[2];
+
+    word[0] = (portp->latch[0] & ~bits) | (val & bits);
+    word[1] = portp->latch[1];
+
+    return lcdiicPortWrite((LCDIICPort *)ip, word, sizeof(word));
+}
+
+static uint8_t lcdiic_wide_latch(void *ip) {
+    return ((LCDIICPcf8575Port *)ip)->latch[0];
+}
+
+/*
+ * PCF8575 backend: quasi-bidirectional like the PCF8574, D7..D0 are written
+ * high to be read.
+ */
+
+static msg_t lcdiic_pcf8575_write(void *ip, const uint8_t *val, uint8_t len) {
+    LCDIICPcf8575Port *portp = (LCDIICPcf8575Port *)ip;
+    uint8_t buf[LCDIIC_PORT_CHUNK];
+    msg_t ret = MSG_OK;
+
+    chDbgCheck((len & 1) == 0);
+
+    pcf8574Lease(portp->drvp);
+    while (ret == MSG_OK && len > 0) {
+        uint8_t n = lcdiicPortRun(val, len, 2, portp->mask, buf);
+
+        ret = pcf8574SetPort(portp->drvp, 0, buf, n);
+        if (ret == MSG_OK) {
+            portp->latch[0] = buf[n - 2];
+            portp->latch[1] = buf[n - 1];
+        }
+        val += n;
+        len -= n;
+    }
+    pcf8574Release(portp->drvp);
+
+    return ret;
+}
+
+static msg_t lcdiic_pcf8575_xfer(void *ip, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    LCDIICPcf8575Port *portp = (LCDIICPcf8575Port *)ip;
+    msg_t ret;
+
+    pcf8574Lease(portp->drvp);
+    ret = lcdiic_pcf8575_write(ip, txval, txlen);
+    if (ret == MSG_OK) {
+        ret = pcf8574GetPort(portp->drvp, rxval, rxlen);
+    }
+    pcf8574Release(portp->drvp);
+
+    return ret;
+}
+
+static const struct LCDIICPortVMT vmt_pcf8575 = {
+    lcdiic_pcf8575_write, lcdiic_pcf8575_xfer,
+    lcdiic_wide_write_masked, lcdiic_wide_latch,
+    lcdiic_expander_lease, lcdiic_expander_release, lcdiic_expander_idle, lcdiic_expander_busy,
+    lcdiic_each_write_group, lcdiic_expander_acquire_group, lcdiic_expander_release_group,
+    lcdiic_direct_submit, lcdiic_direct_wait,
+};
+
+/*
+ * MCP23017 backend: like the MCP23008, with GPB as D7..D0. SEQOP makes the
+ * writes to OLATA alternate between OLATA and OLATB.
+ */
+
+static msg_t lcdiicMcp23017Direction(LCDIICMcp23017Port *portp, uint8_t iodir) {
+    uint8_t buf[3] = { MCP23017_IODIRA, 0x00, iodir };
+    msg_t ret = MSG_OK;
+
+    if (!portp->ready) {
+        uint8_t iocon[2] = { MCP23017_IOCON, MCP23008_IOCON_SEQOP };
+
+        ret = pcf8574SetPort(portp->drvp, 0, iocon, sizeof(iocon));
+    }
+    if (ret == MSG_OK && (!portp->ready || portp->iodir != iodir)) {
+        ret = pcf8574SetPort(portp->drvp, 0, buf, sizeof(buf));
+    }
+    if (ret == MSG_OK) {
+        portp->iodir = iodir;
+        portp->ready = 1;
+    }
+
+    return ret;
+}
+
+/* The bus must be leased */
+static msg_t lcdiicMcp23017WriteLeased(LCDIICMcp23017Port *portp, const uint8_t *val, uint8_t len) {
+    uint8_t buf[1 + LCDIIC_PORT_CHUNK];
+    msg_t ret = MSG_OK;
+
+    chDbgCheck((len & 1) == 0);
+
+    buf[0] = MCP23017_OLATA;
+
+    while (ret == MSG_OK && len > 0) {
+        uint8_t n = lcdiicPortRun(val, len, 2, portp->mask, &buf[1]);
+
+        ret = lcdiicMcp23017Direction(portp, (val[0] & LCDIIC_PORT_RW) ? 0xff : 0x00);
+        if (ret == MSG_OK) {
+            ret = pcf8574SetPort(portp->drvp, 0, buf, 1 + n);
+        }
+        if (ret == MSG_OK) {
+            portp->latch[0] = buf[n - 1];
+            portp->latch[1] = buf[n];
+        }
+        val += n;
+        len -= n;
+    }
+
+    if (ret != MSG_OK) {
+        /* The expander may have been reset */
+        portp->ready = 0;
+    }
+
+    return ret;
+}
+
+static msg_t lcdiic_mcp23017_write(void *ip, const uint8_t *val, uint8_t len) {
+    LCDIICMcp23017Port *portp = (LCDIICMcp23017Port *)ip;
+    msg_t ret;
+
+    pcf8574Lease(portp->drvp);
+    ret = lcdiicMcp23017WriteLeased(portp, val, len);
+    pcf8574Release(portp->drvp);
+
+    return ret;
+}
+
+static msg_t lcdiic_mcp23017_xfer(void *ip, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    LCDIICMcp23017Port *portp = (LCDIICMcp23017Port *)ip;
+    static const uint8_t reg = MCP23017_GPIOA;
+    msg_t ret;
+
+    pcf8574Lease(portp->drvp);
+    ret = lcdiicMcp23017WriteLeased(portp, txval, txlen);
+    if (ret == MSG_OK) {
+        ret = pcf8574XferPort(portp->drvp, 0, &reg, 1, rxval, rxlen);
+    }
+    pcf8574Release(portp->drvp);
+
+    return ret;
+}
+
+static msg_t lcdiic_mcp23017_write_group(void * const *instances, uint8_t n, const uint8_t *val,
+        uint8_t len, msg_t *rets) {
+    msg_t ret;
+
+    lcdiic_expander_acquire_group(instances, n);
+    ret = lcdiic_each_write_group(instances, n, val, len, rets);
+    lcdiic_expander_release_group(instances, n);
+
+    return ret;
+}
+
+static const struct LCDIICPortVMT vmt_mcp23017 = {
+    lcdiic_mcp23017_write, lcdiic_mcp23017_xfer,
+    lcdiic_wide_write_masked, lcdiic_wide_latch,
+    lcdiic_expander_lease, lcdiic_expander_release, lcdiic_expander_idle, lcdiic_expander_busy,
+    lcdiic_mcp23017_write_group, lcdiic_expander_acquire_group, lcdiic_expander_release_group,
+    lcdiic_direct_submit, lcdiic_direct_wait,
+};
+
+/*
+ * GPIO backend: a write takes a few cycles instead of an I2C byte, each one
+ * is held for the 1 us enable cycle of the controller. No bus time hides the
+ * execution time either: every EN falling edge of a write is followed by
+ * LCDIIC_GPIO_EXEC_US, the port does not know whether it ends a nibble or a
+ * whole instruction.
+ */
+
+/* At least us microseconds, one loop takes 4 cycles or more */
+static void lcdiicGpioDelay(uint32_t us) {
+    volatile uint32_t cnt = STM32_SYSCLK / 4000000 * us;
+
+    while (cnt--)
+        ;
+}
+
+static msg_t lcdiic_gpio_write(void *ip, const uint8_t *val, uint8_t len) {
+    LCDIICGpioPort *portp = (LCDIICGpioPort *)ip;
+    uint8_t idx;
+
+    for (idx = 0; idx < len; idx++) {
+        uint8_t latch = val[idx] | portp->mask;
+        uint8_t input = lcdiicPortDirection(latch) != 0x00;
+
+        /* Released before RW goes high, driven once it is low again */
+        if (input && !portp->input) {
+            palSetGroupMode(portp->gpio, LCDIIC_PORT_DATA, portp->offset, PAL_MODE_INPUT);
+        }
+        palWriteGroup(portp->gpio, 0xff, portp->offset, latch);
+        if (!input && portp->input) {
+            palSetGroupMode(portp->gpio, LCDIIC_PORT_DATA, portp->offset, PAL_MODE_OUTPUT_PUSHPULL);
+        }
+
+        lcdiicGpioDelay(1);
+        if ((portp->latch & LCDIIC_PORT_EN) && !(latch & (LCDIIC_PORT_EN | LCDIIC_PORT_RW))) {
+            lcdiicGpioDelay(LCDIIC_GPIO_EXEC_US);
+        }
+
+        portp->input = input;
+        portp->latch = latch;
+    }
+
+    return MSG_OK;
+}
+
+static msg_t lcdiic_gpio_xfer(void *ip, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    LCDIICGpioPort *portp = (LCDIICGpioPort *)ip;
+    uint8_t idx;
+
+    lcdiic_gpio_write(ip, txval, txlen);
+    for (idx = 0; idx < rxlen; idx++) {
+        rxval[idx] = palReadGroup(portp->gpio, 0xff, portp->offset);
+    }
+
+    return MSG_OK;
+}
+
+static msg_t lcdiic_gpio_write_masked(void *ip, uint8_t bits, uint8_t val) {
+    LCDIICGpioPort *portp = (LCDIICGpioPort *)ip;
+    uint8_t latch = (portp->latch & ~bits) | (val & bits);
+
+    return lcdiic_gpio_write(ip, &latch, 1);
+}
+
+static uint8_t lcdiic_gpio_latch(void *ip) {
+    return ((LCDIICGpioPort *)ip)->latch;
+}
+
+static const struct LCDIICPortVMT vmt_gpio = {
+    lcdiic_gpio_write, lcdiic_gpio_xfer,
+    lcdiic_gpio_write_masked, lcdiic_gpio_latch,
+    lcdiic_local_lease, lcdiic_local_lease, lcdiic_local_lease, lcdiic_local_busy,
+    lcdiic_each_write_group, lcdiic_local_acquire_group, lcdiic_local_acquire_group,
+    lcdiic_direct_submit, lcdiic_direct_wait,
+};
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/* drvp is started with config by the application */
+void lcdiicPcf8574PortObjectInit(LCDIICPcf8574Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config) {
+    chDbgCheck((portp != NULL) && (drvp != NULL) && (config != NULL));
+
+    portp->vmt = &vmt_pcf8574;
+    portp->bus = config->i2cp;
+    portp->mask = config->mask;
+    portp->wide = 0;
+    portp->drvp = drvp;
+}
+
+/* drvp is started with config, whose sad is the MCP23008 address */
+void lcdiicMcp23008PortObjectInit(LCDIICMcp23008Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config, uint8_t mask) {
+    chDbgCheck((portp != NULL) && (drvp != NULL) && (config != NULL));
+
+    portp->vmt = &vmt_mcp23008;
+    portp->bus = config->i2cp;
+    portp->mask = mask;
+    portp->wide = 0;
+    portp->drvp = drvp;
+    portp->latch = 0x00;
+    portp->iodir = MCP23008_IODIR_RESET;
+}
+
+/* drvp is started with config, whose sad is the PCF8575 address */
+void lcdiicPcf8575PortObjectInit(LCDIICPcf8575Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config, uint8_t mask) {
+    chDbgCheck((portp != NULL) && (drvp != NULL) && (config != NULL));
+
+    portp->vmt = &vmt_pcf8575;
+    portp->bus = config->i2cp;
+    portp->mask = mask;
+    portp->wide = 1;
+    portp->drvp = drvp;
+    portp->latch[0] = 0xff;
+    portp->latch[1] = 0xff;
+}
+
+/* drvp is started with config, whose sad is the MCP23017 address */
+void lcdiicMcp23017PortObjectInit(LCDIICMcp23017Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config, uint8_t mask) {
+    chDbgCheck((portp != NULL) && (drvp != NULL) && (config != NULL));
+
+    portp->vmt = &vmt_mcp23017;
+    portp->bus = config->i2cp;
+    portp->mask = mask;
+    portp->wide = 1;
+    portp->drvp = drvp;
+    portp->latch[0] = 0x00;
+    portp->latch[1] = 0x00;
+    portp->iodir = 0xff;
+    portp->ready = 0;
+}
+
+/* Configures the pins as outputs, with the mask pins high */
+void lcdiicGpioPortObjectInit(LCDIICGpioPort *portp, ioportid_t gpio, uint8_t offset, uint8_t mask) {
+    chDbgCheck(portp != NULL);
+
+    portp->vmt = &vmt_gpio;
+    portp->bus = NULL;
+    portp->mask = mask;
+    portp->wide = 0;
+    portp->gpio = gpio;
+    portp->offset = offset;
+    portp->latch = mask;
+    portp->input = 0;
+
+    palWriteGroup(gpio, 0xff, offset, mask);
+    palSetGroupMode(gpio, 0xff, offset, PAL_MODE_OUTPUT_PUSHPULL);
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LCDIICPORT_H__
+#define __LCDIICPORT_H__
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Bytes per MCP230xx or PCF8575 transaction, the register address
+ *          aside.
+ */
+#if !defined(LCDIIC_PORT_CHUNK) || defined(__DOXYGEN__)
+#define LCDIIC_PORT_CHUNK           16
+#endif
+
+/**
+ * @brief   Wait in us after each write the GPIO backend clocks in.
+ * @details The instruction time of the HD44780 at 270 kHz, the I2C backends
+ *          take longer than that per byte.
+ */
+#if !defined(LCDIIC_GPIO_EXEC_US) || defined(__DOXYGEN__)
+#define LCDIIC_GPIO_EXEC_US         37
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/* Largest group: a mirror or the two members of a span */
+#if LCDIIC_USE_MIRROR && (LCDIIC_MIRROR_MAX > 2)
+#define LCDIIC_PORT_GROUP_MAX       LCDIIC_MIRROR_MAX
+#else
+#define LCDIIC_PORT_GROUP_MAX       2
+#endif
+
+#if LCDIIC_PORT_CHUNK < 2 || LCDIIC_PORT_CHUNK > 255 || (LCDIIC_PORT_CHUNK & 1)
+#error "LCDIIC_PORT_CHUNK must be even, 2 to 254"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/* Ports behind an I2C expander, drvp is the I2C transport */
+#define _lcdiic_expander_port_data \
+    _lcdiic_port_data \
+    PCF8574Driver *drvp;
+
+/* Pins of the PCF8574, in the lcdiic_port_cfg order */
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_expander_port_data
+} LCDIICPcf8574Port;
+
+/*
+ * MCP23008 wired like the PCF8574 backpack, GP0 to GP7 in the lcdiic_port_cfg
+ * order. drvp only carries the register writes, its mask is unused.
+ * - latch: OLAT as last written
+ * - iodir: IODIR as last written, 0xff after a reset or a failure, which
+ *   also sets IOCON up again
+ */
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_expander_port_data
+    uint8_t latch;
+    uint8_t iodir;
+} LCDIICMcp23008Port;
+
+/* 16-bit expanders, latch: the control and data bytes as last written */
+#define _lcdiic_wide_port_data \
+    _lcdiic_expander_port_data \
+    uint8_t latch[2];
+
+/*
+ * PCF8575 with P0 to P7 in the lcdiic_port_cfg order and D0..D7 on P10 to
+ * P17, the HD44780 on its 8-bit interface.
+ */
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_wide_port_data
+} LCDIICPcf8575Port;
+
+/*
+ * MCP23017 with GPA0 to GPA7 in the lcdiic_port_cfg order and D0..D7 on GPB0
+ * to GPB7, the HD44780 on its 8-bit interface. drvp only carries the register
+ * writes, its mask is unused.
+ * - iodir: IODIRB as last written
+ * - ready: IOCON and IODIRA set up, cleared by a failure
+ */
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_wide_port_data
+    uint8_t iodir;
+    uint8_t ready;
+} LCDIICMcp23017Port;
+
+/*
+ * Eight consecutive pins of one GPIO port from offset, in the lcdiic_port_cfg
+ * order, driven with palWriteGroup().
+ * - input: D7..D4 are inputs, while RW is high
+ */
+typedef struct {
+    const struct LCDIICPortVMT *vmt;
+    _lcdiic_port_data
+    ioportid_t gpio;
+    uint8_t offset;
+    uint8_t latch;
+    uint8_t input;
+} LCDIICGpioPort;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lcdiicPcf8574PortObjectInit(LCDIICPcf8574Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config);
+void lcdiicMcp23008PortObjectInit(LCDIICMcp23008Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config, uint8_t mask);
+void lcdiicPcf8575PortObjectInit(LCDIICPcf8575Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config, uint8_t mask);
+void lcdiicMcp23017PortObjectInit(LCDIICMcp23017Port *portp, PCF8574Driver *drvp,
+        const PCF8574Config *config, uint8_t mask);
+void lcdiicGpioPortObjectInit(LCDIICGpioPort *portp, ioportid_t gpio, uint8_t offset, uint8_t mask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCDIICPORT_H__ */
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+
+#include "hal.h"
+#include "lcdiicterm.h"
+
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/* Parser states */
+#define TERM_GROUND                 0
+#define TERM_ESC                    1
+#define TERM_CSI                    2
+
+/* Shown for what the character ROM lacks */
+#define TERM_UNKNOWN                '?'
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/* Code points found in the A00 character ROM, outside of ASCII */
+static const struct {
+    uint16_t cp;
+    uint8_t ch;
+} lcdiicterm_rom[] = {
+    { 0x00a5, 0x5c }, /* ¥ */
+    { 0x00b0, 0xdf }, /* ° */
+    { 0x00b5, 0xe4 }, /* µ */
+    { 0x00e4, 0xe1 }, /* ä */
+    { 0x00f1, 0xee }, /* ñ */
+    { 0x00f6, 0xef }, /* ö */
+    { 0x00f7, 0xfd }, /* ÷ */
+    { 0x00fc, 0xf5 }, /* ü */
+    { 0x03a3, 0xf6 }, /* Σ */
+    { 0x03a9, 0xf4 }, /* Ω */
+    { 0x03b1, 0xe0 }, /* α */
+    { 0x03b2, 0xe2 }, /* β */
+    { 0x03b5, 0xe3 }, /* ε */
+    { 0x03b8, 0xf2 }, /* θ */
+    { 0x03c0, 0xf7 }, /* π */
+    { 0x03c1, 0xe6 }, /* ρ */
+    { 0x03c3, 0xe5 }, /* σ */
+    { 0x2190, 0x7f }, /* ← */
+    { 0x2192, 0x7e }, /* → */
+    { 0x221a, 0xe8 }, /* √ */
+    { 0x221e, 0xf3 }, /* ∞ */
+    { 0x2588, 0xff }, /* █ */
+};
+
+static thread_t *lcdiicterm_thread;
+static THD_WORKING_AREA(waLcdiicTerm, LCDIIC_TERM_WA_SIZE);
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/* Ring line shown on screen row, back lines up from the bottom */
+static char *lcdiicTermLine(LCDIICTerm *tp, uint8_t row, uint8_t back) {
+    uint16_t idx = tp->last + 2 * LCDIIC_TERM_LINES - back - (LCDIIC_TERM_ROWS - 1) + row;
+
+    return tp->lines[idx % LCDIIC_TERM_LINES];
+}
+
+static void lcdiicTermErase(LCDIICTerm *tp, uint8_t row, uint8_t from, uint8_t to) {
+    memset(lcdiicTermLine(tp, row, 0) + from, ' ', to - from);
+    tp->changed = 1;
+}
+
+static void lcdiicTermLineFeed(LCDIICTerm *tp) {
+    if (tp->row < LCDIIC_TERM_ROWS - 1) {
+        tp->row++;
+        return;
+    }
+
+    /* Scroll: the oldest line becomes the new bottom row */
+    tp->last = (tp->last + 1) % LCDIIC_TERM_LINES;
+    memset(tp->lines[tp->last], ' ', LCDIIC_TERM_COLS);
+    if (tp->filled < LCDIIC_TERM_LINES) {
+        tp->filled++;
+    }
+
+    /* A view scrolled back stays on the same lines while there are some */
+    if (tp->back > 0 && tp->back < tp->filled - LCDIIC_TERM_ROWS) {
+        tp->back++;
+    }
+    tp->changed = 1;
+}
+
+static void lcdiicTermPut(LCDIICTerm *tp, uint8_t ch) {
+    if (tp->wrap) {
+        tp->col = 0;
+        tp->wrap = 0;
+        lcdiicTermLineFeed(tp);
+    }
+
+    lcdiicTermLine(tp, tp->row, 0)[tp->col] = ch;
+    if (tp->col == LCDIIC_TERM_COLS - 1) {
+        tp->wrap = 1;
+    } else {
+        tp->col++;
+    }
+    tp->changed = 1;
+}
+
+/*
+ * ASCII goes through as is, the ROM shows '\' as a yen sign and '~' as an
+ * arrow. U+E000 to U+E007 select the CGRAM patterns.
+ */
+static uint8_t lcdiicTermMap(uint32_t cp) {
+    uint8_t idx;
+
+    if (cp < 0x80) {
+        return cp;
+    }
+    if (cp >= 0xe000 && cp <= 0xe007) {
+        return cp - 0xe000;
+    }
+
+    for (idx = 0; idx < sizeof(lcdiicterm_rom) / sizeof(lcdiicterm_rom[0]); idx++) {
+        if (lcdiicterm_rom[idx].cp == cp) {
+            return lcdiicterm_rom[idx].ch;
+        }
+    }
+
+    return TERM_UNKNOWN;
+}
+
+static uint8_t lcdiicTermMin(uint8_t a, uint8_t b) {
+    return a < b ? a : b;
+}
+
+/* CSI sequence ended by final, missing or zero counts mean 1 */
+static void lcdiicTermCsi(LCDIICTerm *tp, uint8_t final) {
+    uint8_t n = tp->params[0] ? tp->params[0] : 1;
+    uint8_t row;
+
+    switch (final) {
+    case 'A':
+        tp->row = tp->row > n ? tp->row - n : 0;
+        break;
+
+    case 'B':
+        tp->row = lcdiicTermMin(tp->row + n, LCDIIC_TERM_ROWS - 1);
+        break;
+
+    case 'C':
+        tp->col = lcdiicTermMin(tp->col + n, LCDIIC_TERM_COLS - 1);
+        break;
+
+    case 'D':
+        tp->col = tp->col > n ? tp->col - n : 0;
+        break;
+
+    case 'H':
+    case 'f':
+        tp->row = lcdiicTermMin(n - 1, LCDIIC_TERM_ROWS - 1);
+        tp->col = lcdiicTermMin((tp->params[1] ? tp->params[1] : 1) - 1, LCDIIC_TERM_COLS - 1);
+        break;
+
+    case 'K':
+        if (tp->params[0] == 0) {
+            lcdiicTermErase(tp, tp->row, tp->col, LCDIIC_TERM_COLS);
+        } else if (tp->params[0] == 1) {
+            lcdiicTermErase(tp, tp->row, 0, tp->col + 1);
+        } else {
+            lcdiicTermErase(tp, tp->row, 0, LCDIIC_TERM_COLS);
+        }
+        return;
+
+    case 'J':
+        for (row = 0; row < LCDIIC_TERM_ROWS; row++) {
+            if (tp->params[0] == 2 ||
+                    (tp->params[0] == 0 && row > tp->row) ||
+                    (tp->params[0] == 1 && row < tp->row)) {
+                lcdiicTermErase(tp, row, 0, LCDIIC_TERM_COLS);
+            }
+        }
+        if (tp->params[0] == 0) {
+            lcdiicTermErase(tp, tp->row, tp->col, LCDIIC_TERM_COLS);
+        } else if (tp->params[0] == 1) {
+            lcdiicTermErase(tp, tp->row, 0, tp->col + 1);
+        }
+        return;
+
+    default:
+        /* Attributes (m) and the rest have no meaning here */
+        return;
+    }
+
+    tp->wrap = 0;
+}
+
+static void lcdiicTermControl(LCDIICTerm *tp, uint8_t ch) {
+    switch (ch) {
+    case '\r':
+        tp->col = 0;
+        tp->wrap = 0;
+        break;
+
+    case '\n':
+        /* Log lines end with a bare LF too: it implies a CR */
+        tp->col = 0;
+        tp->wrap = 0;
+        lcdiicTermLineFeed(tp);
+        break;
+
+    case '\b':
+        if (tp->col > 0 && !tp->wrap) {
+            tp->col--;
+        }
+        tp->wrap = 0;
+        break;
+
+    case '\t':
+        do {
+            lcdiicTermPut(tp, ' ');
+        } while (!tp->wrap && (tp->col & 0x07));
+        break;
+
+    case 0x1b:
+        tp->state = TERM_ESC;
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void lcdiicTermFeed(LCDIICTerm *tp, uint8_t ch) {
+    if (tp->more > 0) {
+        if ((ch & 0xc0) == 0x80) {
+            tp->cp = tp->cp << 6 | (ch & 0x3f);
+            if (--tp->more == 0) {
+                lcdiicTermPut(tp, lcdiicTermMap(tp->cp));
+            }
+            return;
+        }
+
+        /* Cut short, the byte starts something else */
+        tp->more = 0;
+        lcdiicTermPut(tp, TERM_UNKNOWN);
+    }
+
+    switch (tp->state) {
+    case TERM_ESC:
+        tp->state = TERM_GROUND;
+        if (ch == '[') {
+            tp->state = TERM_CSI;
+            tp->params[0] = tp->params[1] = 0;
+            tp->nparams = 0;
+        } else if (ch == 'c') {
+            tp->params[0] = tp->params[1] = 0;
+            lcdiicTermCsi(tp, 'H');
+            tp->params[0] = 2;
+            lcdiicTermCsi(tp, 'J');
+        }
+        return;
+
+    case TERM_CSI:
+        if (ch >= '0' && ch <= '9') {
+            uint8_t *p = &tp->params[tp->nparams];
+
+            *p = *p > 25 ? 255 : lcdiicTermMin(*p * 10 + (ch - '0'), 255);
+        } else if (ch == ';') {
+            if (tp->nparams < 1) {
+                tp->nparams++;
+            }
+        } else if (ch >= 0x40 && ch <= 0x7e) {
+            tp->state = TERM_GROUND;
+            lcdiicTermCsi(tp, ch);
+        }
+        return;
+
+    default:
+        break;
+    }
+
+    if (ch < 0x20) {
+        lcdiicTermControl(tp, ch);
+    } else if (ch < 0x7f) {
+        lcdiicTermPut(tp, ch);
+    } else if (ch >= 0xc2 && ch <= 0xdf) {
+        tp->cp = ch & 0x1f;
+        tp->more = 1;
+    } else if (ch >= 0xe0 && ch <= 0xef) {
+        tp->cp = ch & 0x0f;
+        tp->more = 2;
+    } else if (ch >= 0xf0 && ch <= 0xf4) {
+        tp->cp = ch & 0x07;
+        tp->more = 3;
+    } else if (ch != 0x7f) {
+        tp->more = 0;
+        lcdiicTermPut(tp, TERM_UNKNOWN);
+    }
+}
+
+/*
+ * Reads the channel and draws at most LCDIIC_TERM_LATENCY ms after the first
+ * byte not yet shown, so a burst is painted once.
+ */
+static THD_FUNCTION(lcdiicTermThread, arg) {
+    LCDIICTerm *tp = (LCDIICTerm *)arg;
+    systime_t start = 0;
+    bool pending = false;
+
+    chRegSetThreadName("lcdiicterm");
+
+    while (true) {
+        systime_t timeout = TIME_INFINITE;
+        uint8_t buf[16];
+        msg_t msg;
+
+        if (pending) {
+            systime_t elapsed = chVTTimeElapsedSinceX(start);
+
+            timeout = elapsed < MS2ST(LCDIIC_TERM_LATENCY) ?
+                    MS2ST(LCDIIC_TERM_LATENCY) - elapsed : TIME_IMMEDIATE;
+        }
+
+        msg = chnGetTimeout(tp->chp, timeout);
+        if (msg >= 0) {
+            buf[0] = (uint8_t)msg;
+            lcdiicTermWrite(tp, buf,
+                    1 + chnReadTimeout(tp->chp, buf + 1, sizeof(buf) - 1, TIME_IMMEDIATE));
+
+            if (!pending) {
+                pending = true;
+                start = chVTGetSystemTimeX();
+            }
+            if (chVTTimeElapsedSinceX(start) < MS2ST(LCDIIC_TERM_LATENCY)) {
+                continue;
+            }
+        } else if (msg == MSG_RESET) {
+            /* Channel stopped */
+            chThdSleepMilliseconds(LCDIIC_TERM_LATENCY);
+        }
+
+        if (pending) {
+            lcdiicTermDraw(tp);
+            pending = false;
+        }
+    }
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+void lcdiicTermObjectInit(LCDIICTerm *tp, LCDIICDriver *lcdp) {
+    chDbgCheck((tp != NULL) && (lcdp != NULL));
+
+    tp->lcdp = lcdp;
+    tp->chp = NULL;
+    chMtxObjectInit(&tp->mutex);
+    memset(tp->lines, ' ', sizeof(tp->lines));
+    tp->last = LCDIIC_TERM_ROWS - 1;
+    tp->filled = LCDIIC_TERM_ROWS;
+    tp->row = 0;
+    tp->col = 0;
+    tp->wrap = 0;
+    tp->back = 0;
+    tp->state = TERM_GROUND;
+    tp->nparams = 0;
+    tp->more = 0;
+    tp->changed = 1;
+}
+
+/*
+ * Interpret n bytes of UTF-8 text with a VT100 subset: CR, LF, BS, TAB,
+ * cursor moves (CSI A, B, C, D, H, f), erase in line and display (CSI K, J)
+ * and ESC c. Other sequences are dropped. Nothing is drawn before
+ * lcdiicTermDraw().
+ */
+void lcdiicTermWrite(LCDIICTerm *tp, const uint8_t *buf, size_t n) {
+    chDbgCheck((tp != NULL) && (buf != NULL || n == 0));
+
+    chMtxLock(&tp->mutex);
+    while (n-- > 0) {
+        lcdiicTermFeed(tp, *buf++);
+    }
+    chMtxUnlock(&tp->mutex);
+}
+
+/* Paint the rows on screen in one batch, only the changed cells are sent */
+void lcdiicTermDraw(LCDIICTerm *tp) {
+    uint8_t row;
+
+    chDbgCheck(tp != NULL);
+
+    chMtxLock(&tp->mutex);
+    if (tp->changed) {
+        tp->changed = 0;
+
+        lcdiicBatchBegin(tp->lcdp);
+        for (row = 0; row < LCDIIC_TERM_ROWS; row++) {
+            lcdiicDrawText(tp->lcdp, row & 1, (row >> 1) * LCDIIC_TERM_COLS,
+                    lcdiicTermLine(tp, row, tp->back), LCDIIC_TERM_COLS);
+        }
+        lcdiicBatchEnd(tp->lcdp);
+    }
+    chMtxUnlock(&tp->mutex);
+}
+
+/* Show the screen back lines up in the ring, 0 follows the output */
+void lcdiicTermView(LCDIICTerm *tp, uint8_t back) {
+    chDbgCheck(tp != NULL);
+
+    chMtxLock(&tp->mutex);
+    back = lcdiicTermMin(back, tp->filled - LCDIIC_TERM_ROWS);
+    if (tp->back != back) {
+        tp->back = back;
+        tp->changed = 1;
+    }
+    chMtxUnlock(&tp->mutex);
+}
+
+/*
+ * Start the thread feeding the terminal from chp, e.g. SD1, at
+ * LCDIIC_TERM_PRIORITY. There is one such thread.
+ */
+thread_t *lcdiicTermStart(LCDIICTerm *tp, BaseChannel *chp) {
+    chDbgCheck((tp != NULL) && (chp != NULL));
+    chDbgAssert(lcdiicterm_thread == NULL, "already started");
+
+    tp->chp = chp;
+    lcdiicterm_thread = chThdCreateStatic(waLcdiicTerm, sizeof(waLcdiicTerm),
+            LCDIIC_TERM_PRIORITY, lcdiicTermThread, tp);
+
+    return lcdiicterm_thread;
+}
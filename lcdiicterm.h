@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LCDIICTERM_H__
+#define __LCDIICTERM_H__
+
+#include "hal.h"
+#include "lcdiic.h"
+
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Terminal geometry, in characters.
+ * @details Rows 2 and 3 of a 4 line module continue lines 0 and 1 of the
+ *          controller, LCDIIC_TERM_COLS further.
+ */
+#if !defined(LCDIIC_TERM_COLS) || defined(__DOXYGEN__)
+#define LCDIIC_TERM_COLS            20
+#endif
+
+#if !defined(LCDIIC_TERM_ROWS) || defined(__DOXYGEN__)
+#define LCDIIC_TERM_ROWS            4
+#endif
+
+/**
+ * @brief   Lines kept in the ring buffer, the rows on screen included.
+ */
+#if !defined(LCDIIC_TERM_LINES) || defined(__DOXYGEN__)
+#define LCDIIC_TERM_LINES           8
+#endif
+
+/**
+ * @brief   Longest time in ms between a byte read by the terminal thread and
+ *          its display, a continuous stream is drawn at this period.
+ */
+#if !defined(LCDIIC_TERM_LATENCY) || defined(__DOXYGEN__)
+#define LCDIIC_TERM_LATENCY         50
+#endif
+
+/**
+ * @brief   Terminal thread working area size and priority.
+ */
+#if !defined(LCDIIC_TERM_WA_SIZE) || defined(__DOXYGEN__)
+#define LCDIIC_TERM_WA_SIZE         256
+#endif
+
+#if !defined(LCDIIC_TERM_PRIORITY) || defined(__DOXYGEN__)
+#define LCDIIC_TERM_PRIORITY        (NORMALPRIO + 1)
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if LCDIIC_TERM_ROWS < 1 || LCDIIC_TERM_ROWS > 4
+#error "LCDIIC_TERM_ROWS must be 1 to 4"
+#endif
+
+#if LCDIIC_TERM_COLS < 1 || LCDIIC_TERM_COLS * ((LCDIIC_TERM_ROWS + 1) / 2) > LCD_DDRAM_LINE_LEN
+#error "LCDIIC_TERM_COLS too large for LCDIIC_TERM_ROWS"
+#endif
+
+#if LCDIIC_TERM_LINES < LCDIIC_TERM_ROWS || LCDIIC_TERM_LINES > 255
+#error "LCDIIC_TERM_LINES must be LCDIIC_TERM_ROWS to 255"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/*
+ * Scrolling terminal on a display: text goes into a ring of lines, a scroll
+ * only moves last. Every draw paints the rows on screen into the driver
+ * shadow, so only the cells that differ go out on the bus.
+ * - last: ring index of the bottom row, filled: lines written so far
+ * - row, col: cursor on screen, wrap: col is past the last column
+ * - back: lines scrolled back from the bottom, see lcdiicTermView()
+ * - state, params, nparams: escape sequence parser
+ * - cp, more: UTF-8 code point being decoded and its missing bytes
+ * - changed: something to draw
+ * - chp: input read by the terminal thread, see lcdiicTermStart()
+ */
+typedef struct {
+    LCDIICDriver *lcdp;
+    BaseChannel *chp;
+    mutex_t mutex;
+    char lines[LCDIIC_TERM_LINES][LCDIIC_TERM_COLS];
+    uint8_t last;
+    uint8_t filled;
+    uint8_t row;
+    uint8_t col;
+    uint8_t wrap;
+    uint8_t back;
+    uint8_t state;
+    uint8_t params[2];
+    uint8_t nparams;
+    uint32_t cp;
+    uint8_t more;
+    uint8_t changed;
+} LCDIICTerm;
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lcdiicTermObjectInit(LCDIICTerm *tp, LCDIICDriver *lcdp);
+void lcdiicTermWrite(LCDIICTerm *tp, const uint8_t *buf, size_t n);
+void lcdiicTermDraw(LCDIICTerm *tp);
+void lcdiicTermView(LCDIICTerm *tp, uint8_t back);
+thread_t *lcdiicTermStart(LCDIICTerm *tp, BaseChannel *chp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LCDIICTERM_H__ */
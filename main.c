@@ -22,6 +22,17 @@
 
 #include "pcf8574.h"
 #include "lcdiic.h"
+#include "lcdiicport.h"
+#include "lcdiicdl.h"
+#if LCDIIC_USE_SCREENS
+#include "lcdscreens.h"
+#endif
+#include "primary_lcd.h"
+
+/* Print the cost of a PCF8574 transfer on SD1 at startup */
+#if !defined(PCF8574_BENCHMARK)
+#define PCF8574_BENCHMARK           FALSE
+#endif
 
 
 /*===========================================================================*/
@@ -53,6 +64,8 @@ static const I2CConfig i2ccfg = { // I2CCLK=48MHz, SCL=~100kHz
   0
 };
 
+#define I2C1_PAD_MODE   (PAL_MODE_ALTERNATE(4) | PAL_STM32_OSPEED_HIGHEST)
+
 /* Primary LCD display configuration */
 static const PCF8574Config pcf8574cfg = {
     &I2CD1,
@@ -60,13 +73,22 @@ static const PCF8574Config pcf8574cfg = {
     PCF8574A_SAD_0X3E,
     0x00,
     0x00,
+    MS2ST(20),
+    PAL_LINE(GPIOA, GPIOA_PIN9),
+    PAL_LINE(GPIOA, GPIOA_PIN10),
+    I2C1_PAD_MODE,
 };
 
 static PCF8574Driver PCF8574D1;
+static LCDIICPcf8574Port LCDIICP1;
 
 static const LCDIICConfig lcdiiccfg = {
-    &PCF8574D1,
-    &pcf8574cfg,
+    (LCDIICPort *)&LCDIICP1,
+#if LCDIIC_USE_POWER
+    { 30, 60, 300 },
+    /* The uptime ticks on an idle display */
+    1,
+#endif
 };
 
 static LCDIICDriver LCDIICD1;
@@ -78,13 +100,22 @@ static const PCF8574Config pcf8574cfgadv = {
     PCF8574A_SAD_0X3F,
     0x00,
     0x00,
+    MS2ST(20),
+    PAL_LINE(GPIOA, GPIOA_PIN9),
+    PAL_LINE(GPIOA, GPIOA_PIN10),
+    I2C1_PAD_MODE,
 };
 
 static PCF8574Driver PCF8574D2;
+static LCDIICPcf8574Port LCDIICP2;
 
 static const LCDIICConfig lcdiiccfgadv = {
-    &PCF8574D2,
-    &pcf8574cfgadv,
+    (LCDIICPort *)&LCDIICP2,
+#if LCDIIC_USE_POWER
+    { 30, 60, 300 },
+    /* The uptime ticks on an idle display */
+    1,
+#endif
 };
 
 static LCDIICDriver LCDIICD2;
@@ -98,14 +129,91 @@ static void delayMs(uint32_t val) {
     chThdSleepMilliseconds(val);
 }
 
+/* Fields of the primary display program, see primary.lcd */
+static const char *lcdDisplayField(void *arg, uint8_t idx) {
+  char *buf = (char *)arg;
+  systime_t millisec;
+
+  switch (idx) {
+  case 0:
+    chsnprintf(buf, 32, "ChibiOS/RT %s", CH_KERNEL_VERSION);
+    break;
+
+  case 1:
+    millisec = ST2MS(chVTGetSystemTime());
+    chsnprintf(buf, 32, "%6d:%02d:%02d.%03d", millisec / 3600 / 1000,
+            (millisec / 60 / 1000) % 60, (millisec / 1000) % 60, millisec % 1000);
+    break;
+
+  default:
+    return NULL;
+  }
+
+  return buf;
+}
+
+#if PCF8574_BENCHMARK
+/*
+ * Time per port read: restarting the peripheral every time as before, in a
+ * transfer of its own, and within a lease. Then one byte writes, straight
+ * through the HAL and through pcf8574SetPortOb(), which polls the registers
+ * with PCF8574_USE_LLD.
+ */
+static void pcf8574Benchmark(PCF8574Driver *devp) {
+  static const char * const names[] = { "restart", "plain", "leased", "hal write", "port write" };
+  I2CDriver *i2cp = devp->config->i2cp;
+  uint8_t mode, val;
+  uint16_t idx;
+
+  for (mode = 0; mode < 5; mode++) {
+    systime_t start;
+
+    if (mode == 2) {
+      pcf8574Lease(devp);
+    }
+
+    start = chVTGetSystemTimeX();
+    for (idx = 0; idx < 500; idx++) {
+      if (mode == 0) {
+        i2cAcquireBus(i2cp);
+        i2cStop(i2cp);
+        i2cReleaseBus(i2cp);
+      }
+      if (mode == 3) {
+        i2cAcquireBus(i2cp);
+        i2cMasterTransmitTimeout(i2cp, devp->config->sad, &devp->latch, 1, NULL, 0,
+            devp->config->timeout);
+        i2cReleaseBus(i2cp);
+      } else if (mode == 4) {
+        pcf8574SetPortOb(devp, 1, devp->latch);
+      } else {
+        pcf8574GetPortOb(devp, &val);
+      }
+    }
+    start = chVTTimeElapsedSinceX(start);
+
+    if (mode == 2) {
+      pcf8574Release(devp);
+    }
+
+    chprintf((BaseSequentialStream *)&SD1, "pcf8574 %s: %u us per transfer, %u per second\r\n",
+        names[mode], (unsigned)(ST2US(start) / 500), (unsigned)(500 * 1000 / ST2MS(start)));
+  }
+}
+#endif
+
 /* Primary LCD display thread */
-static THD_WORKING_AREA(waLcdDisplay, 256);
+static THD_WORKING_AREA(waLcdDisplay, 384);
 static __attribute__((noreturn)) THD_FUNCTION(LcdDisplay, arg) {
+  LCDIICDisplayList dl;
+  char buf[32];
+
   (void)arg;
   chRegSetThreadName("LcdDisplay");
 
   pcf8574ObjectInit(&PCF8574D1);
   pcf8574Start(&PCF8574D1, &pcf8574cfg);
+  lcdiicPcf8574PortObjectInit(&LCDIICP1, &PCF8574D1, &pcf8574cfg);
 
   lcdiicObjectInit(&LCDIICD1, &delayUs, &delayMs);
   lcdiicStart(&LCDIICD1, &lcdiiccfg);
@@ -127,36 +235,48 @@ static __attribute__((noreturn)) THD_FUNCTION(LcdDisplay, arg) {
         lcdiicUpdatePattern(&LCDIICD1, idx, SYMBOL[idx]);
     }
 
-    for (idx = 0; idx < sizeof(SYMBOL) / sizeof(SYMBOL[0][0]); idx++) {
-        uint8_t tmp;
-        lcdiicReadData(&LCDIICD1, 0, idx, &tmp);
+    /* Patterns are sent once the background initialization is over */
+    lcdiicWaitReady(&LCDIICD1, MS2ST(100));
 
-		if (idx % 8 == 0) {
-            chprintf((BaseSequentialStream *)&SD1, "---- dump pattern: %d ----\r\n", idx / 8);
-		}
+#if PCF8574_BENCHMARK
+    pcf8574Benchmark(&PCF8574D1);
+#endif
 
-        chprintf((BaseSequentialStream*)&SD1, "%02x", tmp);
-        if (idx % 8 == 7) {
-            chprintf((BaseSequentialStream *)&SD1, "\r\n");
-        } else {
-            chprintf((BaseSequentialStream *)&SD1, " ");
+#if LCDIIC_USE_READBACK
+    for (idx = 0; idx < sizeof(SYMBOL) / sizeof(SYMBOL[0]); idx++) {
+        uint8_t pat[8], pos;
+        lcdiicReadBlock(&LCDIICD1, 0, idx * 8, pat, sizeof(pat));
+
+        chprintf((BaseSequentialStream *)&SD1, "---- dump pattern: %d ----\r\n", idx);
+
+        for (pos = 0; pos < sizeof(pat); pos++) {
+            chprintf((BaseSequentialStream*)&SD1, "%02x", pat[pos]);
+            if (pos == sizeof(pat) - 1) {
+                chprintf((BaseSequentialStream *)&SD1, "\r\n");
+            } else {
+                chprintf((BaseSequentialStream *)&SD1, " ");
+            }
         }
     }
+#endif
   }
 
+  lcdiicDlObjectInit(&dl, &LCDIICD1, &primary_dl, lcdDisplayField, buf);
+
   while (true) {
-    char buf[32];
-    systime_t millisec;
+    uint32_t ms;
 
-    chsnprintf(buf, sizeof(buf), "ChibiOS/RT %s", CH_KERNEL_VERSION);
-    lcdiicDrawText(&LCDIICD1, 0, 0, buf, strlen(buf));
+    /* Reattach and replay the shadow if the module was unplugged or reset */
+    lcdiicProbe(&LCDIICD1);
 
-    millisec = ST2MS(chVTGetSystemTime());
-    chsnprintf(buf, sizeof(buf), "%6d:%02d:%02d.%03d", millisec / 3600 / 1000,
-            (millisec / 60 / 1000) % 60, (millisec / 1000) % 60, millisec % 1000);
-    lcdiicDrawText(&LCDIICD1, 1, 0, buf, strlen(buf));
+    if (lcdiicDlStep(&dl, &ms) != MSG_OK) {
+      ms = 200;
+    }
 
-    chThdSleepMilliseconds(200);
+#if LCDIIC_USE_POWER
+    ms = lcdiicPowerPeriod(&LCDIICD1, ms);
+#endif
+    chThdSleepMilliseconds(ms);
   }
 
   lcdiicStop(&LCDIICD1);
@@ -172,14 +292,23 @@ static __attribute__((noreturn)) THD_FUNCTION(LcdDisplayAdv, arg) {
 
   pcf8574ObjectInit(&PCF8574D2);
   pcf8574Start(&PCF8574D2, &pcf8574cfgadv);
+  lcdiicPcf8574PortObjectInit(&LCDIICP2, &PCF8574D2, &pcf8574cfgadv);
 
   lcdiicObjectInit(&LCDIICD2, &delayUs, &delayMs);
   lcdiicStart(&LCDIICD2, &lcdiiccfgadv);
 
+#if LCDIIC_USE_SCREENS
+  lcdiicWaitReady(&LCDIICD2, MS2ST(100));
+  lcdiicDrawScreen(&LCDIICD2, &lcdscreen_splash);
+  chThdSleepMilliseconds(1000);
+#endif
+
   while (true) {
     char buf[32];
     volatile uint32_t *uuid = (volatile uint32_t *)0x1FFFF7AC;
 
+    lcdiicProbe(&LCDIICD2);
+
     switch (next++) {
     case 0: ch = '+'; break;
     case 1: ch = '*'; next = 0; break;
@@ -193,7 +322,11 @@ static __attribute__((noreturn)) THD_FUNCTION(LcdDisplayAdv, arg) {
 
     if (idx++ == 2) idx = 0;
 
+#if LCDIIC_USE_POWER
+    chThdSleepMilliseconds(lcdiicPowerPeriod(&LCDIICD2, 1000));
+#else
     chThdSleepMilliseconds(1000);
+#endif
   }
 
   lcdiicStop(&LCDIICD1);
@@ -218,8 +351,8 @@ int __attribute__((noreturn)) main(void)
   /*
    * I2CD1 I/O pins setup.(It bypasses board.h configurations)
    */
-  palSetPadMode(GPIOA, GPIOA_PIN9, PAL_MODE_ALTERNATE(4) | PAL_STM32_OSPEED_HIGHEST);   /* SCL */
-  palSetPadMode(GPIOA, GPIOA_PIN10, PAL_MODE_ALTERNATE(4) | PAL_STM32_OSPEED_HIGHEST);  /* SDA */
+  palSetPadMode(GPIOA, GPIOA_PIN9, I2C1_PAD_MODE);   /* SCL */
+  palSetPadMode(GPIOA, GPIOA_PIN10, I2C1_PAD_MODE);  /* SDA */
 
   /*
    * Activates the serial driver 1 using the driver default configuration.
@@ -23,72 +23,472 @@
  * 2. TI: http://www.ti.com/lit/ds/symlink/pcf8574.pdf
  */
 
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/* Methods are only exported when they are called directly */
+#if PCF8574_USE_VMT
+#define PCF8574_METHOD              static
+#else
+#define PCF8574_METHOD
+#endif
+
+/* A direct transfer of drv goes after its queued write */
+#if PCF8574_USE_QUEUE
+#define pcf8574Drain(drv)           (void)pcf8574WaitPort(drv)
+#else
+#define pcf8574Drain(drv)
+#endif
+
+/* Short enough for the register engine, which busy-waits on the bus */
+#if PCF8574_USE_LLD
+#define pcf8574Polled(txlen, rxlen) ((txlen) + (rxlen) <= PCF8574_LLD_POLL_MAX)
+#else
+#define pcf8574Polled(txlen, rxlen) false
+#endif
+
+#if PCF8574_USE_LLD
+/* CR1 bits of the HAL transfers, masked while the register engine polls */
+#define PCF8574_LLD_CR1_MASK        (I2C_CR1_TXIE | I2C_CR1_RXIE | I2C_CR1_NACKIE | \
+                                     I2C_CR1_STOPIE | I2C_CR1_TCIE | I2C_CR1_ERRIE | \
+                                     I2C_CR1_TXDMAEN | I2C_CR1_RXDMAEN)
+#define PCF8574_LLD_ERRORS          (I2C_ISR_NACKF | I2C_ISR_BERR | I2C_ISR_ARLO)
+#define PCF8574_LLD_NBYTES(n)       ((uint32_t)(n) << 16)
+#endif
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/* Users of each bus: started expanders not idle, and pcf8574ClaimBus() */
+static struct {
+    I2CDriver *i2cp;
+    uint8_t users;
+} pcf8574_buses[PCF8574_BUS_MAX];
+
+#if PCF8574_USE_QUEUE
+/* Requests in submission order, thread: the idle worker */
+static struct {
+    PCF8574Request *head;
+    PCF8574Request *tail;
+    thread_reference_t thread;
+} pcf8574_queue;
+
+static MUTEX_DECL(pcf8574_lock);
+static thread_t *pcf8574_worker;
+static THD_WORKING_AREA(waPcf8574Queue, PCF8574_QUEUE_WA_SIZE);
+#endif
+
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
-static msg_t pcf8574ReadRegister(I2CDriver *i2cp, pcf8574_sad_t sad, uint8_t *rxbuf, size_t n) {
-    return i2cMasterReceiveTimeout(i2cp, sad, rxbuf, n, TIME_INFINITE);
+static msg_t pcf8574ReadRegister(I2CDriver *i2cp, pcf8574_sad_t sad, uint8_t *rxbuf, size_t n,
+        systime_t timeout) {
+    return i2cMasterReceiveTimeout(i2cp, sad, rxbuf, n, timeout);
+}
+
+static msg_t pcf8574WriteRegister(I2CDriver *i2cp, pcf8574_sad_t sad, const uint8_t *txbuf, uint8_t n,
+        uint8_t *rxbuf, uint8_t rn, systime_t timeout) {
+    return i2cMasterTransmitTimeout(i2cp, sad, txbuf, n, rxbuf, rn, timeout);
+}
+
+#if PCF8574_USE_LLD || defined(__DOXYGEN__)
+/*
+ * Spin until one of flags is set in ISR. An error flag is cleared, recorded
+ * in errors and gives MSG_RESET; MSG_TIMEOUT once timeout elapsed from start.
+ */
+static msg_t pcf8574PollFlags(I2C_TypeDef *dp, uint32_t flags, systime_t start,
+        systime_t timeout, i2cflags_t *errors) {
+    uint32_t isr;
+
+    while (((isr = dp->ISR) & (flags | PCF8574_LLD_ERRORS)) == 0) {
+        if (timeout != TIME_INFINITE && !chVTIsSystemTimeWithinX(start, start + timeout)) {
+            return MSG_TIMEOUT;
+        }
+    }
+
+    if ((isr & PCF8574_LLD_ERRORS) == 0) {
+        return MSG_OK;
+    }
+
+    if (isr & I2C_ISR_NACKF)    *errors |= I2C_ACK_FAILURE;
+    if (isr & I2C_ISR_BERR)     *errors |= I2C_BUS_ERROR;
+    if (isr & I2C_ISR_ARLO)     *errors |= I2C_ARBITRATION_LOST;
+    dp->ICR = isr & PCF8574_LLD_ERRORS;
+
+    return MSG_RESET;
+}
+
+/*
+ * Register level transfer on the running peripheral: n bytes written with
+ * mask ORed in as each one goes to TXDR, then rn
+ * bytes read after a repeated START, the last phase ending with an automatic
+ * STOP, which a NACK also sends. A START waits for the bus to be free
+ * first. CR1 and CR2 are restored as the HAL left them.
+ */
+static msg_t pcf8574PollLocked(const PCF8574Config *cfg, const uint8_t *txbuf, uint8_t n,
+        uint8_t mask, uint8_t *rxbuf, uint8_t rn, i2cflags_t *errors) {
+    I2C_TypeDef *dp = cfg->i2cp->i2c;
+    uint32_t sadd = ((uint32_t)cfg->sad << 1) & I2C_CR2_SADD;
+    uint32_t cr1 = dp->CR1;
+    uint32_t cr2 = dp->CR2;
+    systime_t start = chVTGetSystemTimeX();
+    msg_t ret = MSG_OK, end;
+    uint8_t idx;
+
+    /* Another master, or the STOP of the previous transfer, holds the bus */
+    while (dp->ISR & I2C_ISR_BUSY) {
+        if (cfg->timeout != TIME_INFINITE &&
+                !chVTIsSystemTimeWithinX(start, start + cfg->timeout)) {
+            return MSG_TIMEOUT;
+        }
+    }
+
+    dp->CR1 = cr1 & ~PCF8574_LLD_CR1_MASK;
+
+    if (n > 0) {
+        dp->CR2 = sadd | PCF8574_LLD_NBYTES(n) | (rn > 0 ? 0 : I2C_CR2_AUTOEND) | I2C_CR2_START;
+        for (idx = 0; idx < n && ret == MSG_OK; idx++) {
+            ret = pcf8574PollFlags(dp, I2C_ISR_TXIS, start, cfg->timeout, errors);
+            if (ret == MSG_OK) {
+                dp->TXDR = txbuf[idx] | mask;
+            }
+        }
+
+        /* Software end: TC holds SCL low until the repeated START */
+        if (ret == MSG_OK && rn > 0) {
+            ret = pcf8574PollFlags(dp, I2C_ISR_TC, start, cfg->timeout, errors);
+        }
+    }
+
+    if (ret == MSG_OK && rn > 0) {
+        dp->CR2 = sadd | I2C_CR2_RD_WRN | PCF8574_LLD_NBYTES(rn) | I2C_CR2_AUTOEND | I2C_CR2_START;
+        for (idx = 0; idx < rn && ret == MSG_OK; idx++) {
+            ret = pcf8574PollFlags(dp, I2C_ISR_RXNE, start, cfg->timeout, errors);
+            if (ret == MSG_OK) {
+                rxbuf[idx] = (uint8_t)dp->RXDR;
+            }
+        }
+    }
+
+    /* A bus error or a lost arbitration may never see its STOP */
+    if (ret == MSG_OK || *errors == I2C_ACK_FAILURE) {
+        end = pcf8574PollFlags(dp, I2C_ISR_STOPF, start, cfg->timeout, errors);
+        if (ret == MSG_OK) {
+            ret = end;
+        }
+    }
+    dp->ICR = I2C_ICR_STOPCF;
+
+    dp->CR2 = cr2;
+    dp->CR1 = cr1;
+
+    return ret;
+}
+#endif /* PCF8574_USE_LLD */
+
+/* Roughly 5us, half a SCL period at 100kHz */
+static void pcf8574BusDelay(void) {
+    volatile uint32_t cnt = STM32_SYSCLK / 1000000;
+
+    while (cnt--)
+        ;
+}
+
+/*
+ * Bus recovery, the bus must be acquired: with the peripheral stopped, clock
+ * SCL until the slave holding SDA low releases it (at most 9 pulses), then
+ * generate a STOP condition and restart the peripheral.
+ */
+static void pcf8574RecoverBusLocked(const PCF8574Config *cfg) {
+    uint8_t idx;
+
+    i2cStop(cfg->i2cp);
+
+    if (cfg->scl != PCF8574_NOLINE) {
+        palSetLine(cfg->scl);
+        palSetLine(cfg->sda);
+        palSetLineMode(cfg->scl, PAL_MODE_OUTPUT_OPENDRAIN);
+        palSetLineMode(cfg->sda, PAL_MODE_OUTPUT_OPENDRAIN);
+        pcf8574BusDelay();
+
+        for (idx = 0; idx < PCF8574_RECOVERY_PULSES && palReadLine(cfg->sda) == PAL_LOW; idx++) {
+            palClearLine(cfg->scl);
+            pcf8574BusDelay();
+            palSetLine(cfg->scl);
+            pcf8574BusDelay();
+        }
+
+        /* STOP: SDA rises while SCL is high */
+        palClearLine(cfg->scl);
+        pcf8574BusDelay();
+        palClearLine(cfg->sda);
+        pcf8574BusDelay();
+        palSetLine(cfg->scl);
+        pcf8574BusDelay();
+        palSetLine(cfg->sda);
+        pcf8574BusDelay();
+
+        palSetLineMode(cfg->scl, cfg->mode);
+        palSetLineMode(cfg->sda, cfg->mode);
+    }
+
+    i2cStart(cfg->i2cp, cfg->i2ccfg);
 }
 
-static msg_t pcf8574WriteRegister(I2CDriver *i2cp, pcf8574_sad_t sad, uint8_t *txbuf, uint8_t n) {
-    return i2cMasterTransmitTimeout(i2cp, sad, txbuf, n, NULL, 0, TIME_INFINITE);
+/* One user more or less on i2cp, returns the users left */
+static uint8_t pcf8574BusUsers(I2CDriver *i2cp, bool use) {
+    uint8_t idx, slot = PCF8574_BUS_MAX, users;
+
+    chSysLock();
+    for (idx = 0; idx < PCF8574_BUS_MAX; idx++) {
+        if (pcf8574_buses[idx].i2cp == i2cp) {
+            slot = idx;
+            break;
+        }
+        if (slot == PCF8574_BUS_MAX && pcf8574_buses[idx].users == 0) {
+            slot = idx;
+        }
+    }
+    chDbgAssert(slot < PCF8574_BUS_MAX, "pcf8574BusUsers(), too many buses");
+    chDbgAssert(use || pcf8574_buses[slot].users > 0, "pcf8574BusUsers(), no user");
+
+    pcf8574_buses[slot].i2cp = i2cp;
+    users = use ? ++pcf8574_buses[slot].users : --pcf8574_buses[slot].users;
+    chSysUnlock();
+
+    return users;
 }
 
-static msg_t setPort(void *ip, uint8_t modify, uint8_t *val, uint8_t len) {
-    uint8_t ret;
-    const PCF8574Driver *drv = (PCF8574Driver *)ip;
+/*
+ * Write txlen bytes, then read rxlen bytes after a repeated START. Either
+ * length may be zero. A mask other than 0x00 is ORed in by the register
+ * engine, so only a polled transfer takes one. On failure the I2C errors are
+ * kept in drv->errors and a timeout, bus error or lost arbitration triggers
+ * a bus recovery.
+ */
+static msg_t pcf8574TransactLocked(PCF8574Driver *drv, const uint8_t *txval, uint8_t txlen,
+        uint8_t mask, uint8_t *rxval, uint8_t rxlen) {
+    const PCF8574Config *cfg = drv->config;
+    i2cflags_t errors = I2C_NO_ERROR;
+    msg_t ret;
+
+    if (drv->idle) {
+        drv->idle = 0;
+        (void)pcf8574BusUsers(cfg->i2cp, true);
+    }
 
-    if (modify) {
-        uint8_t idx;
-        for (idx = 0; idx < len; idx++)
-            val[idx] = drv->config->mask | val[idx];
+    /* Reprogramming the timings costs more than the transfer of a byte, skip
+     * it while the peripheral runs with this configuration already */
+    if (cfg->i2cp->state != I2C_READY || cfg->i2cp->config != cfg->i2ccfg) {
+        i2cStart(cfg->i2cp, cfg->i2ccfg);
     }
 
-    i2cAcquireBus(drv->config->i2cp);
-    i2cStart(drv->config->i2cp, drv->config->i2ccfg);
+    chDbgAssert(mask == 0x00 || pcf8574Polled(txlen, rxlen),
+            "pcf8574TransactLocked(), mask on a HAL transfer");
 
-    ret = pcf8574WriteRegister(drv->config->i2cp, drv->config->sad, val, len);
+#if PCF8574_USE_LLD
+    if (pcf8574Polled(txlen, rxlen)) {
+        ret = pcf8574PollLocked(cfg, txval, txlen, mask, rxval, rxlen, &errors);
+    } else
+#endif
+    {
+        if (txlen == 0) {
+            ret = pcf8574ReadRegister(cfg->i2cp, cfg->sad, rxval, rxlen, cfg->timeout);
+        } else {
+            ret = pcf8574WriteRegister(cfg->i2cp, cfg->sad, txval, txlen, rxval, rxlen, cfg->timeout);
+        }
+        if (ret != MSG_OK) {
+            errors = i2cGetErrors(cfg->i2cp);
+        }
+    }
+
+    if (ret == MSG_OK) {
+        drv->errors = I2C_NO_ERROR;
+        if (txlen > 0) {
+            drv->latch = txval[txlen - 1] | mask;
+        }
+    } else {
+        drv->errors = errors;
+        if (ret == MSG_TIMEOUT) {
+            drv->errors |= I2C_TIMEOUT;
+        }
 
-    i2cReleaseBus(drv->config->i2cp);
+        /* A NACK only means the slave is absent, anything else may have left
+         * the bus or the peripheral stuck */
+        if (drv->errors & (I2C_TIMEOUT | I2C_BUS_ERROR | I2C_ARBITRATION_LOST)) {
+            pcf8574RecoverBusLocked(cfg);
+        }
+    }
 
     return ret;
 }
 
-static msg_t getPort(void *ip, uint8_t *val, uint8_t len) {
+/*
+ * Write txlen bytes with mask ORed in, then read rxlen bytes. Bytes already
+ * carrying the mask, as the frames of lcdiic.c do, go out straight from
+ * txval, which may be const or in flash. Otherwise a polled transfer has the
+ * mask ORed in on the way to TXDR; a longer one streams from a
+ * PCF8574_STREAM_CHUNK bytes bounce buffer, one transaction (START, address
+ * and STOP) per chunk, the read following the last one.
+ */
+static msg_t pcf8574TransferLocked(PCF8574Driver *drv, const uint8_t *txval, uint8_t txlen,
+        uint8_t mask, uint8_t *rxval, uint8_t rxlen) {
+    uint8_t buf[PCF8574_STREAM_CHUNK];
     msg_t ret;
-    const PCF8574Driver *drv = (PCF8574Driver *)ip;
+    uint8_t idx;
+
+    for (idx = 0; idx < txlen && (txval[idx] & mask) == mask; idx++)
+        ;
+
+    if (idx == txlen) {
+        return pcf8574TransactLocked(drv, txval, txlen, 0x00, rxval, rxlen);
+    }
+
+    if (pcf8574Polled(txlen, rxlen)) {
+        return pcf8574TransactLocked(drv, txval, txlen, mask, rxval, rxlen);
+    }
+
+    do {
+        uint8_t n = txlen < sizeof(buf) ? txlen : sizeof(buf);
+
+        for (idx = 0; idx < n; idx++) {
+            buf[idx] = txval[idx] | mask;
+        }
+        txval += n;
+        txlen -= n;
+
+        ret = pcf8574TransactLocked(drv, buf, n, 0x00, txlen == 0 ? rxval : NULL,
+                txlen == 0 ? rxlen : 0);
+    } while (ret == MSG_OK && txlen > 0);
+
+    return ret;
+}
 
-    i2cAcquireBus(drv->config->i2cp);
-    i2cStart(drv->config->i2cp, drv->config->i2ccfg);
+static msg_t pcf8574Transfer(PCF8574Driver *drv, const uint8_t *txval, uint8_t txlen,
+        uint8_t mask, uint8_t *rxval, uint8_t rxlen) {
+    I2CDriver *i2cp = drv->config->i2cp;
+    msg_t ret;
 
-    ret = pcf8574ReadRegister(drv->config->i2cp, drv->config->sad, val, len);
+    /* Already held by pcf8574AcquireBus() or pcf8574Lease() */
+    if (drv->held) {
+        return pcf8574TransferLocked(drv, txval, txlen, mask, rxval, rxlen);
+    }
 
-    i2cReleaseBus(drv->config->i2cp);
+    pcf8574Drain(drv);
+    i2cAcquireBus(i2cp);
+    ret = pcf8574TransferLocked(drv, txval, txlen, mask, rxval, rxlen);
+    i2cReleaseBus(i2cp);
 
     return ret;
 }
 
-static msg_t setPortOb(void *ip, uint8_t modify, uint8_t val) {
-    return setPort(ip, modify, &val, 1);
+#if PCF8574_USE_QUEUE
+/*
+ * Queue worker: the bus stays acquired from one request to the next, it is
+ * released once the queue is empty or the next request is for another bus.
+ */
+static THD_FUNCTION(pcf8574QueueThread, arg) {
+    I2CDriver *i2cp = NULL;
+
+    (void)arg;
+    chRegSetThreadName("pcf8574");
+
+    while (true) {
+        PCF8574Request *reqp;
+
+        chSysLock();
+        if (pcf8574_queue.head == NULL && i2cp == NULL) {
+            chThdSuspendS(&pcf8574_queue.thread);
+        }
+        reqp = pcf8574_queue.head;
+        if (reqp != NULL) {
+            pcf8574_queue.head = reqp->next;
+        }
+        chSysUnlock();
+
+        if (i2cp != NULL && (reqp == NULL || reqp->drvp->config->i2cp != i2cp)) {
+            i2cReleaseBus(i2cp);
+            i2cp = NULL;
+        }
+        if (reqp == NULL) {
+            continue;
+        }
+        if (i2cp == NULL) {
+            i2cp = reqp->drvp->config->i2cp;
+            i2cAcquireBus(i2cp);
+        }
+
+        reqp->result = pcf8574TransferLocked(reqp->drvp, reqp->txbuf, reqp->txlen,
+                reqp->mask, reqp->rxbuf, reqp->rxlen);
+        if (reqp->callback != NULL) {
+            reqp->callback(reqp);
+        }
+
+        /* The submitter may reuse the request from here on */
+        chSysLock();
+        reqp->state = PCF8574_REQ_DONE;
+        chThdResumeS(&reqp->thread, reqp->result);
+        chSysUnlock();
+    }
+}
+#endif /* PCF8574_USE_QUEUE */
+
+/* With modify, the config mask is ORed into the bytes sent, val is left as is */
+PCF8574_METHOD msg_t _pcf8574_set_port(void *ip, uint8_t modify, const uint8_t *val, uint8_t len) {
+    PCF8574Driver *drv = (PCF8574Driver *)ip;
+
+    return pcf8574Transfer(drv, val, len, modify ? drv->config->mask : 0x00, NULL, 0);
 }
 
-static msg_t getPortOb(void *ip, uint8_t *val) {
-    return getPort(ip, val, 1);
+PCF8574_METHOD msg_t _pcf8574_get_port(void *ip, uint8_t *val, uint8_t len) {
+    return pcf8574Transfer((PCF8574Driver *)ip, NULL, 0, 0x00, val, len);
 }
 
+/* Write txlen bytes, then read rxlen bytes after a repeated START */
+PCF8574_METHOD msg_t _pcf8574_xfer_port(void *ip, uint8_t modify, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen) {
+    PCF8574Driver *drv = (PCF8574Driver *)ip;
+
+    return pcf8574Transfer(drv, txval, txlen, modify ? drv->config->mask : 0x00, rxval, rxlen);
+}
+
+PCF8574_METHOD msg_t _pcf8574_set_port_ob(void *ip, uint8_t modify, uint8_t val) {
+    return _pcf8574_set_port(ip, modify, &val, 1);
+}
+
+PCF8574_METHOD msg_t _pcf8574_get_port_ob(void *ip, uint8_t *val) {
+    return _pcf8574_get_port(ip, val, 1);
+}
+
+#if PCF8574_USE_VMT
 static const struct PCF8574VMT vmt_pcf8574 = {
-    setPort, getPort,
-    setPortOb, getPortOb
+    _pcf8574_set_port, _pcf8574_get_port,
+    _pcf8574_set_port_ob, _pcf8574_get_port_ob,
+    _pcf8574_xfer_port,
 };
+#endif
 
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
 
 void pcf8574ObjectInit(PCF8574Driver *devp) {
+#if PCF8574_USE_VMT
     devp->vmt = &vmt_pcf8574;
+#endif
     devp->config = NULL;
+    devp->errors = I2C_NO_ERROR;
+    /* Power-on state: every pin high */
+    devp->latch = 0xff;
+    devp->held = 0;
+    devp->idle = 1;
+#if PCF8574_USE_QUEUE
+    devp->request.state = PCF8574_REQ_IDLE;
+    devp->request.thread = NULL;
+#endif
 
     devp->state = PCF8574_STOP;
 }
@@ -99,10 +499,24 @@ void pcf8574Start(PCF8574Driver *devp, const PCF8574Config *config) {
     chDbgAssert((devp->state == PCF8574_STOP) || (devp->state == PCF8574_READY),
             "pcf8574Start(), invalid state");
 
+    /* Restarted, maybe on another bus: the init write counts it again */
+    if (!devp->idle) {
+        devp->idle = 1;
+        (void)pcf8574BusUsers(devp->config->i2cp, false);
+    }
     devp->config = config;
 
+#if PCF8574_USE_QUEUE
+    chMtxLock(&pcf8574_lock);
+    if (pcf8574_worker == NULL) {
+        pcf8574_worker = chThdCreateStatic(waPcf8574Queue, sizeof(waPcf8574Queue),
+                PCF8574_QUEUE_PRIORITY, pcf8574QueueThread, NULL);
+    }
+    chMtxUnlock(&pcf8574_lock);
+#endif
+
     /* Init port */
-    setPortOb(devp, 0, devp->config->mask | devp->config->value);
+    _pcf8574_set_port_ob(devp, 0, devp->config->mask | devp->config->value);
 
     devp->state = PCF8574_READY;
 }
@@ -113,8 +527,306 @@ void pcf8574Stop(PCF8574Driver *devp) {
 
     if (devp->state == PCF8574_READY) {
         /* Set all I/O pin to input */
-        setPortOb(devp, 0, 0xff);
+        _pcf8574_set_port_ob(devp, 0, 0xff);
+    }
+
+    if (!devp->idle) {
+        devp->idle = 1;
+        (void)pcf8574BusUsers(devp->config->i2cp, false);
     }
 
     devp->state = PCF8574_STOP;
 }
+
+/*
+ * Hold the I2C bus shared by n expanders across several calls, so their
+ * transfers go out back to back with no other device in between. None of
+ * them may hold the bus already.
+ */
+void pcf8574AcquireBus(PCF8574Driver * const *drvs, uint8_t n) {
+    uint8_t idx;
+
+    chDbgCheck((drvs != NULL) && (n > 0));
+
+    for (idx = 0; idx < n; idx++) {
+        pcf8574Drain(drvs[idx]);
+    }
+
+    i2cAcquireBus(drvs[0]->config->i2cp);
+    for (idx = 0; idx < n; idx++) {
+        chDbgAssert(drvs[idx]->config->i2cp == drvs[0]->config->i2cp,
+                "pcf8574AcquireBus(), not on one bus");
+        chDbgAssert(drvs[idx]->held == 0, "pcf8574AcquireBus(), already held");
+        drvs[idx]->held = 1;
+    }
+}
+
+void pcf8574ReleaseBus(PCF8574Driver * const *drvs, uint8_t n) {
+    uint8_t idx;
+
+    chDbgCheck((drvs != NULL) && (n > 0));
+
+    for (idx = 0; idx < n; idx++) {
+        drvs[idx]->held--;
+    }
+    i2cReleaseBus(drvs[0]->config->i2cp);
+}
+
+/*
+ * True while another thread holds the bus of devp, or requests of any
+ * expander wait in the queue, for work that should rather come back later.
+ */
+bool pcf8574BusBusy(PCF8574Driver *devp) {
+    bool busy = false;
+
+    chDbgCheck((devp != NULL) && (devp->config != NULL));
+
+#if PCF8574_USE_QUEUE
+    busy = pcf8574_queue.head != NULL;
+#endif
+#if I2C_USE_MUTUAL_EXCLUSION
+    if (!busy && devp->held == 0) {
+        busy = !chMtxTryLock(&devp->config->i2cp->mutex);
+        if (!busy) {
+            chMtxUnlock(&devp->config->i2cp->mutex);
+        }
+    }
+#endif
+
+    return busy;
+}
+
+/*
+ * Keep the bus of devp acquired and configured across a burst of transfers,
+ * until the matching pcf8574Release(). Leases nest, also within
+ * pcf8574AcquireBus().
+ */
+void pcf8574Lease(PCF8574Driver *devp) {
+    chDbgCheck((devp != NULL) && (devp->config != NULL));
+
+    if (devp->held == 0) {
+        pcf8574Drain(devp);
+        i2cAcquireBus(devp->config->i2cp);
+    }
+    devp->held++;
+}
+
+void pcf8574Release(PCF8574Driver *devp) {
+    chDbgCheck((devp != NULL) && (devp->held > 0));
+
+    if (--devp->held == 0) {
+        i2cReleaseBus(devp->config->i2cp);
+    }
+}
+
+/*
+ * Write the same len bytes to n expanders on one I2C bus, back to back within
+ * a single bus acquisition, each one with its own mask ORed in.
+ * rets[idx] gets the result of drvs[idx], MSG_OK if all of them succeeded.
+ */
+msg_t pcf8574SetPortMulti(PCF8574Driver * const *drvs, uint8_t n, const uint8_t *val, uint8_t len,
+        msg_t *rets) {
+    I2CDriver *i2cp;
+    msg_t ret = MSG_OK;
+    uint8_t idx, held;
+
+    chDbgCheck((drvs != NULL) && (n > 0) && (rets != NULL));
+
+    i2cp = drvs[0]->config->i2cp;
+    held = drvs[0]->held;
+
+    if (!held) {
+        for (idx = 0; idx < n; idx++) {
+            pcf8574Drain(drvs[idx]);
+        }
+        i2cAcquireBus(i2cp);
+    }
+    for (idx = 0; idx < n; idx++) {
+        chDbgAssert(drvs[idx]->config->i2cp == i2cp, "pcf8574SetPortMulti(), not on one bus");
+
+        rets[idx] = pcf8574TransferLocked(drvs[idx], val, len, drvs[idx]->config->mask,
+                NULL, 0);
+        if (rets[idx] != MSG_OK) {
+            ret = rets[idx];
+        }
+    }
+    if (!held) {
+        i2cReleaseBus(i2cp);
+    }
+
+    return ret;
+}
+
+/* Write the latch with clear pins low and set pins high, unless it holds it already */
+static msg_t pcf8574UpdateLatch(PCF8574Driver *devp, uint8_t clear, uint8_t set) {
+    msg_t ret = MSG_OK;
+    uint8_t val;
+
+    chDbgCheck((devp != NULL) && (devp->config != NULL));
+
+    pcf8574Lease(devp);
+    val = (devp->latch & ~clear) | set | devp->config->mask;
+    if (val != devp->latch) {
+        ret = pcf8574TransactLocked(devp, &val, 1, 0x00, NULL, 0);
+    }
+    pcf8574Release(devp);
+
+    return ret;
+}
+
+/* Drive pins high, the other pins keep their level */
+msg_t pcf8574SetPins(PCF8574Driver *devp, uint8_t pins) {
+    return pcf8574UpdateLatch(devp, 0x00, pins);
+}
+
+/* Drive pins low, except those of the config mask */
+msg_t pcf8574ClearPins(PCF8574Driver *devp, uint8_t pins) {
+    return pcf8574UpdateLatch(devp, pins, 0x00);
+}
+
+/* Drive the pins of bits to their level in val */
+msg_t pcf8574WriteMasked(PCF8574Driver *devp, uint8_t bits, uint8_t val) {
+    return pcf8574UpdateLatch(devp, bits, val & bits);
+}
+
+/* Recover the bus of devp on request, e.g. after repeated failures */
+void pcf8574RecoverBus(PCF8574Driver *devp) {
+    chDbgCheck((devp != NULL) && (devp->config != NULL));
+
+    if (devp->held) {
+        pcf8574RecoverBusLocked(devp->config);
+        return;
+    }
+
+    pcf8574Drain(devp);
+    i2cAcquireBus(devp->config->i2cp);
+    pcf8574RecoverBusLocked(devp->config);
+    i2cReleaseBus(devp->config->i2cp);
+}
+
+/*
+ * devp leaves its bus until the next transfer. The I2C peripheral is stopped
+ * to save power once no started expander and no pcf8574ClaimBus() is left on
+ * the bus, the next transfer restarts it.
+ */
+void pcf8574StopBus(PCF8574Driver *devp) {
+    I2CDriver *i2cp;
+
+    chDbgCheck((devp != NULL) && (devp->config != NULL));
+
+    i2cp = devp->config->i2cp;
+    if (!devp->held) {
+        pcf8574Drain(devp);
+        i2cAcquireBus(i2cp);
+    }
+
+    if (!devp->idle) {
+        devp->idle = 1;
+        if (pcf8574BusUsers(i2cp, false) == 0) {
+            i2cStop(i2cp);
+        }
+    }
+
+    if (!devp->held) {
+        i2cReleaseBus(i2cp);
+    }
+}
+
+/*
+ * Other drivers of a bus shared with expanders claim it, so that
+ * pcf8574StopBus() leaves it running. After an unclaim, a peripheral left
+ * without users is stopped; a claim does not restart it, i2cStart() does.
+ */
+void pcf8574ClaimBus(I2CDriver *i2cp) {
+    chDbgCheck(i2cp != NULL);
+
+    (void)pcf8574BusUsers(i2cp, true);
+}
+
+void pcf8574UnclaimBus(I2CDriver *i2cp) {
+    chDbgCheck(i2cp != NULL);
+
+    i2cAcquireBus(i2cp);
+    if (pcf8574BusUsers(i2cp, false) == 0) {
+        i2cStop(i2cp);
+    }
+    i2cReleaseBus(i2cp);
+}
+
+#if PCF8574_USE_QUEUE || defined(__DOXYGEN__)
+/* Append reqp to the queue, from a locked state, e.g. an ISR or a callback */
+void pcf8574SubmitI(PCF8574Request *reqp) {
+    chDbgCheckClassI();
+    chDbgCheck((reqp != NULL) && (reqp->drvp != NULL) && (reqp->drvp->config != NULL));
+    chDbgAssert(reqp->state != PCF8574_REQ_QUEUED, "pcf8574SubmitI(), already queued");
+
+    reqp->next = NULL;
+    reqp->state = PCF8574_REQ_QUEUED;
+    if (pcf8574_queue.head == NULL) {
+        pcf8574_queue.head = reqp;
+    } else {
+        pcf8574_queue.tail->next = reqp;
+    }
+    pcf8574_queue.tail = reqp;
+
+    chThdResumeI(&pcf8574_queue.thread, MSG_OK);
+}
+
+/*
+ * Queue reqp and return at once. The caller must not hold the bus with a
+ * lease, or wait for the request before releasing it.
+ */
+void pcf8574Submit(PCF8574Request *reqp) {
+    chSysLock();
+    pcf8574SubmitI(reqp);
+    chSchRescheduleS();
+    chSysUnlock();
+}
+
+/* Wait until reqp is done, returns its result, MSG_OK if never submitted */
+msg_t pcf8574Wait(PCF8574Request *reqp) {
+    chDbgCheck(reqp != NULL);
+
+    chSysLock();
+    if (reqp->state == PCF8574_REQ_QUEUED) {
+        chThdSuspendS(&reqp->thread);
+    }
+    chSysUnlock();
+
+    return reqp->state == PCF8574_REQ_DONE ? reqp->result : MSG_OK;
+}
+
+/*
+ * Queue a write of len bytes to devp after its previous one. val must carry
+ * the mask and stay untouched until pcf8574WaitPort(). Within a lease the
+ * write goes out at once.
+ */
+void pcf8574SubmitPort(PCF8574Driver *devp, uint8_t modify, const uint8_t *val, uint8_t len) {
+    PCF8574Request *reqp = &devp->request;
+
+    chDbgCheck((devp != NULL) && (devp->config != NULL) && (val != NULL));
+
+    pcf8574Drain(devp);
+
+    reqp->drvp = devp;
+    reqp->txbuf = val;
+    reqp->txlen = len;
+    reqp->mask = modify ? devp->config->mask : 0x00;
+    reqp->rxbuf = NULL;
+    reqp->rxlen = 0;
+    reqp->callback = NULL;
+
+    if (devp->held) {
+        reqp->result = pcf8574TransferLocked(devp, val, len, reqp->mask, NULL, 0);
+        reqp->state = PCF8574_REQ_DONE;
+        return;
+    }
+
+    pcf8574Submit(reqp);
+}
+
+/* Result of the last pcf8574SubmitPort() of devp, once it is done */
+msg_t pcf8574WaitPort(PCF8574Driver *devp) {
+    return pcf8574Wait(&devp->request);
+}
+#endif /* PCF8574_USE_QUEUE */
@@ -18,6 +18,89 @@
 
 #include "hal.h"
 
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/* No bus recovery lines configured */
+#define PCF8574_NOLINE              ((ioline_t)0)
+
+/* SCL pulses needed to release a slave stuck in the middle of a byte */
+#define PCF8574_RECOVERY_PULSES     9
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Dispatches the driver methods through a VMT.
+ * @details When disabled the method macros call the implementation directly,
+ *          which lets the compiler inline them, and each driver saves its VMT
+ *          pointer.
+ */
+#if !defined(PCF8574_USE_VMT) || defined(__DOXYGEN__)
+#define PCF8574_USE_VMT             TRUE
+#endif
+
+/**
+ * @brief   Bounce buffer size for writes that need the mask applied.
+ * @details Bytes already carrying the mask are sent from the caller buffer,
+ *          and a polled transfer of PCF8574_USE_LLD ORs the mask in as it
+ *          feeds TXDR. Longer writes go by chunks, a transaction each: a
+ *          START, the address byte and a STOP more per chunk.
+ */
+#if !defined(PCF8574_STREAM_CHUNK) || defined(__DOXYGEN__)
+#define PCF8574_STREAM_CHUNK        16
+#endif
+
+/**
+ * @brief   Asynchronous transaction queue.
+ * @details Requests submitted with pcf8574Submit() are carried out back to
+ *          back by one worker thread, which keeps the bus acquired while the
+ *          queue is not empty. With STM32_I2C_USE_DMA the bytes move by DMA
+ *          and the submitting thread is free meanwhile.
+ */
+#if !defined(PCF8574_USE_QUEUE) || defined(__DOXYGEN__)
+#define PCF8574_USE_QUEUE           TRUE
+#endif
+
+/**
+ * @brief   Queue worker thread working area size and priority.
+ */
+#if !defined(PCF8574_QUEUE_WA_SIZE) || defined(__DOXYGEN__)
+#define PCF8574_QUEUE_WA_SIZE       192
+#endif
+
+#if !defined(PCF8574_QUEUE_PRIORITY) || defined(__DOXYGEN__)
+#define PCF8574_QUEUE_PRIORITY      (NORMALPRIO + 3)
+#endif
+
+/**
+ * @brief   Drives the I2Cv2 registers directly for short transfers.
+ * @details Transfers of up to PCF8574_LLD_POLL_MAX bytes, written and read
+ *          together, are polled through TXDR, RXDR, NBYTES and AUTOEND with
+ *          the peripheral interrupts masked, instead of the HAL thread
+ *          suspend and resume. The calling thread spins for the bytes on the
+ *          bus. Longer transfers stay with the HAL, by DMA and interrupts.
+ */
+#if !defined(PCF8574_USE_LLD) || defined(__DOXYGEN__)
+#define PCF8574_USE_LLD             FALSE
+#endif
+
+/**
+ * @brief   Longest transfer polled by the register engine.
+ */
+#if !defined(PCF8574_LLD_POLL_MAX) || defined(__DOXYGEN__)
+#define PCF8574_LLD_POLL_MAX        6
+#endif
+
+/**
+ * @brief   Number of I2C buses whose users are counted by pcf8574StopBus().
+ */
+#if !defined(PCF8574_BUS_MAX) || defined(__DOXYGEN__)
+#define PCF8574_BUS_MAX             1
+#endif
+
 /*===========================================================================*/
 /* Derived constants and error checks.                                       */
 /*===========================================================================*/
@@ -26,6 +109,18 @@
 #error "PCF8574 requires HAL_USE_I2C"
 #endif
 
+#if PCF8574_USE_LLD && !defined(I2C_CR2_AUTOEND)
+#error "PCF8574_USE_LLD requires the STM32 I2Cv2 peripheral"
+#endif
+
+#if PCF8574_LLD_POLL_MAX < 1 || PCF8574_LLD_POLL_MAX > 255
+#error "PCF8574_LLD_POLL_MAX must be 1 to 255"
+#endif
+
+#if PCF8574_BUS_MAX < 1
+#error "PCF8574_BUS_MAX must be at least 1"
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
@@ -65,24 +160,97 @@ typedef struct {
     pcf8574_sad_t sad;
     uint8_t mask;
     uint8_t value;
+
+    /* Per transfer timeout, TIME_INFINITE waits forever */
+    systime_t timeout;
+
+    /* Bus recovery: SCL/SDA lines and the I2C pin mode restored afterwards,
+     * PCF8574_NOLINE as scl only restarts the peripheral */
+    ioline_t scl;
+    ioline_t sda;
+    iomode_t mode;
 } PCF8574Config;
 
+#if PCF8574_USE_QUEUE || defined(__DOXYGEN__)
+typedef enum {
+    PCF8574_REQ_IDLE = 0,
+    PCF8574_REQ_QUEUED = 1,
+    PCF8574_REQ_DONE = 2,
+} pcf8574_req_state_t;
+
+typedef struct PCF8574Request PCF8574Request;
+
+/* Called by the worker thread with the bus still acquired */
+typedef void (*pcf8574_callback_t)(PCF8574Request *reqp);
+
+/*
+ * One queued transaction: write txlen bytes, then read rxlen bytes after a
+ * repeated START, to the address and with the I2C config and timeout of
+ * drvp. A timeout or a bus error recovers the bus as a direct transfer
+ * would. The buffers must stay valid until the request is done.
+ * - mask: ORed into the bytes written, txbuf is left untouched
+ * - result: outcome, valid once state is PCF8574_REQ_DONE
+ * - thread: the thread in pcf8574Wait(), if any
+ */
+struct PCF8574Request {
+    PCF8574Request *next;
+    struct PCF8574Driver *drvp;
+    const uint8_t *txbuf;
+    uint8_t txlen;
+    uint8_t mask;
+    uint8_t *rxbuf;
+    uint8_t rxlen;
+    pcf8574_callback_t callback;
+    void *arg;
+    volatile pcf8574_req_state_t state;
+    msg_t result;
+    thread_reference_t thread;
+};
+#endif /* PCF8574_USE_QUEUE */
+
 #define _pcf8574_methods \
-    msg_t (*setPort)(void *instance, uint8_t modify, uint8_t *val, uint8_t len); \
+    msg_t (*setPort)(void *instance, uint8_t modify, const uint8_t *val, uint8_t len); \
     msg_t (*getPort)(void *instance, uint8_t *val, uint8_t len); \
     msg_t (*setPortOb)(void *instance, uint8_t modify, uint8_t val); \
     msg_t (*getPortOb)(void *instance, uint8_t *val); \
+    msg_t (*xferPort)(void *instance, uint8_t modify, const uint8_t *txval, uint8_t txlen, \
+            uint8_t *rxval, uint8_t rxlen); \
 
 struct PCF8574VMT {
     _pcf8574_methods
 };
 
+/*
+ * - latch: output latch of the expander, last byte written with success
+ * - held: nesting count of pcf8574Lease() and pcf8574AcquireBus()
+ * - idle: not counted as a user of the bus, since pcf8574StopBus() or
+ *   pcf8574Stop(), the next transfer counts it again
+ * - request: write of pcf8574SubmitPort(), every direct transfer of the
+ *   driver waits for it first
+ */
+#if PCF8574_USE_QUEUE || defined(__DOXYGEN__)
 #define _pcf8574_data \
     pcf8574_state_t state; \
-    const PCF8574Config *config;
+    const PCF8574Config *config; \
+    i2cflags_t errors; \
+    uint8_t latch; \
+    uint8_t held; \
+    uint8_t idle; \
+    PCF8574Request request;
+#else
+#define _pcf8574_data \
+    pcf8574_state_t state; \
+    const PCF8574Config *config; \
+    i2cflags_t errors; \
+    uint8_t latch; \
+    uint8_t held; \
+    uint8_t idle;
+#endif
 
 typedef struct PCF8574Driver {
+#if PCF8574_USE_VMT
     const struct PCF8574VMT *vmt;
+#endif
     _pcf8574_data;
 } PCF8574Driver;
 
@@ -90,10 +258,11 @@ typedef struct PCF8574Driver {
 /* Driver macros.                                                            */
 /*===========================================================================*/
 
+#if PCF8574_USE_VMT || defined(__DOXYGEN__)
 #define pcf8574SetPort(ip, modify, val, len) \
     (ip)->vmt->setPort(ip, modify, val, len)
 
-#define pcf8574GetPort(ip, val) \
+#define pcf8574GetPort(ip, val, len) \
     (ip)->vmt->getPort(ip, val, len)
 
 #define pcf8574SetPortOb(ip, modify, val) \
@@ -102,6 +271,32 @@ typedef struct PCF8574Driver {
 #define pcf8574GetPortOb(ip, val) \
     (ip)->vmt->getPortOb(ip, val)
 
+#define pcf8574XferPort(ip, modify, txval, txlen, rxval, rxlen) \
+    (ip)->vmt->xferPort(ip, modify, txval, txlen, rxval, rxlen)
+#else
+#define pcf8574SetPort(ip, modify, val, len) \
+    _pcf8574_set_port(ip, modify, val, len)
+
+#define pcf8574GetPort(ip, val, len) \
+    _pcf8574_get_port(ip, val, len)
+
+#define pcf8574SetPortOb(ip, modify, val) \
+    _pcf8574_set_port_ob(ip, modify, val)
+
+#define pcf8574GetPortOb(ip, val) \
+    _pcf8574_get_port_ob(ip, val)
+
+#define pcf8574XferPort(ip, modify, txval, txlen, rxval, rxlen) \
+    _pcf8574_xfer_port(ip, modify, txval, txlen, rxval, rxlen)
+#endif
+
+/* I2C errors of the last failed transfer, I2C_NO_ERROR after a successful one */
+#define pcf8574GetErrors(ip) \
+    (ip)->errors
+
+#define pcf8574GetLatch(ip) \
+    (ip)->latch
+
 /*===========================================================================*/
 /* External declarations.                                                    */
 /*===========================================================================*/
@@ -113,6 +308,35 @@ extern "C" {
 void pcf8574ObjectInit(PCF8574Driver *devp);
 void pcf8574Start(PCF8574Driver *devp, const PCF8574Config *config);
 void pcf8574Stop(PCF8574Driver *devp);
+void pcf8574RecoverBus(PCF8574Driver *devp);
+void pcf8574StopBus(PCF8574Driver *devp);
+void pcf8574ClaimBus(I2CDriver *i2cp);
+void pcf8574UnclaimBus(I2CDriver *i2cp);
+void pcf8574AcquireBus(PCF8574Driver * const *drvs, uint8_t n);
+void pcf8574ReleaseBus(PCF8574Driver * const *drvs, uint8_t n);
+bool pcf8574BusBusy(PCF8574Driver *devp);
+void pcf8574Lease(PCF8574Driver *devp);
+void pcf8574Release(PCF8574Driver *devp);
+msg_t pcf8574SetPortMulti(PCF8574Driver * const *drvs, uint8_t n, const uint8_t *val, uint8_t len,
+        msg_t *rets);
+msg_t pcf8574SetPins(PCF8574Driver *devp, uint8_t pins);
+msg_t pcf8574ClearPins(PCF8574Driver *devp, uint8_t pins);
+msg_t pcf8574WriteMasked(PCF8574Driver *devp, uint8_t bits, uint8_t val);
+#if PCF8574_USE_QUEUE
+void pcf8574SubmitI(PCF8574Request *reqp);
+void pcf8574Submit(PCF8574Request *reqp);
+msg_t pcf8574Wait(PCF8574Request *reqp);
+void pcf8574SubmitPort(PCF8574Driver *devp, uint8_t modify, const uint8_t *val, uint8_t len);
+msg_t pcf8574WaitPort(PCF8574Driver *devp);
+#endif
+#if !PCF8574_USE_VMT
+msg_t _pcf8574_set_port(void *ip, uint8_t modify, const uint8_t *val, uint8_t len);
+msg_t _pcf8574_get_port(void *ip, uint8_t *val, uint8_t len);
+msg_t _pcf8574_set_port_ob(void *ip, uint8_t modify, uint8_t val);
+msg_t _pcf8574_get_port_ob(void *ip, uint8_t *val);
+msg_t _pcf8574_xfer_port(void *ip, uint8_t modify, const uint8_t *txval, uint8_t txlen,
+        uint8_t *rxval, uint8_t rxlen);
+#endif
 
 #ifdef __cplusplus
 }
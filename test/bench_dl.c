@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark, `make -C test bench`: the CPU time of a step of
+ * primary.lcd, the program of the primary display, on the mock port. Once
+ * with the uptime field unchanged, the step is then only the interpreter and
+ * the field hash, once with a new uptime each step, which adds the redraw of
+ * the field. Host numbers, they give the ratio, not Cortex-M0 cycles.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "hal.h"
+#include "lcdiic.h"
+#include "lcdiicmock.h"
+#include "lcdiicdl.h"
+#include "primary_lcd.h"
+
+#define RUNS                        200000
+
+static LCDIICMockPort port;
+static LCDIICDriver lcd;
+static const LCDIICConfig cfg = { (LCDIICPort *)&port };
+
+static char uptime[32];
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+static const char *field(void *arg, uint8_t idx) {
+    (void)arg;
+
+    switch (idx) {
+    case 0:
+        return "ChibiOS/RT 4.0.0";
+
+    case 1:
+        return uptime;
+
+    default:
+        return NULL;
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run(const char *name, LCDIICDisplayList *dlp, bool tick) {
+    unsigned long idx, mark;
+    uint32_t ms;
+    double start;
+
+    mark = port.len;
+    start = now();
+    for (idx = 0; idx < RUNS; idx++) {
+        if (tick) {
+            snprintf(uptime, sizeof(uptime), "%6lu:%02lu:%02lu.%03lu", idx / 18000,
+                    idx / 300 % 60, idx / 5 % 60, idx % 5 * 200);
+        }
+        lcdiicDlStep(dlp, &ms);
+    }
+    printf("%-26s %6.1f ns per step, %lu bytes\n", name, (now() - start) / RUNS,
+            (port.len - mark) / RUNS);
+}
+
+int main(void) {
+    LCDIICDisplayList dl;
+    uint32_t ms;
+
+    chSysInit();
+    lcdiicMockPortObjectInit(&port, 0, NULL, 0, NULL, NULL);
+    lcdiicObjectInit(&lcd, delayUs, delayMs);
+    lcdiicStart(&lcd, &cfg);
+    lcdiicWaitReady(&lcd, MS2ST(500));
+
+    lcdiicDlObjectInit(&dl, &lcd, &primary_dl, field, NULL);
+    lcdiicDlStep(&dl, &ms);
+
+    run("Display list, unchanged:", &dl, false);
+    run("Display list, new uptime:", &dl, true);
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark, `make -C test bench`: the CPU time of a 16 character
+ * drawText through the C driver and its VMT, on the mock port, against
+ * lcdiic::Lcd on an expander that only counts bytes. Both write the same
+ * bytes, the two texts alternate so the shadow of the C driver cannot skip
+ * a cell. Host numbers, they give the ratio, not Cortex-M0 cycles.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "hal.h"
+#include "lcdiic.h"
+#include "lcdiicmock.h"
+#include "lcdiic.hpp"
+
+#define RUNS                        200000
+
+static const char *const texts[2] = { "0123456789abcdef", "fedcba9876543210" };
+
+struct CountingExpander {
+    unsigned long bytes;
+
+    bool send(const uint8_t *buf, size_t len) {
+        (void)buf;
+        bytes += len;
+        return true;
+    }
+};
+
+struct NoWait {
+    static constexpr uint32_t powerOnMs = 0;
+    static constexpr uint32_t clearMs = 0;
+
+    static void delayUs(uint32_t us) {
+        (void)us;
+    }
+
+    static void delayMs(uint32_t ms) {
+        (void)ms;
+    }
+};
+
+static LCDIICMockPort port;
+static LCDIICDriver lcd;
+static const LCDIICConfig cfg = { (LCDIICPort *)&port };
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void) {
+    CountingExpander ex = { 0 };
+    lcdiic::Lcd<CountingExpander, lcdiic::Geometry1602, lcdiic::PinMapPcf8574T, NoWait> cpp(ex);
+    unsigned long idx, mark;
+    double start, vmt, tmpl;
+
+    chSysInit();
+    lcdiicMockPortObjectInit(&port, 0, NULL, 0, NULL, NULL);
+    lcdiicObjectInit(&lcd, delayUs, delayMs);
+    lcdiicStart(&lcd, &cfg);
+    lcdiicWaitReady(&lcd, MS2ST(500));
+    cpp.start();
+
+    mark = port.len;
+    start = now();
+    for (idx = 0; idx < RUNS; idx++) {
+        lcdiicDrawText(&lcd, 1, 0, texts[idx & 1], 16);
+    }
+    vmt = (now() - start) / RUNS;
+    printf("C driver, VMT:   %6.1f ns per drawText, %lu bytes\n", vmt, (port.len - mark) / RUNS);
+
+    mark = ex.bytes;
+    start = now();
+    for (idx = 0; idx < RUNS; idx++) {
+        cpp.drawText(1, 0, texts[idx & 1], 16);
+    }
+    tmpl = (now() - start) / RUNS;
+    printf("lcdiic::Lcd:     %6.1f ns per drawText, %lu bytes\n", tmpl, (ex.bytes - mark) / RUNS);
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __CH_H__
+#define __CH_H__
+
+/*
+ * Host stand-in for the ChibiOS/RT 4 kernel, the subset the drivers use.
+ * Threads are cooperative contexts run by priority on one host thread. The
+ * system time is virtual: it only moves when every thread waits, straight to
+ * the next timer or timeout, so a test takes no real time. See hostch.c.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef TRUE
+#define TRUE                        1
+#endif
+#ifndef FALSE
+#define FALSE                       0
+#endif
+
+#define CH_KERNEL_VERSION           "4.0.0 host"
+#define CH_CFG_ST_FREQUENCY         1000
+#define CH_CFG_USE_MUTEXES          TRUE
+#define CH_CFG_USE_EVENTS           TRUE
+
+/* Host stack added to every working area, the target sizes are far too small */
+#define CH_HOST_STACK_SIZE          32768
+
+/*===========================================================================*/
+/* Types.                                                                    */
+/*===========================================================================*/
+
+typedef int32_t msg_t;
+typedef uint32_t systime_t;
+typedef uint32_t tprio_t;
+typedef uint32_t eventmask_t;
+typedef uint32_t eventflags_t;
+typedef uint64_t stkalign_t;
+
+#define MSG_OK                      (msg_t)0
+#define MSG_TIMEOUT                 (msg_t)-1
+#define MSG_RESET                   (msg_t)-2
+
+#define TIME_IMMEDIATE              ((systime_t)0)
+#define TIME_INFINITE               ((systime_t)-1)
+
+#define IDLEPRIO                    (tprio_t)1
+#define LOWPRIO                     (tprio_t)2
+#define NORMALPRIO                  (tprio_t)128
+#define HIGHPRIO                    (tprio_t)255
+
+#define ALL_EVENTS                  ((eventmask_t)-1)
+#define EVENT_MASK(eid)             ((eventmask_t)1 << (eventmask_t)(eid))
+
+#define S2ST(sec)                   ((systime_t)((uint32_t)(sec) * CH_CFG_ST_FREQUENCY))
+#define MS2ST(msec)                 ((systime_t)(((uint32_t)(msec) * CH_CFG_ST_FREQUENCY + 999) / 1000))
+#define US2ST(usec)                 ((systime_t)(((uint32_t)(usec) * CH_CFG_ST_FREQUENCY + 999999) / 1000000))
+#define ST2MS(n)                    ((uint32_t)(((n) * 1000 + CH_CFG_ST_FREQUENCY - 1) / CH_CFG_ST_FREQUENCY))
+#define ST2US(n)                    ((uint32_t)(((n) * 1000000 + CH_CFG_ST_FREQUENCY - 1) / CH_CFG_ST_FREQUENCY))
+
+typedef void (*tfunc_t)(void *p);
+typedef void (*vtfunc_t)(void *p);
+
+typedef struct ch_thread thread_t;
+typedef thread_t *thread_reference_t;
+
+/* Threads waiting in priority order, then in arrival order */
+typedef struct {
+    thread_t *next;
+} threads_queue_t;
+
+typedef struct {
+    threads_queue_t queue;
+    thread_t *owner;
+} mutex_t;
+
+typedef struct virtual_timer {
+    struct virtual_timer *next;
+    systime_t time;
+    vtfunc_t func;
+    void *par;
+} virtual_timer_t;
+
+typedef struct event_listener {
+    struct event_listener *next;
+    thread_t *listener;
+    eventmask_t events;
+    eventflags_t flags;
+    eventflags_t wflags;
+} event_listener_t;
+
+typedef struct {
+    event_listener_t *next;
+} event_source_t;
+
+#define THD_WORKING_AREA(s, n)      stkalign_t s[((n) + CH_HOST_STACK_SIZE) / sizeof(stkalign_t)]
+#define THD_FUNCTION(tname, arg)    void tname(void *arg)
+
+#define _MUTEX_DATA(name)           {{NULL}, NULL}
+#define MUTEX_DECL(name)            mutex_t name = _MUTEX_DATA(name)
+
+/* A failed check stops the test with the function name */
+#define chDbgCheck(c) do {                                                  \
+    if (!(c)) {                                                             \
+        chSysHalt(__func__);                                                \
+    }                                                                       \
+} while (false)
+
+#define chDbgAssert(c, r) do {                                              \
+    if (!(c)) {                                                             \
+        chSysHalt(r);                                                       \
+    }                                                                       \
+} while (false)
+
+#define chDbgCheckClassI()
+#define chDbgCheckClassS()
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void chSysInit(void);
+void chSysHalt(const char *reason);
+void chSysLock(void);
+void chSysUnlock(void);
+void chSysLockFromISR(void);
+void chSysUnlockFromISR(void);
+void chSchRescheduleS(void);
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg);
+thread_t *chThdGetSelfX(void);
+tprio_t chThdGetPriorityX(void);
+void chRegSetThreadName(const char *name);
+void chThdSleep(systime_t time);
+void chThdSleepMilliseconds(uint32_t msec);
+void chThdSleepMicroseconds(uint32_t usec);
+void chThdSleepUntil(systime_t time);
+void chThdYield(void);
+msg_t chThdSuspendS(thread_reference_t *trp);
+msg_t chThdSuspendTimeoutS(thread_reference_t *trp, systime_t timeout);
+void chThdResumeI(thread_reference_t *trp, msg_t msg);
+void chThdResumeS(thread_reference_t *trp, msg_t msg);
+void chThdResume(thread_reference_t *trp, msg_t msg);
+void chThdQueueObjectInit(threads_queue_t *tqp);
+msg_t chThdEnqueueTimeoutS(threads_queue_t *tqp, systime_t timeout);
+void chThdDequeueNextI(threads_queue_t *tqp, msg_t msg);
+void chThdDequeueAllI(threads_queue_t *tqp, msg_t msg);
+
+void chMtxObjectInit(mutex_t *mp);
+void chMtxLock(mutex_t *mp);
+void chMtxLockS(mutex_t *mp);
+bool chMtxTryLock(mutex_t *mp);
+void chMtxUnlock(mutex_t *mp);
+void chMtxUnlockS(mutex_t *mp);
+
+void chVTObjectInit(virtual_timer_t *vtp);
+void chVTSet(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par);
+void chVTSetI(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par);
+void chVTReset(virtual_timer_t *vtp);
+void chVTResetI(virtual_timer_t *vtp);
+bool chVTIsArmed(virtual_timer_t *vtp);
+bool chVTIsArmedI(virtual_timer_t *vtp);
+systime_t chVTGetSystemTime(void);
+systime_t chVTGetSystemTimeX(void);
+systime_t chVTTimeElapsedSinceX(systime_t start);
+bool chVTIsSystemTimeWithinX(systime_t start, systime_t end);
+bool chVTIsSystemTimeWithin(systime_t start, systime_t end);
+
+void chEvtObjectInit(event_source_t *esp);
+void chEvtRegisterMaskWithFlags(event_source_t *esp, event_listener_t *elp,
+        eventmask_t events, eventflags_t wflags);
+void chEvtRegisterMask(event_source_t *esp, event_listener_t *elp, eventmask_t events);
+void chEvtUnregister(event_source_t *esp, event_listener_t *elp);
+eventflags_t chEvtGetAndClearFlags(event_listener_t *elp);
+eventmask_t chEvtGetAndClearEvents(eventmask_t events);
+void chEvtBroadcastFlags(event_source_t *esp, eventflags_t flags);
+void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags);
+void chEvtSignal(thread_t *tp, eventmask_t events);
+void chEvtSignalI(thread_t *tp, eventmask_t events);
+eventmask_t chEvtWaitAny(eventmask_t events);
+eventmask_t chEvtWaitAnyTimeout(eventmask_t events, systime_t timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CH_H__ */
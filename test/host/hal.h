@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __HAL_H__
+#define __HAL_H__
+
+/*
+ * Host stand-in for the ChibiOS HAL. lcdiic.c and lcdiicmock.c need the
+ * kernel only, pcf8574.c and lcdiicport.c the I2C and PAL subset below,
+ * implemented by the bus model of hostbus.c. No I2Cv2 registers, so
+ * PCF8574_USE_LLD is a target only option.
+ */
+
+#include "ch.h"
+
+#define HAL_USE_I2C                 TRUE
+#define HAL_USE_PAL                 TRUE
+#define I2C_USE_MUTUAL_EXCLUSION    TRUE
+#define STM32_I2C_USE_DMA           FALSE
+#define STM32_SYSCLK                48000000
+
+/*===========================================================================*/
+/* I2C.                                                                      */
+/*===========================================================================*/
+
+#define I2C_NO_ERROR                0x00
+#define I2C_BUS_ERROR               0x01
+#define I2C_ARBITRATION_LOST        0x02
+#define I2C_ACK_FAILURE             0x04
+#define I2C_OVERRUN                 0x08
+#define I2C_PEC_ERROR               0x10
+#define I2C_TIMEOUT                 0x20
+#define I2C_SMB_ALERT               0x40
+
+typedef uint16_t i2caddr_t;
+typedef uint32_t i2cflags_t;
+
+typedef enum {
+    I2C_UNINIT = 0,
+    I2C_STOP = 1,
+    I2C_READY = 2,
+    I2C_ACTIVE_TX = 3,
+    I2C_ACTIVE_RX = 4,
+    I2C_LOCKED = 5,
+} i2cstate_t;
+
+typedef struct {
+    uint32_t timingr;
+    uint32_t cr1;
+    uint32_t cr2;
+} I2CConfig;
+
+typedef struct {
+    i2cstate_t state;
+    const I2CConfig *config;
+    i2cflags_t errors;
+    mutex_t mutex;
+} I2CDriver;
+
+extern I2CDriver I2CD1;
+
+/*===========================================================================*/
+/* PAL.                                                                      */
+/*===========================================================================*/
+
+typedef struct {
+    uint32_t odr;
+    uint32_t idr;
+} stm32_gpio_t;
+
+typedef stm32_gpio_t *ioportid_t;
+typedef uint32_t ioportmask_t;
+typedef uint32_t iomode_t;
+typedef uintptr_t ioline_t;
+
+extern stm32_gpio_t host_gpioa;
+
+#define GPIOA                       (&host_gpioa)
+
+#define PAL_LOW                     0
+#define PAL_HIGH                    1
+
+#define PAL_MODE_INPUT              0
+#define PAL_MODE_OUTPUT_PUSHPULL    1
+#define PAL_MODE_OUTPUT_OPENDRAIN   2
+#define PAL_MODE_ALTERNATE(n)       (0x10 | ((n) << 8))
+
+#define PAL_LINE(port, pad)         ((ioline_t)(port) | (ioline_t)(pad))
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void i2cStart(I2CDriver *i2cp, const I2CConfig *config);
+void i2cStop(I2CDriver *i2cp);
+i2cflags_t i2cGetErrors(I2CDriver *i2cp);
+msg_t i2cMasterTransmitTimeout(I2CDriver *i2cp, i2caddr_t addr, const uint8_t *txbuf, size_t txbytes,
+        uint8_t *rxbuf, size_t rxbytes, systime_t timeout);
+msg_t i2cMasterReceiveTimeout(I2CDriver *i2cp, i2caddr_t addr, uint8_t *rxbuf, size_t rxbytes,
+        systime_t timeout);
+void i2cAcquireBus(I2CDriver *i2cp);
+void i2cReleaseBus(I2CDriver *i2cp);
+
+void palSetLine(ioline_t line);
+void palClearLine(ioline_t line);
+int palReadLine(ioline_t line);
+void palSetLineMode(ioline_t line, iomode_t mode);
+void palWriteGroup(ioportid_t port, ioportmask_t mask, uint32_t offset, ioportmask_t bits);
+ioportmask_t palReadGroup(ioportid_t port, ioportmask_t mask, uint32_t offset);
+void palSetGroupMode(ioportid_t port, ioportmask_t mask, uint32_t offset, iomode_t mode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HAL_H__ */
@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <string.h>
+
+#include "hal.h"
+#include "hostbus.h"
+
+
+/*===========================================================================*/
+/* Local definitions.                                                        */
+/*===========================================================================*/
+
+#define HOST_LCD_RS                 0x01
+#define HOST_LCD_RW                 0x02
+#define HOST_LCD_EN                 0x04
+
+/*===========================================================================*/
+/* Exported variables.                                                       */
+/*===========================================================================*/
+
+I2CDriver I2CD1;
+stm32_gpio_t host_gpioa;
+HostBusStats host_bus;
+
+/*===========================================================================*/
+/* Local variables.                                                          */
+/*===========================================================================*/
+
+static HostLcd host_lcds[HOST_BUS_DEVICES];
+static unsigned host_nlcds;
+
+/*===========================================================================*/
+/* Local functions.                                                          */
+/*===========================================================================*/
+
+static HostLcd *hostBusFind(i2caddr_t addr) {
+    unsigned idx;
+
+    for (idx = 0; idx < host_nlcds; idx++) {
+        if (host_lcds[idx].sad == addr) {
+            return &host_lcds[idx];
+        }
+    }
+
+    return NULL;
+}
+
+/* The address counter wraps per line of a 2 line display */
+static uint8_t hostLcdNext(const HostLcd *lcdp) {
+    if (lcdp->cgram) {
+        return (lcdp->ac + 1) & 0x3f;
+    }
+    if (lcdp->ac == 0x27) {
+        return 0x40;
+    }
+    if (lcdp->ac == 0x67) {
+        return 0x00;
+    }
+
+    return (lcdp->ac + 1) & 0x7f;
+}
+
+/* Instructions the drivers use: address, function set, clear, home */
+static void hostLcdExec(HostLcd *lcdp, bool rs, uint8_t val) {
+    if (rs) {
+        if (lcdp->cgram) {
+            lcdp->pattern[lcdp->ac & 0x3f] = val;
+        } else {
+            lcdp->ddram[lcdp->ac & 0x7f] = val;
+        }
+        lcdp->ac = hostLcdNext(lcdp);
+    } else if (val & 0x80) {
+        lcdp->cgram = false;
+        lcdp->ac = val & 0x7f;
+    } else if (val & 0x40) {
+        lcdp->cgram = true;
+        lcdp->ac = val & 0x3f;
+    } else if (val & 0x20) {
+        lcdp->mode8 = (val & 0x10) != 0;
+        lcdp->phase = false;
+    } else if (val & 0x02) {
+        lcdp->cgram = false;
+        lcdp->ac = 0;
+    } else if (val & 0x01) {
+        memset(lcdp->ddram, ' ', sizeof(lcdp->ddram));
+        lcdp->cgram = false;
+        lcdp->ac = 0;
+    }
+}
+
+/* A falling EN ends a write or a read cycle, a rising one starts a read */
+static void hostLcdWrite(HostLcd *lcdp, uint8_t val) {
+    uint8_t old = lcdp->latch;
+    bool rs = (val & HOST_LCD_RS) != 0;
+    bool rw = (val & HOST_LCD_RW) != 0;
+    uint8_t data;
+
+    lcdp->latch = val;
+
+    if (!(old & HOST_LCD_EN) && (val & HOST_LCD_EN) && rw) {
+        data = !rs ? lcdp->ac : lcdp->cgram ? lcdp->pattern[lcdp->ac & 0x3f] : lcdp->ddram[lcdp->ac & 0x7f];
+        lcdp->out = (lcdp->mode8 || !lcdp->phase) ? (data & 0xf0) : (uint8_t)(data << 4);
+    }
+
+    if ((old & HOST_LCD_EN) && !(val & HOST_LCD_EN)) {
+        if (!lcdp->mode8) {
+            lcdp->phase = !lcdp->phase;
+        }
+        if (rw) {
+            if (rs && !lcdp->phase) {
+                lcdp->ac = hostLcdNext(lcdp);
+            }
+        } else if (lcdp->mode8) {
+            hostLcdExec(lcdp, rs, val & 0xf0);
+        } else if (lcdp->phase) {
+            lcdp->high = val & 0xf0;
+        } else {
+            hostLcdExec(lcdp, rs, lcdp->high | (val >> 4));
+        }
+    }
+}
+
+static uint8_t hostLcdRead(const HostLcd *lcdp) {
+    uint8_t val = lcdp->latch;
+
+    if ((val & (HOST_LCD_RW | HOST_LCD_EN)) == (HOST_LCD_RW | HOST_LCD_EN)) {
+        val = (val & 0x0f) | (lcdp->out & val & 0xf0);
+    }
+
+    return val;
+}
+
+/*===========================================================================*/
+/* Exported functions.                                                       */
+/*===========================================================================*/
+
+void hostBusObjectInit(void) {
+    memset(&host_bus, 0, sizeof(host_bus));
+    host_nlcds = 0;
+
+    I2CD1.state = I2C_STOP;
+    I2CD1.config = NULL;
+    I2CD1.errors = I2C_NO_ERROR;
+    chMtxObjectInit(&I2CD1.mutex);
+}
+
+/* A display powered up in 8-bit mode, as the initialization expects */
+HostLcd *hostBusAddLcd(uint8_t sad) {
+    HostLcd *lcdp;
+
+    chDbgAssert(host_nlcds < HOST_BUS_DEVICES, "hostBusAddLcd(), too many");
+
+    lcdp = &host_lcds[host_nlcds++];
+    memset(lcdp, 0, sizeof(*lcdp));
+    lcdp->sad = sad;
+    lcdp->latch = 0xff;
+    lcdp->mode8 = true;
+    memset(lcdp->ddram, ' ', sizeof(lcdp->ddram));
+
+    return lcdp;
+}
+
+void i2cStart(I2CDriver *i2cp, const I2CConfig *config) {
+    i2cp->config = config;
+    i2cp->state = I2C_READY;
+    host_bus.starts++;
+}
+
+void i2cStop(I2CDriver *i2cp) {
+    i2cp->state = I2C_STOP;
+}
+
+i2cflags_t i2cGetErrors(I2CDriver *i2cp) {
+    return i2cp->errors;
+}
+
+/* One transaction, the address byte and data bytes counted as bus bytes */
+msg_t i2cMasterTransmitTimeout(I2CDriver *i2cp, i2caddr_t addr, const uint8_t *txbuf, size_t txbytes,
+        uint8_t *rxbuf, size_t rxbytes, systime_t timeout) {
+    HostLcd *lcdp = hostBusFind(addr);
+    size_t idx;
+
+    (void)timeout;
+    chDbgAssert(i2cp->state == I2C_READY, "i2cMasterTransmitTimeout(), not ready");
+    chDbgAssert(i2cp->mutex.owner == chThdGetSelfX(), "i2cMasterTransmitTimeout(), bus not acquired");
+
+    host_bus.transactions++;
+    i2cp->errors = I2C_NO_ERROR;
+    if (lcdp == NULL) {
+        i2cp->errors = I2C_ACK_FAILURE;
+        return MSG_RESET;
+    }
+
+    host_bus.bytes += 1 + txbytes + (rxbytes > 0 ? 1 + rxbytes : 0);
+    for (idx = 0; idx < txbytes; idx++) {
+        hostLcdWrite(lcdp, txbuf[idx]);
+    }
+    for (idx = 0; idx < rxbytes; idx++) {
+        rxbuf[idx] = hostLcdRead(lcdp);
+    }
+
+    return MSG_OK;
+}
+
+msg_t i2cMasterReceiveTimeout(I2CDriver *i2cp, i2caddr_t addr, uint8_t *rxbuf, size_t rxbytes,
+        systime_t timeout) {
+    return i2cMasterTransmitTimeout(i2cp, addr, NULL, 0, rxbuf, rxbytes, timeout);
+}
+
+void i2cAcquireBus(I2CDriver *i2cp) {
+    chMtxLock(&i2cp->mutex);
+    host_bus.acquisitions++;
+}
+
+void i2cReleaseBus(I2CDriver *i2cp) {
+    chMtxUnlock(&i2cp->mutex);
+}
+
+/* No wires behind the pins, recovery finds SDA released */
+void palSetLine(ioline_t line) {
+    (void)line;
+}
+
+void palClearLine(ioline_t line) {
+    (void)line;
+}
+
+int palReadLine(ioline_t line) {
+    (void)line;
+    return PAL_HIGH;
+}
+
+void palSetLineMode(ioline_t line, iomode_t mode) {
+    (void)line;
+    (void)mode;
+}
+
+void palWriteGroup(ioportid_t port, ioportmask_t mask, uint32_t offset, ioportmask_t bits) {
+    port->odr = (port->odr & ~(mask << offset)) | ((bits & mask) << offset);
+}
+
+ioportmask_t palReadGroup(ioportid_t port, ioportmask_t mask, uint32_t offset) {
+    return (port->odr >> offset) & mask;
+}
+
+void palSetGroupMode(ioportid_t port, ioportmask_t mask, uint32_t offset, iomode_t mode) {
+    (void)port;
+    (void)mask;
+    (void)offset;
+    (void)mode;
+}
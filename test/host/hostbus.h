@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __HOSTBUS_H__
+#define __HOSTBUS_H__
+
+#include "hal.h"
+
+/*
+ * Bus model behind the host I2C driver: PCF8574 expanders, each wired to an
+ * HD44780 as on the serial LCD module (P0 RS, P1 RW, P2 EN, P3 BL,
+ * P4..P7 D4..D7), and counters of what the drivers asked of the HAL.
+ */
+
+#define HOST_BUS_DEVICES            4
+
+/* Calls into the HAL since hostBusObjectInit() */
+typedef struct {
+    unsigned long transactions;
+    unsigned long bytes;
+    unsigned long starts;
+    unsigned long acquisitions;
+} HostBusStats;
+
+/*
+ * The HD44780 after one PCF8574. latch is the port, the pins read back are
+ * its bits with D4..D7 driven by the controller while RW and EN are high.
+ */
+typedef struct {
+    uint8_t sad;
+    uint8_t latch;
+    bool mode8;
+    bool phase;
+    uint8_t high;
+    uint8_t out;
+    bool cgram;
+    uint8_t ac;
+    uint8_t ddram[128];
+    uint8_t pattern[64];
+} HostLcd;
+
+extern HostBusStats host_bus;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hostBusObjectInit(void);
+HostLcd *hostBusAddLcd(uint8_t sad);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HOSTBUS_H__ */
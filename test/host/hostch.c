@@ -0,0 +1,631 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include "ch.h"
+
+
+/*
+ * Host kernel: the thread running is always the ready one of highest
+ * priority, as on the target, but a thread only loses the CPU where the
+ * kernel would reschedule, never in the middle of its code. Timers fire
+ * when every thread waits, after the system time jumps to them.
+ */
+
+/*===========================================================================*/
+/* Local definitions.                                                        */
+/*===========================================================================*/
+
+#define CH_HOST_THREADS_MAX         8
+
+typedef enum {
+    CH_STATE_READY = 0,
+    CH_STATE_WAITING = 1,
+    CH_STATE_FINAL = 2,
+} ch_state_t;
+
+/*
+ * - queue: the threads queue or mutex the thread waits in, if any
+ * - wakeup: end of the timeout of a waiting thread, if timed
+ * - ewmask: events a thread in chEvtWaitAny() waits for, 0 otherwise
+ */
+struct ch_thread {
+    ucontext_t ctx;
+    const char *name;
+    tprio_t prio;
+    ch_state_t state;
+    thread_t *qnext;
+    threads_queue_t *queue;
+    bool timed;
+    systime_t wakeup;
+    msg_t rdymsg;
+    eventmask_t epending;
+    eventmask_t ewmask;
+    tfunc_t pf;
+    void *arg;
+};
+
+/*===========================================================================*/
+/* Local variables.                                                          */
+/*===========================================================================*/
+
+static thread_t ch_threads[CH_HOST_THREADS_MAX];
+static unsigned ch_nthreads;
+static thread_t *ch_current;
+static systime_t ch_now;
+static virtual_timer_t *ch_timers;
+
+/*===========================================================================*/
+/* Local functions.                                                          */
+/*===========================================================================*/
+
+/* The main thread of the test, the first one */
+static thread_t *chHostSelf(void) {
+    if (ch_current == NULL) {
+        chSysInit();
+    }
+
+    return ch_current;
+}
+
+static void chHostQueueInsert(threads_queue_t *tqp, thread_t *tp) {
+    thread_t **pp = &tqp->next;
+
+    while (*pp != NULL && (*pp)->prio >= tp->prio) {
+        pp = &(*pp)->qnext;
+    }
+    tp->qnext = *pp;
+    *pp = tp;
+    tp->queue = tqp;
+}
+
+static void chHostQueueRemove(thread_t *tp) {
+    thread_t **pp;
+
+    if (tp->queue == NULL) {
+        return;
+    }
+
+    for (pp = &tp->queue->next; *pp != NULL; pp = &(*pp)->qnext) {
+        if (*pp == tp) {
+            *pp = tp->qnext;
+            break;
+        }
+    }
+    tp->queue = NULL;
+    tp->qnext = NULL;
+}
+
+static void chHostReady(thread_t *tp, msg_t msg) {
+    chHostQueueRemove(tp);
+    tp->state = CH_STATE_READY;
+    tp->timed = false;
+    tp->ewmask = 0;
+    tp->rdymsg = msg;
+}
+
+static thread_t *chHostHighest(void) {
+    thread_t *best = NULL;
+    unsigned idx;
+
+    for (idx = 0; idx < ch_nthreads; idx++) {
+        thread_t *tp = &ch_threads[idx];
+
+        if (tp->state == CH_STATE_READY && (best == NULL || tp->prio > best->prio)) {
+            best = tp;
+        }
+    }
+
+    return best;
+}
+
+/* Move the system time to the next timer or timeout and fire what is due */
+static bool chHostAdvance(void) {
+    virtual_timer_t *vtp;
+    systime_t next = 0;
+    bool found = false;
+    unsigned idx;
+
+    for (vtp = ch_timers; vtp != NULL; vtp = vtp->next) {
+        if (!found || (systime_t)(vtp->time - ch_now) < (systime_t)(next - ch_now)) {
+            next = vtp->time;
+            found = true;
+        }
+    }
+    for (idx = 0; idx < ch_nthreads; idx++) {
+        thread_t *tp = &ch_threads[idx];
+
+        if (tp->state == CH_STATE_WAITING && tp->timed &&
+                (!found || (systime_t)(tp->wakeup - ch_now) < (systime_t)(next - ch_now))) {
+            next = tp->wakeup;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        return false;
+    }
+    ch_now = next;
+
+    /* Timers first, as the tick interrupt runs them before the threads */
+    for (;;) {
+        virtual_timer_t **pp;
+
+        for (pp = &ch_timers; *pp != NULL && (*pp)->time != ch_now; pp = &(*pp)->next)
+            ;
+        if (*pp == NULL) {
+            break;
+        }
+
+        vtp = *pp;
+        *pp = vtp->next;
+        vtp->func(vtp->par);
+    }
+
+    for (idx = 0; idx < ch_nthreads; idx++) {
+        thread_t *tp = &ch_threads[idx];
+
+        if (tp->state == CH_STATE_WAITING && tp->timed && tp->wakeup == ch_now) {
+            chHostReady(tp, MSG_TIMEOUT);
+        }
+    }
+
+    return true;
+}
+
+static void chHostSwitch(thread_t *otp, thread_t *ntp) {
+    ch_current = ntp;
+    if (otp != ntp) {
+        swapcontext(&otp->ctx, &ntp->ctx);
+    }
+}
+
+/* Give the CPU to the ready thread of highest priority, otp included */
+static void chHostSchedule(void) {
+    thread_t *otp = ch_current;
+    thread_t *ntp;
+
+    while ((ntp = chHostHighest()) == NULL) {
+        if (!chHostAdvance()) {
+            chSysHalt("deadlock, every thread waits forever");
+        }
+    }
+
+    chHostSwitch(otp, ntp);
+}
+
+/* Preempt the current thread if a thread of higher priority is ready */
+static void chHostReschedule(void) {
+    thread_t *ntp = chHostHighest();
+
+    if (ntp != NULL && ntp->prio > ch_current->prio) {
+        chHostSwitch(ch_current, ntp);
+    }
+}
+
+/* The current thread waits until readied, or until timeout */
+static msg_t chHostWait(systime_t timeout) {
+    thread_t *tp = chHostSelf();
+
+    tp->state = CH_STATE_WAITING;
+    tp->timed = timeout != TIME_INFINITE;
+    tp->wakeup = ch_now + timeout;
+    chHostSchedule();
+
+    return tp->rdymsg;
+}
+
+static void chHostEntry(void) {
+    thread_t *tp = ch_current;
+
+    tp->pf(tp->arg);
+
+    /* Thread returned */
+    tp->state = CH_STATE_FINAL;
+    chHostSchedule();
+}
+
+/*===========================================================================*/
+/* Exported functions.                                                       */
+/*===========================================================================*/
+
+void chSysInit(void) {
+    thread_t *tp = &ch_threads[0];
+
+    if (ch_current != NULL) {
+        return;
+    }
+
+    ch_nthreads = 1;
+    tp->name = "main";
+    tp->prio = NORMALPRIO;
+    tp->state = CH_STATE_READY;
+    ch_current = tp;
+}
+
+void chSysHalt(const char *reason) {
+    fprintf(stderr, "halt: %s\n", reason);
+    exit(2);
+}
+
+void chSysLock(void) {
+}
+
+void chSysUnlock(void) {
+}
+
+void chSysLockFromISR(void) {
+}
+
+void chSysUnlockFromISR(void) {
+}
+
+void chSchRescheduleS(void) {
+    (void)chHostSelf();
+    chHostReschedule();
+}
+
+thread_t *chThdCreateStatic(void *wsp, size_t size, tprio_t prio, tfunc_t pf, void *arg) {
+    thread_t *tp;
+
+    (void)chHostSelf();
+    chDbgAssert(ch_nthreads < CH_HOST_THREADS_MAX, "chThdCreateStatic(), too many threads");
+
+    tp = &ch_threads[ch_nthreads++];
+    tp->name = NULL;
+    tp->prio = prio;
+    tp->state = CH_STATE_READY;
+    tp->pf = pf;
+    tp->arg = arg;
+
+    getcontext(&tp->ctx);
+    tp->ctx.uc_stack.ss_sp = wsp;
+    tp->ctx.uc_stack.ss_size = size;
+    tp->ctx.uc_link = NULL;
+    makecontext(&tp->ctx, chHostEntry, 0);
+
+    chHostReschedule();
+
+    return tp;
+}
+
+thread_t *chThdGetSelfX(void) {
+    return chHostSelf();
+}
+
+tprio_t chThdGetPriorityX(void) {
+    return chHostSelf()->prio;
+}
+
+void chRegSetThreadName(const char *name) {
+    chHostSelf()->name = name;
+}
+
+void chThdSleep(systime_t time) {
+    chDbgCheck(time != TIME_IMMEDIATE);
+
+    (void)chHostWait(time);
+}
+
+void chThdSleepMilliseconds(uint32_t msec) {
+    chThdSleep(MS2ST(msec));
+}
+
+void chThdSleepMicroseconds(uint32_t usec) {
+    chThdSleep(US2ST(usec));
+}
+
+void chThdSleepUntil(systime_t time) {
+    if ((systime_t)(time - ch_now) != 0) {
+        chThdSleep(time - ch_now);
+    }
+}
+
+void chThdYield(void) {
+    thread_t *ntp = chHostHighest();
+
+    (void)chHostSelf();
+    if (ntp != NULL && ntp != ch_current && ntp->prio >= ch_current->prio) {
+        chHostSwitch(ch_current, ntp);
+    }
+}
+
+msg_t chThdSuspendS(thread_reference_t *trp) {
+    return chThdSuspendTimeoutS(trp, TIME_INFINITE);
+}
+
+msg_t chThdSuspendTimeoutS(thread_reference_t *trp, systime_t timeout) {
+    thread_t *tp = chHostSelf();
+    msg_t msg;
+
+    chDbgAssert(*trp == NULL, "chThdSuspendTimeoutS(), not NULL");
+
+    if (timeout == TIME_IMMEDIATE) {
+        return MSG_TIMEOUT;
+    }
+
+    *trp = tp;
+    msg = chHostWait(timeout);
+    if (msg == MSG_TIMEOUT && *trp == tp) {
+        *trp = NULL;
+    }
+
+    return msg;
+}
+
+void chThdResumeI(thread_reference_t *trp, msg_t msg) {
+    if (*trp != NULL) {
+        thread_t *tp = *trp;
+
+        *trp = NULL;
+        chHostReady(tp, msg);
+    }
+}
+
+void chThdResumeS(thread_reference_t *trp, msg_t msg) {
+    chThdResumeI(trp, msg);
+    chSchRescheduleS();
+}
+
+void chThdResume(thread_reference_t *trp, msg_t msg) {
+    chThdResumeS(trp, msg);
+}
+
+void chThdQueueObjectInit(threads_queue_t *tqp) {
+    tqp->next = NULL;
+}
+
+msg_t chThdEnqueueTimeoutS(threads_queue_t *tqp, systime_t timeout) {
+    if (timeout == TIME_IMMEDIATE) {
+        return MSG_TIMEOUT;
+    }
+
+    chHostQueueInsert(tqp, chHostSelf());
+
+    return chHostWait(timeout);
+}
+
+void chThdDequeueNextI(threads_queue_t *tqp, msg_t msg) {
+    if (tqp->next != NULL) {
+        chHostReady(tqp->next, msg);
+    }
+}
+
+void chThdDequeueAllI(threads_queue_t *tqp, msg_t msg) {
+    while (tqp->next != NULL) {
+        chHostReady(tqp->next, msg);
+    }
+}
+
+void chMtxObjectInit(mutex_t *mp) {
+    mp->queue.next = NULL;
+    mp->owner = NULL;
+}
+
+/* No priority inheritance, the owner hands the mutex to the first waiter */
+void chMtxLockS(mutex_t *mp) {
+    thread_t *tp = chHostSelf();
+
+    chDbgAssert(mp->owner != tp, "chMtxLockS(), recursive lock");
+
+    if (mp->owner == NULL) {
+        mp->owner = tp;
+        return;
+    }
+
+    chHostQueueInsert(&mp->queue, tp);
+    (void)chHostWait(TIME_INFINITE);
+}
+
+void chMtxLock(mutex_t *mp) {
+    chMtxLockS(mp);
+}
+
+bool chMtxTryLock(mutex_t *mp) {
+    if (mp->owner != NULL) {
+        return false;
+    }
+    mp->owner = chHostSelf();
+
+    return true;
+}
+
+void chMtxUnlockS(mutex_t *mp) {
+    chDbgAssert(mp->owner == chHostSelf(), "chMtxUnlockS(), not owner");
+
+    mp->owner = mp->queue.next;
+    if (mp->owner != NULL) {
+        chHostReady(mp->owner, MSG_OK);
+    }
+}
+
+void chMtxUnlock(mutex_t *mp) {
+    chMtxUnlockS(mp);
+    chHostReschedule();
+}
+
+void chVTObjectInit(virtual_timer_t *vtp) {
+    vtp->func = NULL;
+}
+
+void chVTSetI(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par) {
+    chDbgCheck((delay != TIME_IMMEDIATE) && (delay != TIME_INFINITE));
+
+    chVTResetI(vtp);
+    vtp->time = ch_now + delay;
+    vtp->func = vtfunc;
+    vtp->par = par;
+    vtp->next = ch_timers;
+    ch_timers = vtp;
+}
+
+void chVTSet(virtual_timer_t *vtp, systime_t delay, vtfunc_t vtfunc, void *par) {
+    chVTSetI(vtp, delay, vtfunc, par);
+}
+
+void chVTResetI(virtual_timer_t *vtp) {
+    virtual_timer_t **pp;
+
+    for (pp = &ch_timers; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == vtp) {
+            *pp = vtp->next;
+            break;
+        }
+    }
+    vtp->func = NULL;
+}
+
+void chVTReset(virtual_timer_t *vtp) {
+    chVTResetI(vtp);
+}
+
+bool chVTIsArmedI(virtual_timer_t *vtp) {
+    virtual_timer_t *p;
+
+    for (p = ch_timers; p != NULL; p = p->next) {
+        if (p == vtp) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool chVTIsArmed(virtual_timer_t *vtp) {
+    return chVTIsArmedI(vtp);
+}
+
+systime_t chVTGetSystemTimeX(void) {
+    return ch_now;
+}
+
+systime_t chVTGetSystemTime(void) {
+    return ch_now;
+}
+
+systime_t chVTTimeElapsedSinceX(systime_t start) {
+    return ch_now - start;
+}
+
+bool chVTIsSystemTimeWithinX(systime_t start, systime_t end) {
+    return (systime_t)(ch_now - start) < (systime_t)(end - start);
+}
+
+bool chVTIsSystemTimeWithin(systime_t start, systime_t end) {
+    return chVTIsSystemTimeWithinX(start, end);
+}
+
+void chEvtObjectInit(event_source_t *esp) {
+    esp->next = NULL;
+}
+
+void chEvtRegisterMaskWithFlags(event_source_t *esp, event_listener_t *elp,
+        eventmask_t events, eventflags_t wflags) {
+    elp->next = esp->next;
+    esp->next = elp;
+    elp->listener = chHostSelf();
+    elp->events = events;
+    elp->flags = 0;
+    elp->wflags = wflags;
+}
+
+void chEvtRegisterMask(event_source_t *esp, event_listener_t *elp, eventmask_t events) {
+    chEvtRegisterMaskWithFlags(esp, elp, events, (eventflags_t)-1);
+}
+
+void chEvtUnregister(event_source_t *esp, event_listener_t *elp) {
+    event_listener_t **pp;
+
+    for (pp = &esp->next; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == elp) {
+            *pp = elp->next;
+            break;
+        }
+    }
+}
+
+eventflags_t chEvtGetAndClearFlags(event_listener_t *elp) {
+    eventflags_t flags = elp->flags;
+
+    elp->flags = 0;
+
+    return flags;
+}
+
+eventmask_t chEvtGetAndClearEvents(eventmask_t events) {
+    thread_t *tp = chHostSelf();
+    eventmask_t m = tp->epending & events;
+
+    tp->epending &= ~events;
+
+    return m;
+}
+
+void chEvtSignalI(thread_t *tp, eventmask_t events) {
+    tp->epending |= events;
+    if (tp->state == CH_STATE_WAITING && (tp->epending & tp->ewmask) != 0) {
+        chHostReady(tp, MSG_OK);
+    }
+}
+
+void chEvtSignal(thread_t *tp, eventmask_t events) {
+    chEvtSignalI(tp, events);
+    chSchRescheduleS();
+}
+
+void chEvtBroadcastFlagsI(event_source_t *esp, eventflags_t flags) {
+    event_listener_t *elp;
+
+    for (elp = esp->next; elp != NULL; elp = elp->next) {
+        elp->flags |= flags;
+        if (flags == 0 || (flags & elp->wflags) != 0) {
+            chEvtSignalI(elp->listener, elp->events);
+        }
+    }
+}
+
+void chEvtBroadcastFlags(event_source_t *esp, eventflags_t flags) {
+    chEvtBroadcastFlagsI(esp, flags);
+    chSchRescheduleS();
+}
+
+/* The lowest pending event of events, cleared */
+eventmask_t chEvtWaitAnyTimeout(eventmask_t events, systime_t timeout) {
+    thread_t *tp = chHostSelf();
+    eventmask_t m;
+
+    if ((tp->epending & events) == 0) {
+        if (timeout == TIME_IMMEDIATE) {
+            return 0;
+        }
+        tp->ewmask = events;
+        if (chHostWait(timeout) == MSG_TIMEOUT) {
+            return 0;
+        }
+    }
+
+    m = tp->epending & events;
+    m ^= m & (m - 1);
+    tp->epending &= ~m;
+
+    return m;
+}
+
+eventmask_t chEvtWaitAny(eventmask_t events) {
+    return chEvtWaitAnyTimeout(events, TIME_INFINITE);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "hosttest.h"
+
+
+static unsigned test_checks;
+static unsigned test_failures;
+
+static void hostTestDump(const char *what, const uint8_t *buf, size_t len) {
+    size_t idx;
+
+    fprintf(stderr, "  %s (%u):", what, (unsigned)len);
+    for (idx = 0; idx < len; idx++) {
+        fprintf(stderr, "%s%02x", idx % 24 == 0 ? "\n   " : " ", buf[idx]);
+    }
+    fprintf(stderr, "\n");
+}
+
+void hostTestCheck(int ok, const char *file, int line, const char *expr) {
+    test_checks++;
+    if (!ok) {
+        test_failures++;
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+    }
+}
+
+void hostTestBytes(const uint8_t *got, size_t gotlen, const uint8_t *exp, size_t explen,
+        const char *file, int line) {
+    test_checks++;
+    if (gotlen != explen || memcmp(got, exp, explen) != 0) {
+        test_failures++;
+        fprintf(stderr, "%s:%d: byte stream differs\n", file, line);
+        hostTestDump("expected", exp, explen);
+        hostTestDump("got", got, gotlen);
+    }
+}
+
+/* Exit status of the test */
+int hostTestEnd(const char *name) {
+    printf("%s: %u checks, %u failed\n", name, test_checks, test_failures);
+
+    return test_failures == 0 ? 0 : 1;
+}
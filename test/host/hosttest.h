@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __HOSTTEST_H__
+#define __HOSTTEST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A failed check is reported and counted, the test goes on */
+#define TEST_CHECK(c)               hostTestCheck((c) != 0, __FILE__, __LINE__, #c)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void hostTestCheck(int ok, const char *file, int line, const char *expr);
+void hostTestBytes(const uint8_t *got, size_t gotlen, const uint8_t *exp, size_t explen,
+        const char *file, int line);
+int hostTestEnd(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* The bytes got, gotlen of them, are exactly the explen bytes of exp */
+#define TEST_BYTES(got, gotlen, exp, explen) \
+    hostTestBytes(got, gotlen, exp, explen, __FILE__, __LINE__)
+
+#endif /* __HOSTTEST_H__ */
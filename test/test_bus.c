@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * lcdiic.c on a PCF8574Driver over the host bus model: what a burst costs in
+ * transactions, i2cStart() calls and bus acquisitions with the bus lease,
+ * and what a port mask costs.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+#include "lcdiicport.h"
+#include "hostbus.h"
+#include "hosttest.h"
+
+#define READS                       100
+#define READ_LEN                    8
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config pcfcfg = {
+    &I2CD1,
+    &i2ccfg,
+    PCF8574A_SAD_0X3E,
+    0x00,
+    0x00,
+    MS2ST(20),
+    PCF8574_NOLINE,
+    PCF8574_NOLINE,
+    0,
+};
+
+/* The same module with the backlight pin always high */
+static const PCF8574Config maskcfg = {
+    &I2CD1,
+    &i2ccfg,
+    PCF8574A_SAD_0X3F,
+    0x08,
+    0x00,
+    MS2ST(20),
+    PCF8574_NOLINE,
+    PCF8574_NOLINE,
+    0,
+};
+
+static PCF8574Driver pcf, maskpcf;
+static LCDIICPcf8574Port port, maskport;
+static LCDIICDriver lcd, masklcd;
+static const LCDIICConfig cfg = { (LCDIICPort *)&port };
+static const LCDIICConfig masklcdcfg = { (LCDIICPort *)&maskport };
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+/*
+ * A read of 8 bytes is 18 transactions: the address, one transfer per nibble
+ * and the word ending the read. The address takes one acquisition, the rest
+ * goes under one lease, and the peripheral is never set up again.
+ */
+static void testReadBurst(void) {
+    HostBusStats before;
+    uint8_t buf[READ_LEN];
+    unsigned idx;
+    bool same = true;
+
+    TEST_CHECK(lcdiicDrawText(&lcd, 0, 0, "Readback", READ_LEN) == READ_LEN);
+    TEST_CHECK(lcdiicWaitReady(&lcd, MS2ST(100)) == MSG_OK);
+
+    before = host_bus;
+    for (idx = 0; idx < READS; idx++) {
+        memset(buf, 0x00, sizeof(buf));
+        TEST_CHECK(lcdiicReadBlock(&lcd, 1, 0, buf, READ_LEN) == MSG_OK);
+        same = same && memcmp(buf, "Readback", READ_LEN) == 0;
+    }
+    TEST_CHECK(same);
+
+    TEST_CHECK(host_bus.transactions - before.transactions == 1800);
+    TEST_CHECK(host_bus.starts - before.starts == 0);
+    TEST_CHECK(host_bus.acquisitions - before.acquisitions == 200);
+}
+
+/*
+ * The frames carry the mask from the encoder: a flush with the backlight off
+ * costs the same transactions as without a mask, no bounce buffer chunks,
+ * and the pin stays high.
+ */
+static void testMaskedFrame(HostLcd *lcdp) {
+    HostBusStats before;
+    unsigned long plain;
+
+    lcdiicSetBacklight(&lcd, 0);
+    lcdiicSetBacklight(&masklcd, 0);
+
+    before = host_bus;
+    TEST_CHECK(lcdiicDrawText(&lcd, 1, 0, "Masked frame", 12) == 12);
+    plain = host_bus.transactions - before.transactions;
+
+    before = host_bus;
+    TEST_CHECK(lcdiicDrawText(&masklcd, 1, 0, "Masked frame", 12) == 12);
+    TEST_CHECK(host_bus.transactions - before.transactions == plain);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x40], "Masked frame", 12) == 0);
+    TEST_CHECK(lcdp->latch & 0x08);
+}
+
+int main(void) {
+    HostLcd *lcdp, *masklcdp;
+
+    chSysInit();
+    hostBusObjectInit();
+    lcdp = hostBusAddLcd(PCF8574A_SAD_0X3E);
+    masklcdp = hostBusAddLcd(PCF8574A_SAD_0X3F);
+
+    pcf8574ObjectInit(&pcf);
+    pcf8574Start(&pcf, &pcfcfg);
+    lcdiicPcf8574PortObjectInit(&port, &pcf, &pcfcfg);
+    lcdiicObjectInit(&lcd, delayUs, delayMs);
+    lcdiicStart(&lcd, &cfg);
+    TEST_CHECK(lcdiicWaitReady(&lcd, MS2ST(500)) == MSG_OK);
+    TEST_CHECK(!lcdp->mode8);
+
+    pcf8574ObjectInit(&maskpcf);
+    pcf8574Start(&maskpcf, &maskcfg);
+    lcdiicPcf8574PortObjectInit(&maskport, &maskpcf, &maskcfg);
+    lcdiicObjectInit(&masklcd, delayUs, delayMs);
+    lcdiicStart(&masklcd, &masklcdcfg);
+    TEST_CHECK(lcdiicWaitReady(&masklcd, MS2ST(500)) == MSG_OK);
+
+    testReadBurst();
+    TEST_CHECK(memcmp(lcdp->ddram, "Readback", READ_LEN) == 0);
+    testMaskedFrame(masklcdp);
+
+    return hostTestEnd("test_bus");
+}
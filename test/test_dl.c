@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * lcdiicdl.c running test_dl.lcd, assembled by tools/lcdiicasm at build
+ * time, on the host bus model: the bytecode against a hand encoding, what
+ * each step leaves in the DDRAM and CGRAM and what it costs on the bus, and
+ * the programs the interpreter must stop.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+#include "lcdiicport.h"
+#include "lcdiicdl.h"
+#include "hostbus.h"
+#include "hosttest.h"
+#include "test_dl_lcd.h"
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config pcfcfg = {
+    &I2CD1,
+    &i2ccfg,
+    PCF8574A_SAD_0X3E,
+    0x00,
+    0x00,
+    MS2ST(20),
+    PCF8574_NOLINE,
+    PCF8574_NOLINE,
+    0,
+};
+
+static PCF8574Driver pcf;
+static LCDIICPcf8574Port port;
+static LCDIICDriver lcd;
+static const LCDIICConfig cfg = { (LCDIICPort *)&port };
+
+static const char *fields[LCDIIC_DL_FIELDS];
+
+static const uint8_t box[8] = { 0x1f, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1f };
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+static const char *field(void *arg, uint8_t idx) {
+    (void)arg;
+    return fields[idx];
+}
+
+/* test_dl.lcd encoded by hand, jump targets low byte first */
+static void testAssembler(void) {
+    static const uint8_t exp[] = {
+        LCDIIC_DL_GLYPH, 0, 0,
+        LCDIIC_DL_MOVE, 0, 0,
+        LCDIIC_DL_TEXT, 0,
+        LCDIIC_DL_MOVE, 0, 10,
+        LCDIIC_DL_FIELD, 0, 4,
+        LCDIIC_DL_WAIT, 10, 0,
+        /* loop: 17 */
+        LCDIIC_DL_JCHG, 9, 27, 0,
+        LCDIIC_DL_WAIT, 300 & 0xff, 300 >> 8,
+        LCDIIC_DL_JMP, 17, 0,
+        /* redraw: 27 */
+        LCDIIC_DL_MOVE, 1, 0,
+        LCDIIC_DL_FIELD, 9, 6,
+        LCDIIC_DL_WAIT, 10, 0,
+        LCDIIC_DL_JMP, 17, 0,
+    };
+
+    TEST_BYTES(test_dl.code, test_dl.size, exp, sizeof(exp));
+    TEST_CHECK(test_dl.ntexts == 1 && strcmp(test_dl.texts[0], "Up:") == 0);
+    TEST_CHECK(test_dl.nglyphs == 1 && memcmp(test_dl.glyphs[0], box, 8) == 0);
+}
+
+static void testRun(HostLcd *lcdp) {
+    LCDIICDisplayList dl;
+    unsigned long mark;
+    uint32_t ms;
+
+    fields[0] = "ab";
+    fields[9] = "12:00";
+    lcdiicDlObjectInit(&dl, &lcd, &test_dl, field, NULL);
+
+    /* The first step draws the title, field 0 padded and the glyph */
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 10);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x00], "Up:", 3) == 0);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x0a], "ab  ", 4) == 0);
+    TEST_CHECK(memcmp(lcdp->pattern, box, 8) == 0);
+
+    /* Field 9 was never seen, then it is unchanged and the step is silent */
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 10);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x40], "12:00 ", 6) == 0);
+    mark = host_bus.transactions;
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 300);
+    TEST_CHECK(host_bus.transactions == mark);
+
+    /* Same sum as "12:00" for an 8-bit rotate-xor */
+    fields[9] = "12:12";
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 10);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x40], "12:12 ", 6) == 0);
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 300);
+
+    /* Cut to the width of the field */
+    fields[9] = "1234567";
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 10);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x40], "123456", 6) == 0);
+    TEST_CHECK(lcdp->ddram[0x46] == ' ');
+}
+
+/* Each program is stopped, and the steps after it end right away */
+static void testStop(void) {
+    static const uint8_t text[] = { LCDIIC_DL_TEXT, 1 };
+    static const uint8_t jchg[] = { LCDIIC_DL_JCHG, LCDIIC_DL_FIELDS, 0, 0 };
+    static const uint8_t cut[] = { LCDIIC_DL_MOVE, 0 };
+    static const uint8_t spin[] = { LCDIIC_DL_JMP, 0, 0 };
+    static const uint8_t end[] = { LCDIIC_DL_WAIT, 1, 0, LCDIIC_DL_END };
+    static const LCDIICProgram progs[] = {
+        { text, sizeof(text), test_dl_texts, 1, NULL, 0 },
+        { jchg, sizeof(jchg), NULL, 0, NULL, 0 },
+        { cut, sizeof(cut), NULL, 0, NULL, 0 },
+        { spin, sizeof(spin), NULL, 0, NULL, 0 },
+    };
+    LCDIICDisplayList dl;
+    unsigned idx;
+    uint32_t ms;
+
+    for (idx = 0; idx < sizeof(progs) / sizeof(progs[0]); idx++) {
+        lcdiicDlObjectInit(&dl, &lcd, &progs[idx], NULL, NULL);
+        TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_RESET && ms == 0);
+        TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_RESET);
+    }
+
+    lcdiicDlObjectInit(&dl, &lcd, &(const LCDIICProgram){ end, sizeof(end), NULL, 0, NULL, 0 },
+            NULL, NULL);
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_OK && ms == 1);
+    TEST_CHECK(lcdiicDlStep(&dl, &ms) == MSG_RESET);
+}
+
+int main(void) {
+    HostLcd *lcdp;
+
+    chSysInit();
+    hostBusObjectInit();
+    lcdp = hostBusAddLcd(PCF8574A_SAD_0X3E);
+
+    pcf8574ObjectInit(&pcf);
+    pcf8574Start(&pcf, &pcfcfg);
+    lcdiicPcf8574PortObjectInit(&port, &pcf, &pcfcfg);
+    lcdiicObjectInit(&lcd, delayUs, delayMs);
+    lcdiicStart(&lcd, &cfg);
+    TEST_CHECK(lcdiicWaitReady(&lcd, MS2ST(500)) == MSG_OK);
+
+    testAssembler();
+    testRun(lcdp);
+    testStop();
+
+    return hostTestEnd("test_dl");
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * lcdiic.hpp and lcdiic_layout.hpp built with the host g++: the frames the
+ * compiler encodes, then Lcd<Pcf8574> on a PCF8574Driver over the host bus
+ * model, checked against the DDRAM of the modelled HD44780.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.hpp"
+#include "lcdiic_layout.hpp"
+#include "hostbus.h"
+#include "hosttest.h"
+
+using namespace lcdiic;
+
+/* Every member of the driver compiles, not only the ones called below */
+template class lcdiic::Lcd<Pcf8574>;
+
+static constexpr auto banner = textFrame<Geometry1602, PinMapPcf8574T>(1, 2, "Hi!");
+
+/* The address then 3 characters, 6 bytes each, backlight in every byte */
+static_assert(banner.size == 24, "banner size");
+static_assert(banner.data[0] == (0x08 | 0xc0), "DDRAM 0x42, high nibble");
+static_assert(banner.data[1] == (0x08 | 0xc0 | 0x04), "EN high");
+static_assert(banner.data[3] == (0x08 | 0x20), "DDRAM 0x42, low nibble");
+static_assert(banner.data[6] == (0x08 | 0x01 | 0x40), "'H' high nibble, RS");
+
+/* Text past the last column is dropped */
+static constexpr auto cut = textFrame<Geometry1602, PinMapPcf8574T>(0, 14, "abcd");
+static_assert(cut.size == 18, "cut at the end of the row");
+
+static constexpr Label labels[] = { { 0, 0, "Tick:" }, { 1, 0, "ID:" } };
+static constexpr Field fields[] = { { 0, 6, 10 }, { 1, 4, 12 } };
+static constexpr auto screen = layout<Geometry1602, PinMapPcf8574T>(labels, fields);
+
+/* Per row an address and 16 cells */
+static_assert(screen.paint.size == 2 * 6 * 17, "paint size");
+static_assert(screen.fields[0].addr == 0x06 && screen.fields[0].width == 10, "field 0");
+static_assert(screen.fields[1].addr == 0x44 && screen.fields[1].width == 12, "field 1");
+
+static_assert(Geometry2004::address(2, 0) == 0x14 && Geometry2004::address(3, 19) == 0x67,
+        "rows 2 and 3 continue rows 0 and 1");
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config pcfcfg = {
+    &I2CD1,
+    &i2ccfg,
+    PCF8574A_SAD_0X3E,
+    0x00,
+    0x00,
+    MS2ST(20),
+    PCF8574_NOLINE,
+    PCF8574_NOLINE,
+    0,
+};
+
+/* P3 held high: the backlight stays on whatever the frames say */
+static const PCF8574Config maskcfg = {
+    &I2CD1,
+    &i2ccfg,
+    PCF8574A_SAD_0X3F,
+    0x08,
+    0x00,
+    MS2ST(20),
+    PCF8574_NOLINE,
+    PCF8574_NOLINE,
+    0,
+};
+
+static PCF8574Driver pcf, maskpcf;
+
+static void testMask(void) {
+    HostLcd *lcdp = hostBusAddLcd(PCF8574A_SAD_0X3F);
+
+    pcf8574ObjectInit(&maskpcf);
+    pcf8574Start(&maskpcf, &maskcfg);
+
+    Pcf8574 ex(maskpcf);
+    Lcd<Pcf8574> lcd(ex);
+
+    TEST_CHECK(lcd.start());
+    TEST_CHECK(lcd.setBacklight(false));
+    TEST_CHECK(lcdp->latch & 0x08);
+    TEST_CHECK(lcd.drawText(0, 0, "On", 2) == 2);
+    TEST_CHECK(lcdp->latch & 0x08);
+    TEST_CHECK(memcmp(lcdp->ddram, "On", 2) == 0);
+}
+
+/* Passes every frame on but fails the one numbered fail */
+class Flaky {
+public:
+    explicit Flaky(Pcf8574 &ex) : ex(ex), sent(0), fail(~0u) {}
+
+    bool send(const uint8_t *buf, size_t len) {
+        return ex.send(buf, len) && sent++ != fail;
+    }
+
+    Pcf8574 &ex;
+    unsigned sent, fail;
+};
+
+static void testFlaky(void) {
+    Pcf8574 ex(pcf);
+    Flaky flaky(ex);
+    Lcd<Flaky> lcd(flaky);
+
+    /* A full row spans more than one frame, losing the first is an error */
+    flaky.fail = flaky.sent;
+    TEST_CHECK(lcd.drawText(0, 0, "0123456789abcdef", 16) == 0);
+    TEST_CHECK(flaky.sent - flaky.fail == 3);
+    flaky.fail = flaky.sent;
+    TEST_CHECK(!lcd.writeAt(0x40, 16, "x", 1));
+
+    /* The error is not carried over to the next call */
+    TEST_CHECK(lcd.drawText(0, 0, "0123456789abcdef", 16) == 16);
+    TEST_CHECK(lcd.writeAt(0x40, 16, "x", 1));
+}
+
+int main(void) {
+    HostLcd *lcdp;
+    unsigned long mark;
+
+    chSysInit();
+    hostBusObjectInit();
+    lcdp = hostBusAddLcd(PCF8574A_SAD_0X3E);
+
+    pcf8574ObjectInit(&pcf);
+    pcf8574Start(&pcf, &pcfcfg);
+
+    Pcf8574 ex(pcf);
+    Lcd<Pcf8574> lcd(ex);
+
+    TEST_CHECK(lcd.start());
+    TEST_CHECK(!lcdp->mode8);
+
+    /* A prebuilt frame is one transaction */
+    mark = host_bus.transactions;
+    TEST_CHECK(lcd.send(banner));
+    TEST_CHECK(host_bus.transactions - mark == 1);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x42], "Hi!", 3) == 0);
+
+    TEST_CHECK(lcd.drawText(0, 14, "xyz", 3) == 2);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x0e], "xy", 2) == 0);
+
+    TEST_CHECK(lcd.send(screen.paint));
+    TEST_CHECK(memcmp(&lcdp->ddram[0x00], "Tick:           ", 16) == 0);
+    TEST_CHECK(memcmp(&lcdp->ddram[0x40], "ID:             ", 16) == 0);
+
+    /* Only the field goes out, padded to its width */
+    lcdp->ddram[0x10] = '#';
+    TEST_CHECK(drawField(lcd, screen, 0, "123", 3));
+    TEST_CHECK(memcmp(&lcdp->ddram[0x00], "Tick: 123       ", 16) == 0);
+    TEST_CHECK(lcdp->ddram[0x10] == '#');
+    TEST_CHECK(!drawField(lcd, screen, 2, "x", 1));
+
+    testFlaky();
+    testMask();
+
+    return hostTestEnd("test_hpp");
+}
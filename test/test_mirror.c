@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * A mirror group of two displays on the host bus model, lcdiic.c built with
+ * LCDIIC_USE_MIRROR and LCDIIC_USE_POWER: the group stays in sync across
+ * updates, a member powered off holds the group writes back until it wakes,
+ * and an update sending nothing does not tell the listeners a flush happened.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+#include "lcdiicport.h"
+#include "hostbus.h"
+#include "hosttest.h"
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config pcfcfg[2] = {
+    {
+        &I2CD1,
+        &i2ccfg,
+        PCF8574A_SAD_0X3E,
+        0x00,
+        0x00,
+        MS2ST(20),
+        PCF8574_NOLINE,
+        PCF8574_NOLINE,
+        0,
+    },
+    {
+        &I2CD1,
+        &i2ccfg,
+        PCF8574A_SAD_0X3F,
+        0x00,
+        0x00,
+        MS2ST(20),
+        PCF8574_NOLINE,
+        PCF8574_NOLINE,
+        0,
+    },
+};
+
+static PCF8574Driver pcf[2];
+static LCDIICPcf8574Port port[2];
+static LCDIICDriver lcd[2];
+static LCDIICMirror mirror;
+
+/* The second display goes off after 1 s without activity, group writes
+ * included */
+static const LCDIICConfig cfg[2] = {
+    { (LCDIICPort *)&port[0], { 0, 0, 0 }, 0 },
+    { (LCDIICPort *)&port[1], { 0, 0, 1 }, 1 },
+};
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+int main(void) {
+    event_listener_t el[2];
+    HostBusStats before;
+    HostLcd *lcdp[2];
+    unsigned idx;
+
+    chSysInit();
+    hostBusObjectInit();
+    lcdiicMirrorObjectInit(&mirror);
+
+    for (idx = 0; idx < 2; idx++) {
+        lcdp[idx] = hostBusAddLcd(pcfcfg[idx].sad);
+        pcf8574ObjectInit(&pcf[idx]);
+        pcf8574Start(&pcf[idx], &pcfcfg[idx]);
+        lcdiicPcf8574PortObjectInit(&port[idx], &pcf[idx], &pcfcfg[idx]);
+        lcdiicObjectInit(&lcd[idx], delayUs, delayMs);
+        lcdiicStart(&lcd[idx], &cfg[idx]);
+        TEST_CHECK(lcdiicWaitReady(&lcd[idx], MS2ST(500)) == MSG_OK);
+        lcdiicMirrorAdd(&mirror, &lcd[idx]);
+        chEvtRegisterMaskWithFlags(lcdiicGetEventSource(&lcd[idx]), &el[idx], EVENT_MASK(idx),
+                LCDIIC_EVT_FLUSHED);
+    }
+
+    TEST_CHECK(lcdiicMirrorDrawText(&mirror, 0, 0, "AB", 2) == 2);
+    TEST_CHECK(memcmp(lcdp[0]->ddram, "AB", 2) == 0 && memcmp(lcdp[1]->ddram, "AB", 2) == 0);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[0]) & LCDIIC_EVT_FLUSHED);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[1]) & LCDIIC_EVT_FLUSHED);
+
+    /* Still in sync, the next update is one group write again */
+    before = host_bus;
+    TEST_CHECK(lcdiicMirrorDrawText(&mirror, 0, 0, "AC", 2) == 2);
+    TEST_CHECK(host_bus.acquisitions - before.acquisitions == 1);
+    TEST_CHECK(memcmp(lcdp[0]->ddram, "AC", 2) == 0 && memcmp(lcdp[1]->ddram, "AC", 2) == 0);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[0]) & LCDIIC_EVT_FLUSHED);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[1]) & LCDIIC_EVT_FLUSHED);
+
+    /* Nothing changed, nothing flushed */
+    TEST_CHECK(lcdiicMirrorDrawText(&mirror, 0, 0, "AC", 2) == 2);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[0]) == 0);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[1]) == 0);
+
+    /*
+     * The display powered off keeps the old text, the other one shows the
+     * new. That one is switched off by hand, its backlight too: the members
+     * differ in nothing but the power stage.
+     */
+    chThdSleepMilliseconds(1500);
+    lcdiicSetBacklight(&lcd[0], 0);
+    lcdiicSetDisplay(&lcd[0], 0, 0, 0);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_ACTIVE);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[1]) == LCDIIC_POWER_OFF);
+    chEvtGetAndClearFlags(&el[0]);
+    chEvtGetAndClearFlags(&el[1]);
+    TEST_CHECK(lcdiicMirrorDrawText(&mirror, 0, 0, "CD", 2) == 2);
+    TEST_CHECK(memcmp(lcdp[0]->ddram, "CD", 2) == 0);
+    TEST_CHECK(memcmp(lcdp[1]->ddram, "AC", 2) == 0);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[0]) & LCDIIC_EVT_FLUSHED);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[1]) == 0);
+
+    /* Held writes go out on wake, then both members get the next update */
+    lcdiicPowerActivity(&lcd[1]);
+    TEST_CHECK(memcmp(lcdp[1]->ddram, "CD", 2) == 0);
+    chEvtGetAndClearFlags(&el[1]);
+    TEST_CHECK(lcdiicMirrorDrawText(&mirror, 1, 0, "EF", 2) == 2);
+    TEST_CHECK(memcmp(&lcdp[0]->ddram[0x40], "EF", 2) == 0);
+    TEST_CHECK(memcmp(&lcdp[1]->ddram[0x40], "EF", 2) == 0);
+    TEST_CHECK(chEvtGetAndClearFlags(&el[1]) & LCDIIC_EVT_FLUSHED);
+
+    return hostTestEnd("test_mirror");
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * lcdiic.c driven through the mock port: the port words written for text,
+ * CGRAM patterns, the backlight and a wide port, against the HD44780 write
+ * cycles encoded here independently of the driver.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "lcdiic.h"
+#include "lcdiicmock.h"
+#include "hosttest.h"
+
+#define RS                          LCDIIC_PORT_RS
+#define EN                          LCDIIC_PORT_EN
+#define BL                          LCDIIC_PORT_BL
+
+static LCDIICMockPort port, wport;
+static LCDIICDriver lcd, wlcd;
+static uint8_t wire[1024], wwire[1024];
+
+static const LCDIICConfig cfg = { (LCDIICPort *)&port };
+static const LCDIICConfig wcfg = { (LCDIICPort *)&wport };
+
+static const uint8_t pattern[8] = { 0x1f, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1f };
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+/* 4-bit interface: D7..D4 then D3..D0, each latched by EN high then low */
+static size_t write4(uint8_t *buf, uint8_t ctl, uint8_t val) {
+    uint8_t hi = val & 0xf0, lo = (uint8_t)(val << 4);
+    uint8_t cycle[6] = { hi | ctl, hi | ctl | EN, hi | ctl, lo | ctl, lo | ctl | EN, lo | ctl };
+
+    memcpy(buf, cycle, sizeof(cycle));
+
+    return sizeof(cycle);
+}
+
+/* Wide port words: control then D7..D0, a setup word first when RS changes */
+static size_t write8(uint8_t *buf, uint8_t ctl, uint8_t val, bool setup) {
+    size_t n = 0;
+
+    if (setup) {
+        buf[n++] = ctl;
+        buf[n++] = val;
+    }
+    buf[n++] = ctl | EN;
+    buf[n++] = val;
+    buf[n++] = ctl;
+    buf[n++] = val;
+
+    return n;
+}
+
+/* Bytes the mock logged since mark */
+#define WIRE_CHECK(p, log, mark, exp, explen) \
+    TEST_BYTES(&(log)[mark], (p)->len - (mark), exp, explen)
+
+static void testText(void) {
+    uint8_t exp[64];
+    size_t mark, n;
+
+    /* The cursor is home after the init, no address needed */
+    mark = port.len;
+    TEST_CHECK(lcdiicDrawText(&lcd, 0, 0, "Hi", 2) == 2);
+    n = write4(exp, RS | BL, 'H');
+    n += write4(&exp[n], RS | BL, 'i');
+    WIRE_CHECK(&port, wire, mark, exp, n);
+
+    /* Elsewhere: LCD_CMD_SET_DDRAM_ADDR first */
+    mark = port.len;
+    TEST_CHECK(lcdiicDrawText(&lcd, 1, 3, "x", 1) == 1);
+    n = write4(exp, BL, LCD_CMD_SET_DDRAM_ADDR | 0x43);
+    n += write4(&exp[n], RS | BL, 'x');
+    WIRE_CHECK(&port, wire, mark, exp, n);
+
+    /* Unchanged cells are not sent again, the cursor still ends after them */
+    mark = port.len;
+    TEST_CHECK(lcdiicDrawText(&lcd, 0, 0, "Hi", 2) == 2);
+    n = write4(exp, BL, LCD_CMD_SET_DDRAM_ADDR | 0x02);
+    WIRE_CHECK(&port, wire, mark, exp, n);
+}
+
+static void testPattern(void) {
+    uint8_t exp[128];
+    size_t mark, n;
+    uint8_t idx;
+
+    mark = port.len;
+    lcdiicUpdatePattern(&lcd, 2, pattern);
+    n = write4(exp, BL, LCD_CMD_SET_CGRAM_ADDR | (2 << 3));
+    for (idx = 0; idx < 8; idx++) {
+        n += write4(&exp[n], RS | BL, pattern[idx]);
+    }
+    WIRE_CHECK(&port, wire, mark, exp, n);
+
+    /* The address counter is left in CGRAM, the next text moves it back */
+    mark = port.len;
+    TEST_CHECK(lcdiicDrawText(&lcd, 0, 5, "\x02", 1) == 1);
+    n = write4(exp, BL, LCD_CMD_SET_DDRAM_ADDR | 0x05);
+    n += write4(&exp[n], RS | BL, 0x02);
+    WIRE_CHECK(&port, wire, mark, exp, n);
+}
+
+static void testBacklight(void) {
+    uint8_t exp[64];
+    uint8_t latch = port.latch;
+    size_t mark, n;
+
+    /* One port write within LCDIIC_BACKLIGHT_LATENCY, only BL changes */
+    mark = port.len;
+    lcdiicSetBacklight(&lcd, 0);
+    chThdSleepMilliseconds(LCDIIC_BACKLIGHT_LATENCY + 1);
+    exp[0] = latch & ~BL;
+    WIRE_CHECK(&port, wire, mark, exp, 1);
+
+    /* Later writes keep it off */
+    mark = port.len;
+    TEST_CHECK(lcdiicDrawText(&lcd, 0, 6, "y", 1) == 1);
+    n = write4(exp, RS, 'y');
+    WIRE_CHECK(&port, wire, mark, exp, n);
+
+    mark = port.len;
+    latch = port.latch;
+    lcdiicSetBacklight(&lcd, 1);
+    chThdSleepMilliseconds(LCDIIC_BACKLIGHT_LATENCY + 1);
+    exp[0] = latch | BL;
+    WIRE_CHECK(&port, wire, mark, exp, 1);
+}
+
+static void testWide(void) {
+    uint8_t exp[64];
+    size_t mark, n;
+
+    lcdiicMockPortObjectInit(&wport, 1, wwire, sizeof(wwire), NULL, NULL);
+    lcdiicObjectInit(&wlcd, delayUs, delayMs);
+    lcdiicStart(&wlcd, &wcfg);
+    TEST_CHECK(lcdiicWaitReady(&wlcd, MS2ST(500)) == MSG_OK);
+
+    /* 8-bit interface, one word per byte and RS set up before EN rises */
+    mark = wport.len;
+    TEST_CHECK(lcdiicDrawText(&wlcd, 0, 0, "AB", 2) == 2);
+    n = write8(exp, RS | BL, 'A', true);
+    n += write8(&exp[n], RS | BL, 'B', false);
+    WIRE_CHECK(&wport, wwire, mark, exp, n);
+
+    mark = wport.len;
+    TEST_CHECK(lcdiicDrawText(&wlcd, 1, 0, "C", 1) == 1);
+    n = write8(exp, BL, LCD_CMD_SET_DDRAM_ADDR | 0x40, true);
+    n += write8(&exp[n], RS | BL, 'C', true);
+    WIRE_CHECK(&wport, wwire, mark, exp, n);
+}
+
+static void testFailure(void) {
+    /* A port error takes the display offline, nothing more is written */
+    port.result = MSG_RESET;
+    lcdiicDrawText(&lcd, 1, 0, "z", 1);
+    TEST_CHECK(lcd.state == LCDIIC_OFFLINE);
+    port.result = MSG_OK;
+}
+
+int main(void) {
+    chSysInit();
+
+    lcdiicMockPortObjectInit(&port, 0, wire, sizeof(wire), NULL, NULL);
+    lcdiicObjectInit(&lcd, delayUs, delayMs);
+    lcdiicStart(&lcd, &cfg);
+    TEST_CHECK(lcdiicWaitReady(&lcd, MS2ST(500)) == MSG_OK);
+    TEST_CHECK(port.len < sizeof(wire));
+
+    testText();
+    testPattern();
+    testBacklight();
+    testWide();
+    testFailure();
+
+    return hostTestEnd("test_mock");
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The power manager of lcdiic.c, built with LCDIIC_USE_POWER, on the host bus
+ * model: content changes restart the idle time and wake a display powered
+ * off, unless its config sets keepidle, and writes changing nothing do not.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+#include "lcdiicport.h"
+#include "hostbus.h"
+#include "hosttest.h"
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config pcfcfg[2] = {
+    {
+        &I2CD1,
+        &i2ccfg,
+        PCF8574A_SAD_0X3E,
+        0x00,
+        0x00,
+        MS2ST(20),
+        PCF8574_NOLINE,
+        PCF8574_NOLINE,
+        0,
+    },
+    {
+        &I2CD1,
+        &i2ccfg,
+        PCF8574A_SAD_0X3F,
+        0x00,
+        0x00,
+        MS2ST(20),
+        PCF8574_NOLINE,
+        PCF8574_NOLINE,
+        0,
+    },
+};
+
+static PCF8574Driver pcf[2];
+static LCDIICPcf8574Port port[2];
+static LCDIICDriver lcd[2];
+
+/* Both go off after 1 s without activity, the second one keeps ticking */
+static const LCDIICConfig cfg[2] = {
+    { (LCDIICPort *)&port[0], { 0, 0, 1 }, 0 },
+    { (LCDIICPort *)&port[1], { 0, 0, 1 }, 1 },
+};
+
+static const uint8_t box[8] = { 0x1f, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x1f };
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+int main(void) {
+    static const char *ticks[] = { "00:01", "00:02", "00:03", "00:04" };
+    HostLcd *lcdp[2];
+    unsigned idx;
+
+    chSysInit();
+    hostBusObjectInit();
+
+    for (idx = 0; idx < 2; idx++) {
+        lcdp[idx] = hostBusAddLcd(pcfcfg[idx].sad);
+        pcf8574ObjectInit(&pcf[idx]);
+        pcf8574Start(&pcf[idx], &pcfcfg[idx]);
+        lcdiicPcf8574PortObjectInit(&port[idx], &pcf[idx], &pcfcfg[idx]);
+        lcdiicObjectInit(&lcd[idx], delayUs, delayMs);
+        lcdiicStart(&lcd[idx], &cfg[idx]);
+        TEST_CHECK(lcdiicWaitReady(&lcd[idx], MS2ST(500)) == MSG_OK);
+    }
+
+    /* A clock ticking: the first display stays on, the second one goes off */
+    for (idx = 0; idx < 4; idx++) {
+        chThdSleepMilliseconds(600);
+        TEST_CHECK(lcdiicDrawText(&lcd[0], 0, 0, ticks[idx], 5) == 5);
+        TEST_CHECK(lcdiicDrawText(&lcd[1], 0, 0, ticks[idx], 5) == 5);
+    }
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_ACTIVE);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[1]) == LCDIIC_POWER_OFF);
+    TEST_CHECK(memcmp(lcdp[0]->ddram, "00:04", 5) == 0);
+    TEST_CHECK(memcmp(lcdp[1]->ddram, "00:04", 5) != 0);
+
+    /* The same text again is no activity */
+    for (idx = 0; idx < 2; idx++) {
+        chThdSleepMilliseconds(600);
+        TEST_CHECK(lcdiicDrawText(&lcd[0], 0, 0, "00:04", 5) == 5);
+    }
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_OFF);
+
+    /* New text wakes it at once, so does a new pattern */
+    TEST_CHECK(lcdiicDrawText(&lcd[0], 1, 0, "Up", 2) == 2);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_ACTIVE);
+    TEST_CHECK(memcmp(&lcdp[0]->ddram[0x40], "Up", 2) == 0);
+    chThdSleepMilliseconds(1500);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_OFF);
+    lcdiicUpdatePattern(&lcd[0], 0, box);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_ACTIVE);
+    TEST_CHECK(memcmp(lcdp[0]->pattern, box, 8) == 0);
+
+    /* In a batch, the wake waits for its end */
+    chThdSleepMilliseconds(1500);
+    lcdiicBatchBegin(&lcd[0]);
+    TEST_CHECK(lcdiicDrawText(&lcd[0], 0, 0, "00:05", 5) == 5);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_OFF);
+    TEST_CHECK(lcdiicBatchEnd(&lcd[0]) == MSG_OK);
+    TEST_CHECK(lcdiicPowerGetStage(&lcd[0]) == LCDIIC_POWER_ACTIVE);
+    TEST_CHECK(memcmp(lcdp[0]->ddram, "00:05", 5) == 0);
+
+    return hostTestEnd("test_power");
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The background worker of lcdiic.c, built with LCDIIC_USE_BACKGROUND and
+ * the other options of OPTDEFS, on the host bus model: it keeps off a bus
+ * held by another thread, each of its bus acquisitions is a single
+ * transaction, and a corrupted cell is found and rewritten within a period.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+#include "lcdiicport.h"
+#include "hostbus.h"
+#include "hosttest.h"
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config pcfcfg = {
+    &I2CD1,
+    &i2ccfg,
+    PCF8574A_SAD_0X3E,
+    0x00,
+    0x00,
+    MS2ST(20),
+    PCF8574_NOLINE,
+    PCF8574_NOLINE,
+    0,
+};
+
+static PCF8574Driver pcf;
+static LCDIICPcf8574Port port;
+static LCDIICDriver lcd;
+/* Never powered down */
+static const LCDIICConfig cfg = { (LCDIICPort *)&port, { 0, 0, 0 }, 0 };
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+int main(void) {
+    LCDIICBackgroundStats stats;
+    HostBusStats before;
+    HostLcd *lcdp;
+
+    chSysInit();
+    hostBusObjectInit();
+    lcdp = hostBusAddLcd(PCF8574A_SAD_0X3E);
+
+    pcf8574ObjectInit(&pcf);
+    pcf8574Start(&pcf, &pcfcfg);
+    lcdiicPcf8574PortObjectInit(&port, &pcf, &pcfcfg);
+    lcdiicObjectInit(&lcd, delayUs, delayMs);
+    lcdiicStart(&lcd, &cfg);
+    TEST_CHECK(lcdiicWaitReady(&lcd, MS2ST(500)) == MSG_OK);
+
+    TEST_CHECK(lcdiicDrawText(&lcd, 0, 0, "Scrub", 5) == 5);
+    lcdp->ddram[3] = '#';
+
+    /* Not a single transaction while another thread holds the bus */
+    i2cAcquireBus(&I2CD1);
+    TEST_CHECK(pcf8574BusBusy(&pcf));
+    i2cReleaseBus(&I2CD1);
+    TEST_CHECK(!pcf8574BusBusy(&pcf));
+
+    i2cAcquireBus(&I2CD1);
+    before = host_bus;
+    chThdSleepMilliseconds(3 * LCDIIC_BACKGROUND_PERIOD);
+    TEST_CHECK(host_bus.transactions == before.transactions);
+    i2cReleaseBus(&I2CD1);
+
+    lcdiicGetBackgroundStats(&lcd, &stats);
+    TEST_CHECK(stats.repaired == 0 && stats.bgbytes == 0);
+
+    /* The next period reads cells 0 to 3, one acquisition per transaction */
+    before = host_bus;
+    chThdSleepMilliseconds(LCDIIC_BACKGROUND_PERIOD);
+    TEST_CHECK(host_bus.transactions > before.transactions);
+    TEST_CHECK(host_bus.acquisitions - before.acquisitions ==
+            host_bus.transactions - before.transactions);
+
+    lcdiicGetBackgroundStats(&lcd, &stats);
+    TEST_CHECK(stats.repaired == 1 && stats.bgbytes > 0);
+    TEST_CHECK(memcmp(lcdp->ddram, "Scrub", 5) == 0);
+
+    return hostTestEnd("test_scrub");
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Warm and cold starts on the host bus model: lcdiicStart() leaves the bus
+ * to the service thread, a controller that kept its power and its 4-bit
+ * mode is ready within a few milliseconds, its DDRAM is adopted afterwards.
+ */
+
+#include <string.h>
+
+#include "hal.h"
+#include "pcf8574.h"
+#include "lcdiic.h"
+#include "lcdiicport.h"
+#include "hostbus.h"
+#include "hosttest.h"
+
+static const I2CConfig i2ccfg = { 0x00, 0x00, 0x00 };
+
+static const PCF8574Config warmcfg = {
+    &I2CD1, &i2ccfg, PCF8574A_SAD_0X3E, 0x00, 0x00, MS2ST(20),
+    PCF8574_NOLINE, PCF8574_NOLINE, 0,
+};
+
+static const PCF8574Config coldcfg = {
+    &I2CD1, &i2ccfg, PCF8574A_SAD_0X3F, 0x00, 0x00, MS2ST(20),
+    PCF8574_NOLINE, PCF8574_NOLINE, 0,
+};
+
+static PCF8574Driver warmpcf, coldpcf;
+static LCDIICPcf8574Port warmport, coldport;
+static LCDIICDriver warm, cold;
+static const LCDIICConfig warmlcd = { (LCDIICPort *)&warmport };
+static const LCDIICConfig coldlcd = { (LCDIICPort *)&coldport };
+
+static HostLcd *warmp, *coldp;
+static volatile bool done;
+static THD_WORKING_AREA(waTest, 1024);
+
+static void delayUs(uint32_t us) {
+    (void)us;
+}
+
+static void delayMs(uint32_t ms) {
+    chThdSleepMilliseconds(ms);
+}
+
+static void testWarm(void) {
+    unsigned long mark;
+    systime_t start;
+
+    /* Left by the previous run: 4-bit mode, between the two nibbles of an
+     * instruction, old text on the glass */
+    warmp->mode8 = false;
+    warmp->phase = true;
+    warmp->latch = 0x08;
+    memcpy(warmp->ddram, "Kept X", 6);
+
+    /* Above the service thread: nothing is sent before lcdiicStart() returns */
+    mark = host_bus.transactions;
+    start = chVTGetSystemTime();
+    lcdiicStart(&warm, &warmlcd);
+    TEST_CHECK(host_bus.transactions == mark);
+    TEST_CHECK(warm.state == LCDIIC_INIT);
+
+    /* Written before the panel is ready: sent once it is, and a blank over a
+     * cell not read back yet is sent too */
+    TEST_CHECK(lcdiicDrawText(&warm, 1, 0, "New", 3) == 3);
+    TEST_CHECK(lcdiicDrawText(&warm, 0, 5, " ", 1) == 1);
+
+    TEST_CHECK(lcdiicWaitReady(&warm, MS2ST(5)) == MSG_OK);
+    TEST_CHECK(chVTTimeElapsedSinceX(start) <= MS2ST(5));
+    TEST_CHECK(warmp->mode8 == false);
+    TEST_CHECK(memcmp(&warmp->ddram[0x40], "New", 3) == 0);
+    TEST_CHECK(memcmp(warmp->ddram, "Kept  ", 6) == 0);
+
+    /* Adopted in the background: the shadow holds the glass */
+    chThdSleepMilliseconds(100);
+    TEST_CHECK(memcmp(warm.ddram, "Kept  ", 6) == 0);
+    TEST_CHECK(memcmp(&warm.ddram[LCD_DDRAM_LINE_LEN], "New", 3) == 0);
+
+    /* Same text again: only the cursor moves */
+    mark = host_bus.transactions;
+    TEST_CHECK(lcdiicDrawText(&warm, 0, 0, "Kept", 4) == 4);
+    TEST_CHECK(host_bus.transactions - mark <= 1);
+}
+
+static void testCold(void) {
+    systime_t start = chVTGetSystemTime();
+
+    /* Power-on state: 8-bit mode, the probe fails, the full sequence runs */
+    lcdiicStart(&cold, &coldlcd);
+    TEST_CHECK(lcdiicDrawText(&cold, 0, 0, "Cold", 4) == 4);
+    TEST_CHECK(lcdiicWaitReady(&cold, MS2ST(100)) == MSG_OK);
+    TEST_CHECK(chVTTimeElapsedSinceX(start) >= MS2ST(40));
+    TEST_CHECK(coldp->mode8 == false);
+    TEST_CHECK(memcmp(coldp->ddram, "Cold", 4) == 0);
+}
+
+static THD_FUNCTION(testThread, arg) {
+    (void)arg;
+
+    testWarm();
+    testCold();
+    done = true;
+}
+
+int main(void) {
+    chSysInit();
+    hostBusObjectInit();
+    warmp = hostBusAddLcd(PCF8574A_SAD_0X3E);
+    coldp = hostBusAddLcd(PCF8574A_SAD_0X3F);
+
+    pcf8574ObjectInit(&warmpcf);
+    pcf8574Start(&warmpcf, &warmcfg);
+    lcdiicPcf8574PortObjectInit(&warmport, &warmpcf, &warmcfg);
+    lcdiicObjectInit(&warm, delayUs, delayMs);
+
+    pcf8574ObjectInit(&coldpcf);
+    pcf8574Start(&coldpcf, &coldcfg);
+    lcdiicPcf8574PortObjectInit(&coldport, &coldpcf, &coldcfg);
+    lcdiicObjectInit(&cold, delayUs, delayMs);
+
+    chThdCreateStatic(waTest, sizeof(waTest), LCDIIC_SERVICE_PRIORITY + 1, testThread, NULL);
+    while (!done) {
+        chThdSleepMilliseconds(10);
+    }
+
+    return hostTestEnd("test_warm");
+}
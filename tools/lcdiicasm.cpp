@@ -0,0 +1,355 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host tool, run by the Makefile: assembles a display list program for
+ * lcdiicdl.c into a C header holding its bytecode and tables.
+ *
+ * Usage: lcdiicasm <program.lcd> <output.h>
+ *
+ * Source, one statement per line, ';' starts a comment:
+ *   .program <name>                 C name of the LCDIICProgram
+ *   .text <name> "string"           text table entry
+ *   .glyph <name> b0 .. b7          CGRAM pattern, 8 rows
+ *   <label>:
+ *   move <row> <col>
+ *   text <name>
+ *   field <index> <width>
+ *   glyph <position> <name>
+ *   shift display|cursor left|right
+ *   wait <ms>                       1 to 65535, ends the step
+ *   jchg <field> <label>            jump if the field changed, field below
+ *                                   LCDIIC_DL_FIELDS
+ *   jmp <label>
+ *   end
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/* Must match lcdiicdl.h */
+enum {
+    DL_END = 0x00,
+    DL_MOVE = 0x01,
+    DL_TEXT = 0x02,
+    DL_FIELD = 0x03,
+    DL_GLYPH = 0x04,
+    DL_SHIFT = 0x05,
+    DL_WAIT = 0x06,
+    DL_JCHG = 0x07,
+    DL_JMP = 0x08,
+};
+
+const unsigned DL_SHIFT_DISPLAY = 0x01;
+const unsigned DL_SHIFT_RIGHT = 0x02;
+const unsigned DDRAM_LINE_LEN = 40;
+
+struct Line {
+    int lineno;
+    std::vector<std::string> words;
+};
+
+std::string source;
+
+void fail(int line, const std::string &msg) {
+    std::fprintf(stderr, "%s:%d: %s\n", source.c_str(), line, msg.c_str());
+    std::exit(1);
+}
+
+unsigned number(const Line &l, size_t idx, unsigned max) {
+    char *end;
+
+    if (idx >= l.words.size()) {
+        fail(l.lineno, "missing operand");
+    }
+
+    unsigned long val = std::strtoul(l.words[idx].c_str(), &end, 0);
+    if (*end != '\0' || val > max) {
+        fail(l.lineno, "bad operand '" + l.words[idx] + "'");
+    }
+
+    return val;
+}
+
+/* Words, keeping a quoted string as one word without its quotes */
+std::vector<std::string> split(const std::string &text, int lineno) {
+    std::vector<std::string> words;
+    size_t pos = 0;
+
+    while (pos < text.size()) {
+        if (text[pos] == ';') {
+            break;
+        } else if (isspace((unsigned char)text[pos])) {
+            pos++;
+        } else if (text[pos] == '"') {
+            size_t end = text.find('"', pos + 1);
+
+            if (end == std::string::npos) {
+                fail(lineno, "unterminated string");
+            }
+            words.push_back(text.substr(pos + 1, end - pos - 1));
+            pos = end + 1;
+        } else {
+            size_t end = pos;
+
+            while (end < text.size() && !isspace((unsigned char)text[end]) && text[end] != ';') {
+                end++;
+            }
+            words.push_back(text.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+
+    return words;
+}
+
+size_t length(const std::string &op) {
+    static const std::map<std::string, size_t> sizes = {
+        { "move", 3 }, { "text", 2 }, { "field", 3 }, { "glyph", 3 },
+        { "shift", 2 }, { "wait", 3 }, { "jchg", 4 }, { "jmp", 3 }, { "end", 1 },
+    };
+    auto it = sizes.find(op);
+
+    return it == sizes.end() ? 0 : it->second;
+}
+
+std::string cstring(const std::string &text) {
+    std::string out;
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+
+    return out;
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::vector<Line> code;
+    std::map<std::string, unsigned> labels, texts, glyphs;
+    std::vector<std::string> textv;
+    std::vector<std::vector<unsigned>> glyphv;
+    std::vector<unsigned char> out;
+    std::string name, line;
+    int lineno = 0;
+    size_t pc = 0;
+    unsigned fields = 0;
+
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <program.lcd> <output.h>\n", argv[0]);
+        return 1;
+    }
+
+    source = argv[1];
+    std::ifstream in(argv[1]);
+    if (!in) {
+        fail(0, "cannot open");
+    }
+
+    /* Pass 1: directives and label offsets */
+    while (std::getline(in, line)) {
+        Line l = { ++lineno, split(line, lineno) };
+
+        if (l.words.empty()) {
+            continue;
+        }
+
+        const std::string &w = l.words[0];
+
+        if (w[w.size() - 1] == ':') {
+            std::string label = w.substr(0, w.size() - 1);
+
+            if (labels.count(label)) {
+                fail(lineno, "duplicate label '" + label + "'");
+            }
+            labels[label] = pc;
+            l.words.erase(l.words.begin());
+            if (l.words.empty()) {
+                continue;
+            }
+        }
+
+        if (l.words[0] == ".program" && l.words.size() == 2) {
+            name = l.words[1];
+        } else if (l.words[0] == ".text" && l.words.size() == 3) {
+            if (texts.count(l.words[1])) {
+                fail(lineno, "duplicate text '" + l.words[1] + "'");
+            }
+            texts[l.words[1]] = textv.size();
+            textv.push_back(l.words[2]);
+        } else if (l.words[0] == ".glyph" && l.words.size() == 10) {
+            std::vector<unsigned> rows;
+
+            for (size_t idx = 2; idx < 10; idx++) {
+                rows.push_back(number(l, idx, 0x1f));
+            }
+            if (glyphs.count(l.words[1])) {
+                fail(lineno, "duplicate glyph '" + l.words[1] + "'");
+            }
+            glyphs[l.words[1]] = glyphv.size();
+            glyphv.push_back(rows);
+        } else if (length(l.words[0]) != 0) {
+            pc += length(l.words[0]);
+            code.push_back(l);
+        } else {
+            fail(lineno, "unknown statement '" + l.words[0] + "'");
+        }
+    }
+
+    if (name.empty()) {
+        fail(lineno, "missing .program");
+    }
+    if (pc > 0xffff || textv.size() > 0xff || glyphv.size() > 0xff) {
+        fail(lineno, "program too large");
+    }
+
+    /* Pass 2: bytecode */
+    for (const Line &l : code) {
+        const std::string &op = l.words[0];
+        auto target = [&](size_t idx) {
+            if (idx >= l.words.size() || !labels.count(l.words[idx])) {
+                fail(l.lineno, "unknown label");
+            }
+            unsigned addr = labels[l.words[idx]];
+            out.push_back(addr & 0xff);
+            out.push_back(addr >> 8);
+        };
+        auto lookup = [&](std::map<std::string, unsigned> &table, size_t idx) {
+            if (idx >= l.words.size() || !table.count(l.words[idx])) {
+                fail(l.lineno, "unknown name");
+            }
+            out.push_back(table[l.words[idx]]);
+        };
+
+        if (op == "move") {
+            out.push_back(DL_MOVE);
+            out.push_back(number(l, 1, 1));
+            out.push_back(number(l, 2, DDRAM_LINE_LEN - 1));
+        } else if (op == "text") {
+            out.push_back(DL_TEXT);
+            lookup(texts, 1);
+        } else if (op == "field") {
+            out.push_back(DL_FIELD);
+            out.push_back(number(l, 1, 0xff));
+            out.push_back(number(l, 2, DDRAM_LINE_LEN));
+        } else if (op == "glyph") {
+            out.push_back(DL_GLYPH);
+            out.push_back(number(l, 1, 7));
+            lookup(glyphs, 2);
+        } else if (op == "shift") {
+            if (l.words.size() != 3 || (l.words[1] != "display" && l.words[1] != "cursor") ||
+                    (l.words[2] != "left" && l.words[2] != "right")) {
+                fail(l.lineno, "shift display|cursor left|right");
+            }
+            out.push_back(DL_SHIFT);
+            out.push_back((l.words[1] == "display" ? DL_SHIFT_DISPLAY : 0) |
+                    (l.words[2] == "right" ? DL_SHIFT_RIGHT : 0));
+        } else if (op == "wait") {
+            unsigned ms = number(l, 1, 0xffff);
+
+            if (ms == 0) {
+                fail(l.lineno, "wait needs at least 1 ms");
+            }
+            out.push_back(DL_WAIT);
+            out.push_back(ms & 0xff);
+            out.push_back(ms >> 8);
+        } else if (op == "jchg") {
+            unsigned field = number(l, 1, 0xff);
+
+            out.push_back(DL_JCHG);
+            out.push_back(field);
+            fields = std::max(fields, field + 1);
+            target(2);
+        } else if (op == "jmp") {
+            out.push_back(DL_JMP);
+            target(1);
+        } else {
+            out.push_back(DL_END);
+        }
+    }
+
+    std::string guard = "__" + name + "_H__";
+    for (char &c : guard) {
+        c = toupper((unsigned char)c);
+    }
+
+    std::ofstream of(argv[2]);
+    of << "/* Generated by tools/lcdiicasm from " << argv[1] << ", do not edit */\n"
+       << "#ifndef " << guard << "\n"
+       << "#define " << guard << "\n\n"
+       << "#include \"lcdiicdl.h\"\n\n";
+
+    /* The fields watched by jchg are set by the firmware, checked at build time */
+    if (fields != 0) {
+        of << "#if LCDIIC_DL_FIELDS < " << fields << "\n"
+           << "#error \"" << name << " needs LCDIIC_DL_FIELDS of " << fields << " or more\"\n"
+           << "#endif\n\n";
+    }
+
+    of << "static const uint8_t " << name << "_code[] = {";
+    for (size_t idx = 0; idx < out.size(); idx++) {
+        char hex[8];
+
+        std::snprintf(hex, sizeof(hex), "0x%02x,", out[idx]);
+        of << (idx % 12 == 0 ? "\n    " : " ") << hex;
+    }
+    of << "\n};\n";
+
+    if (!textv.empty()) {
+        of << "\nstatic const char * const " << name << "_texts[] = {\n";
+        for (const std::string &t : textv) {
+            of << "    \"" << cstring(t) << "\",\n";
+        }
+        of << "};\n";
+    }
+
+    if (!glyphv.empty()) {
+        of << "\nstatic const uint8_t " << name << "_glyphs[][8] = {\n";
+        for (const std::vector<unsigned> &g : glyphv) {
+            char hex[8];
+
+            of << "    {";
+            for (size_t idx = 0; idx < g.size(); idx++) {
+                std::snprintf(hex, sizeof(hex), " 0x%02x%s", g[idx], idx + 1 < g.size() ? "," : " ");
+                of << hex;
+            }
+            of << "},\n";
+        }
+        of << "};\n";
+    }
+
+    of << "\nstatic const LCDIICProgram " << name << " = {\n"
+       << "    " << name << "_code, " << out.size() << ",\n"
+       << "    " << (textv.empty() ? "NULL" : name + "_texts") << ", " << textv.size() << ",\n"
+       << "    " << (glyphv.empty() ? "NULL" : name + "_glyphs") << ", " << glyphv.size() << ",\n"
+       << "};\n\n"
+       << "#endif /* " << guard << " */\n";
+
+    return of ? 0 : 1;
+}
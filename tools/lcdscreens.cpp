@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2016 https://www.brobwind.com
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host tool, run by the Makefile: turns the screen definitions into frame
+ * streams already encoded for the PCF8574T pin mapping, to be sent with
+ * lcdiicDrawScreen().
+ *
+ * Usage: lcdscreens <screens.def> <output.h>
+ *
+ * Definitions:
+ *   # comment
+ *   screen <name> [rle]
+ *   |one row, between bars|
+ *   |up to two rows, all of the same width|
+ *   end
+ *
+ * Stream: records ended by a 0x00 byte. A header byte below 0x80 is followed
+ * by that many bytes, sent as one I2C transaction straight from flash. With
+ * rle, runs of the same character become 0x80 | count followed by the 6
+ * bytes of one 4-bit write, repeated count times.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+/* Must match lcdiic.h */
+const unsigned STREAM_RLE = 0x80;
+const unsigned STREAM_MAX = 0x7f;
+const unsigned DDRAM_LINE_LEN = 40;
+const unsigned MAX_ROWS = 2;
+
+/* PCF8574T: P0 - RS, P1 - RW, P2 - E, P3 - BL, P4..P7 - D4..D7 */
+const unsigned PIN_RS = 0x01;
+const unsigned PIN_EN = 0x04;
+const unsigned PIN_BL = 0x08;
+
+const unsigned CMD_SET_DDRAM_ADDR = 0x80;
+
+struct Screen {
+    std::string name;
+    bool rle;
+    std::vector<std::string> rows;
+    int line;
+};
+
+typedef std::vector<unsigned char> Bytes;
+
+void fail(const std::string &file, int line, const std::string &msg) {
+    std::fprintf(stderr, "%s:%d: %s\n", file.c_str(), line, msg.c_str());
+    std::exit(1);
+}
+
+/* One 4-bit write: each nibble is latched on the falling edge of EN */
+Bytes encode(bool data, unsigned val) {
+    unsigned ctl = PIN_BL | (data ? PIN_RS : 0);
+    Bytes out;
+
+    for (unsigned nibble : { val >> 4, val & 0x0f }) {
+        out.push_back(ctl | (nibble << 4));
+        out.push_back(ctl | (nibble << 4) | PIN_EN);
+        out.push_back(ctl | (nibble << 4));
+    }
+
+    return out;
+}
+
+void raw(Bytes &stream, const Bytes &bytes) {
+    size_t pos = 0;
+
+    /* Split on write boundaries */
+    while (pos < bytes.size()) {
+        size_t n = bytes.size() - pos;
+
+        if (n > STREAM_MAX - STREAM_MAX % 6) {
+            n = STREAM_MAX - STREAM_MAX % 6;
+        }
+        stream.push_back(n);
+        stream.insert(stream.end(), bytes.begin() + pos, bytes.begin() + pos + n);
+        pos += n;
+    }
+}
+
+Bytes render(const Screen &s) {
+    Bytes stream;
+
+    for (size_t row = 0; row < s.rows.size(); row++) {
+        const std::string &text = s.rows[row];
+        Bytes pending = encode(false, CMD_SET_DDRAM_ADDR | (row * 0x40));
+        size_t col = 0;
+
+        while (col < text.size()) {
+            size_t run = 1;
+
+            while (col + run < text.size() && text[col + run] == text[col] && run < STREAM_MAX) {
+                run++;
+            }
+
+            /* A record header costs one byte, a write six */
+            if (s.rle && run >= 2) {
+                raw(stream, pending);
+                pending.clear();
+
+                Bytes w = encode(true, (unsigned char)text[col]);
+                stream.push_back(STREAM_RLE | run);
+                stream.insert(stream.end(), w.begin(), w.end());
+                col += run;
+            } else {
+                Bytes w = encode(true, (unsigned char)text[col]);
+                pending.insert(pending.end(), w.begin(), w.end());
+                col++;
+            }
+        }
+
+        raw(stream, pending);
+    }
+
+    stream.push_back(0x00);
+    return stream;
+}
+
+std::string cstring(const std::string &text) {
+    std::string out;
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+
+    return out;
+}
+
+}
+
+int main(int argc, char **argv) {
+    std::vector<Screen> screens;
+    Screen *cur = nullptr;
+    std::string line;
+    int lineno = 0;
+
+    if (argc != 3) {
+        std::fprintf(stderr, "usage: %s <screens.def> <output.h>\n", argv[0]);
+        return 1;
+    }
+
+    std::ifstream in(argv[1]);
+    if (!in) {
+        fail(argv[1], 0, "cannot open");
+    }
+
+    while (std::getline(in, line)) {
+        lineno++;
+
+        if (!line.empty() && line[line.size() - 1] == '\r') {
+            line.erase(line.size() - 1);
+        }
+
+        if (cur != nullptr && !line.empty() && line[0] == '|') {
+            if (line.size() < 2 || line[line.size() - 1] != '|') {
+                fail(argv[1], lineno, "row must end with '|'");
+            }
+
+            std::string text = line.substr(1, line.size() - 2);
+            if (text.empty() || text.size() > DDRAM_LINE_LEN) {
+                fail(argv[1], lineno, "row must hold 1 to 40 characters");
+            }
+            if (!cur->rows.empty() && cur->rows[0].size() != text.size()) {
+                fail(argv[1], lineno, "rows of a screen must have the same width");
+            }
+            if (cur->rows.size() == MAX_ROWS) {
+                fail(argv[1], lineno, "too many rows");
+            }
+            cur->rows.push_back(text);
+            continue;
+        }
+
+        std::istringstream words(line);
+        std::string word;
+
+        if (!(words >> word) || word[0] == '#') {
+            continue;
+        }
+
+        if (word == "screen" && cur == nullptr) {
+            Screen s;
+
+            if (!(words >> s.name)) {
+                fail(argv[1], lineno, "screen needs a name");
+            }
+            s.rle = (words >> word) && word == "rle";
+            s.line = lineno;
+            screens.push_back(s);
+            cur = &screens.back();
+        } else if (word == "end" && cur != nullptr) {
+            if (cur->rows.empty()) {
+                fail(argv[1], lineno, "empty screen");
+            }
+            cur = nullptr;
+        } else {
+            fail(argv[1], lineno, "unexpected '" + word + "'");
+        }
+    }
+
+    if (cur != nullptr) {
+        fail(argv[1], cur->line, "screen without end");
+    }
+
+    std::ofstream out(argv[2]);
+    out << "/* Generated by tools/lcdscreens from " << argv[1] << ", do not edit */\n"
+        << "#ifndef __LCDSCREENS_H__\n"
+        << "#define __LCDSCREENS_H__\n\n"
+        << "#include \"lcdiic.h\"\n";
+
+    for (const Screen &s : screens) {
+        Bytes stream = render(s);
+        std::string text;
+        char hex[8];
+
+        for (const std::string &row : s.rows) {
+            text += row;
+        }
+
+        out << "\n/* " << s.name << ": " << stream.size() << " bytes */\n"
+            << "static const uint8_t lcdscreen_" << s.name << "_stream[] = {";
+        for (size_t idx = 0; idx < stream.size(); idx++) {
+            std::snprintf(hex, sizeof(hex), "0x%02x,", stream[idx]);
+            out << (idx % 12 == 0 ? "\n    " : " ") << hex;
+        }
+        out << "\n};\n\n"
+            << "static const LCDIICScreen lcdscreen_" << s.name << " = {\n"
+            << "    lcdscreen_" << s.name << "_stream,\n"
+            << "    \"" << cstring(text) << "\",\n"
+            << "    " << s.rows.size() << ", " << s.rows[0].size() << ",\n"
+            << "};\n";
+    }
+
+    out << "\n#endif /* __LCDSCREENS_H__ */\n";
+
+    return out ? 0 : 1;
+}
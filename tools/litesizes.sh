@@ -0,0 +1,60 @@
+#!/bin/sh
+#
+# Copyright (C) 2016 https://www.brobwind.com
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Flash and RAM saved by each option of the lite build profile, read from the
+# linker map: the firmware is built once as it is and once per option, in
+# build/lite/<option>, and the sizes of the .text, .rodata, .data and .bss
+# output sections of ch.map are compared. Prints the README table.
+#
+# Usage, from the top of the tree: tools/litesizes.sh [make options]
+#
+
+set -e
+
+MAKEOPTS="$*"
+UDEFS_BASE="-DCHPRINTF_USE_FLOAT=0"
+OPTIONS="PCF8574_USE_VMT LCDIIC_USE_VMT LCDIIC_USE_MUTEX LCDIIC_USE_DELAY_CALLBACKS
+LCDIIC_USE_READBACK LCDIIC_USE_BLINK LCDIIC_USE_QUEUE PCF8574_USE_QUEUE"
+
+# Output section sizes of a map, as "flash ram": .data counts in both
+sizes() {
+    awk '/^\.(text|rodata|data|bss)[ \t]/ && $2 ~ /^0x/ && $3 ~ /^0x/ { print $1, $3 }' "$1" |
+    while read -r sect size; do
+        echo "$sect $((size))"
+    done |
+    awk '{ s[$1] += $2 }
+         END { print s[".text"] + s[".rodata"] + s[".data"], s[".data"] + s[".bss"] }'
+}
+
+build() {
+    make -s BUILDDIR="build/lite/$1" UDEFS="$UDEFS_BASE $2" $MAKEOPTS >/dev/null
+}
+
+build base ""
+set -- $(sizes build/lite/base/ch.map)
+base_flash=$1
+base_ram=$2
+
+echo "| Option                            | Flash saved | RAM saved |"
+echo "| --------------------------------- | ----------- | --------- |"
+for opt in $OPTIONS; do
+    build "$opt" "-D$opt=FALSE"
+    set -- $(sizes "build/lite/$opt/ch.map")
+    printf "| %-33s | %5d bytes | %3d bytes |\n" "$opt=FALSE" \
+        $((base_flash - $1)) $((base_ram - $2))
+done